@@ -0,0 +1,71 @@
+// Compares the cost of getLineDiffs() with each diff algorithm on large
+// generated files.
+//
+//   node benchmark/line-diffs.js [lines]
+
+const {execFileSync} = require('child_process')
+const fs = require('fs-plus')
+const path = require('path')
+const temp = require('temp').track()
+const git = require('../src/git')
+
+const lineCount = parseInt(process.argv[2] || '200000', 10)
+const iterations = 5
+
+function generatedLines () {
+  const lines = []
+  for (let i = 0; i < lineCount; i++) {
+    lines.push(`  "entry${i}": {"id": ${i}, "hash": "${(i * 2654435761 % 4294967296).toString(16)}"},\n`)
+  }
+  return lines
+}
+
+function minifiedBundle () {
+  const statements = []
+  for (let i = 0; i < lineCount; i++) statements.push(`var a${i}=function(b){return b*${i}};`)
+  return statements.join('') + '\n'
+}
+
+function createRepository () {
+  const directory = temp.mkdirSync('git-utils-benchmark-')
+  const run = (...args) => execFileSync('git', args, {cwd: directory, stdio: 'ignore'})
+  run('init')
+  fs.writeFileSync(path.join(directory, 'generated.json'), generatedLines().join(''))
+  fs.writeFileSync(path.join(directory, 'bundle.min.js'), minifiedBundle())
+  run('add', '.')
+  run('-c', 'user.name=benchmark', '-c', 'user.email=benchmark@example.com', 'commit', '-q', '-m', 'initial')
+  return directory
+}
+
+function measure (repo, name, filePath, text, options) {
+  repo.getLineDiffs(filePath, text, options)
+  const start = process.hrtime()
+  let diffs
+  for (let i = 0; i < iterations; i++) diffs = repo.getLineDiffs(filePath, text, options)
+  const [seconds, nanoseconds] = process.hrtime(start)
+  const milliseconds = (seconds * 1e3 + nanoseconds / 1e6) / iterations
+  console.log(`${name.padEnd(40)} ${milliseconds.toFixed(2).padStart(10)} ms ${String(diffs.length).padStart(8)} hunks`)
+}
+
+function main () {
+  const repo = git.open(createRepository())
+  console.log(`${lineCount} lines, mean of ${iterations} runs\n`)
+
+  const oneEdit = generatedLines()
+  oneEdit[Math.floor(lineCount / 2)] = '  "edited": true,\n'
+  const scatteredEdits = generatedLines()
+  for (let i = 0; i < lineCount; i += 100) scatteredEdits[i] = `  "edited${i}": true,\n`
+  const bundle = minifiedBundle().replace('var a0=', 'var a0x=')
+
+  for (const algorithm of ['myers', 'patience', 'minimal']) {
+    measure(repo, `one edit, ${algorithm}`, 'generated.json', oneEdit.join(''), {algorithm})
+  }
+  for (const algorithm of ['myers', 'patience', 'minimal']) {
+    measure(repo, `scattered edits, ${algorithm}`, 'generated.json', scatteredEdits.join(''), {algorithm})
+  }
+  measure(repo, 'scattered edits, maxHunks: 100', 'generated.json', scatteredEdits.join(''), {maxHunks: 100})
+  measure(repo, 'minified bundle', 'bundle.min.js', bundle, {})
+  repo.release()
+}
+
+main()
@@ -0,0 +1,39 @@
+// Measures collecting the status of a large number of paths, with the number
+// of heap allocations the native status collector made per scan.
+//
+//   node benchmark/status-collection.js [untrackedFiles]
+
+const fs = require('fs-plus')
+const path = require('path')
+const temp = require('temp').track()
+const git = require('../src/git')
+
+const untrackedCount = parseInt(process.argv[2] || '200000', 10)
+const iterations = 5
+
+function createRepository () {
+  const directory = temp.mkdirSync('git-utils-benchmark-')
+  fs.copySync(path.join(__dirname, '..', 'spec', 'fixtures', 'master.git'), path.join(directory, '.git'))
+  for (let i = 0; i < untrackedCount; i++) {
+    fs.writeFileSync(path.join(directory, `dir${i % 1000}`, `file${i}.txt`), '')
+  }
+  return directory
+}
+
+async function main () {
+  const repo = git.open(createRepository())
+  await repo.getStatusAsync()
+
+  repo.setPerformanceStatsEnabled(true)
+  let statuses
+  for (let i = 0; i < iterations; i++) statuses = await repo.getStatusAsync()
+
+  const {totalTime, allocations} = repo.getPerformanceStats().operations.getStatusAsync
+  const count = Object.keys(statuses).length
+  console.log(`${count} paths, mean of ${iterations} scans`)
+  console.log(`latency:     ${(totalTime / iterations).toFixed(2)} ms`)
+  console.log(`allocations: ${allocations / iterations} per scan`)
+  repo.release()
+}
+
+main()
@@ -0,0 +1,59 @@
+// Compares the cost of the scanStatusAsync() profiles on a repository with a
+// large untracked directory.
+//
+//   node benchmark/status-options.js [trackedFiles] [untrackedFiles]
+
+const {execFileSync} = require('child_process')
+const fs = require('fs-plus')
+const path = require('path')
+const temp = require('temp').track()
+const git = require('../src/git')
+
+const trackedCount = parseInt(process.argv[2] || '2000', 10)
+const untrackedCount = parseInt(process.argv[3] || '20000', 10)
+const iterations = 10
+
+function createRepository () {
+  const directory = temp.mkdirSync('git-utils-benchmark-')
+  const run = (...args) => execFileSync('git', args, {cwd: directory, stdio: 'ignore'})
+  run('init')
+  for (let i = 0; i < trackedCount; i++) {
+    fs.writeFileSync(path.join(directory, 'src', `dir${i % 50}`, `file${i}.txt`), `${i}\n`)
+  }
+  run('add', '.')
+  run('-c', 'user.name=benchmark', '-c', 'user.email=benchmark@example.com', 'commit', '-q', '-m', 'initial')
+
+  for (let i = 0; i < trackedCount; i += 10) {
+    fs.writeFileSync(path.join(directory, 'src', `dir${i % 50}`, `file${i}.txt`), 'modified\n')
+  }
+  for (let i = 0; i < untrackedCount; i++) {
+    fs.writeFileSync(path.join(directory, 'node_modules', `package${i % 500}`, `file${i}.js`), '')
+  }
+  return directory
+}
+
+async function measure (repo, name, options) {
+  await repo.scanStatusAsync(options)
+  const start = process.hrtime()
+  let result
+  for (let i = 0; i < iterations; i++) result = await repo.scanStatusAsync(options)
+  const [seconds, nanoseconds] = process.hrtime(start)
+  const milliseconds = (seconds * 1e3 + nanoseconds / 1e6) / iterations
+  const count = Object.keys(result.statuses).length
+  console.log(`${name.padEnd(32)} ${milliseconds.toFixed(2).padStart(10)} ms ${String(count).padStart(8)} paths`)
+}
+
+async function main () {
+  const repo = git.open(createRepository())
+  console.log(`${trackedCount} tracked files, ${untrackedCount} untracked files, mean of ${iterations} runs\n`)
+  await measure(repo, 'default', {})
+  await measure(repo, 'collapseUntrackedDirectories', {collapseUntrackedDirectories: true})
+  await measure(repo, 'mode: tracked', {mode: 'tracked'})
+  await measure(repo, 'mode: untracked', {mode: 'untracked'})
+  await measure(repo, 'skipHeadToIndex', {skipHeadToIndex: true})
+  await measure(repo, 'excludeSubmodules', {excludeSubmodules: true})
+  await measure(repo, 'maxEntries: 100', {maxEntries: 100})
+  repo.release()
+}
+
+main()
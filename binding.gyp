@@ -7,7 +7,26 @@
       ],
       'include_dirs': [ '<!(node -e "require(\'nan\')")' ],
       'sources': [
-        'src/repository.cc'
+        'src/blame-cache.cc',
+        'src/buffer-diff.cc',
+        'src/cancellation.cc',
+        'src/commit-cache.cc',
+        'src/commit-graph.cc',
+        'src/grep.cc',
+        'src/hash-cache.cc',
+        'src/index-refresh.cc',
+        'src/instrumentation.cc',
+        'src/path-history.cc',
+        'src/path-table.cc',
+        'src/repository.cc',
+        'src/repository-registry.cc',
+        'src/status-cache.cc',
+        'src/status-cache-file.cc',
+        'src/status-list.cc',
+        'src/status-renames.cc',
+        'src/thread-pool.cc',
+        'src/tracked-paths.cc',
+        'src/tree-diff.cc'
       ],
       'conditions': [
         ['OS=="win"', {
@@ -18,14 +37,21 @@
             4267,  # conversion from 'size_t' to 'int', possible loss of data
             4344,  # behavior change
           ],
+          'msvs_settings': {
+            'VCCLCompilerTool': {
+              'ExceptionHandling': 1,  # std::regex reports errors by throwing.
+            },
+          },
         }, {
           'cflags': [
             '-Wno-missing-field-initializers',
           ],
           'cflags_cc!': [
             '-fno-delete-null-pointer-checks', # clang-3.4 doesn't understand this flag and fails.
+            '-fno-exceptions',  # std::regex reports errors by throwing.
           ],
           'xcode_settings': {
+            'GCC_ENABLE_CPP_EXCEPTIONS': 'YES',
             'WARNING_CFLAGS': [
               '-Wno-missing-field-initializers',
             ],
@@ -842,6 +842,60 @@ describe('git', () => {
         })
       })
     })
+
+    describe('algorithm option', () => {
+      it('diffs with the patience and minimal algorithms', () => {
+        repo = git.open(path.join(__dirname, 'fixtures/master.git'))
+
+        for (const algorithm of ['myers', 'patience', 'histogram', 'minimal']) {
+          const diffs = repo.getLineDiffs('a.txt', 'first line\nsecond line', {algorithm})
+          expect(diffs).toEqual([{oldStart: 1, oldLines: 0, newStart: 2, newLines: 1}])
+        }
+      })
+    })
+
+    describe('large files', () => {
+      let lines
+
+      beforeEach(() => {
+        const repoDirectory = temp.mkdirSync('node-git-repo-')
+        wrench.copyDirSyncRecursive(path.join(__dirname, 'fixtures/master.git'), path.join(repoDirectory, '.git'))
+        repo = git.open(repoDirectory)
+
+        lines = []
+        for (let i = 1; i <= 20000; i++) lines.push(`line ${i}\n`)
+        fs.writeFileSync(path.join(repoDirectory, 'large.txt'), lines.join(''), 'utf8')
+        repo.add('large.txt')
+      })
+
+      it('numbers the hunks as in the whole file', () => {
+        lines[9999] = 'changed\n'
+        lines.splice(15000, 0, 'inserted\n')
+        const diffs = repo.getLineDiffs('large.txt', lines.join(''), {useIndex: true})
+        expect(diffs).toEqual([
+          {oldStart: 10000, oldLines: 1, newStart: 10000, newLines: 1},
+          {oldStart: 15000, oldLines: 0, newStart: 15001, newLines: 1}
+        ])
+
+        const details = repo.getLineDiffDetails('large.txt', lines.join(''), {useIndex: true})
+        expect(details.map(({oldLineNumber, newLineNumber, line}) => ({oldLineNumber, newLineNumber, line}))).toEqual([
+          {oldLineNumber: 10000, newLineNumber: -1, line: 'line 10000\n'},
+          {oldLineNumber: -1, newLineNumber: 10000, line: 'changed\n'},
+          {oldLineNumber: -1, newLineNumber: 15001, line: 'inserted\n'}
+        ])
+      })
+
+      it('returns the whole changed region as one hunk past maxHunks', () => {
+        lines[99] = 'changed\n'
+        lines[199] = 'changed\n'
+        lines[299] = 'changed\n'
+        let diffs = repo.getLineDiffs('large.txt', lines.join(''), {useIndex: true, maxHunks: 2})
+        expect(diffs).toEqual([{oldStart: 100, oldLines: 201, newStart: 100, newLines: 201}])
+
+        diffs = repo.getLineDiffs('large.txt', lines.join(''), {useIndex: true, maxHunks: 3})
+        expect(diffs.length).toBe(3)
+      })
+    })
   })
 
   describe('.getLineDiffDetails(path, text, options)', () => {
@@ -1088,6 +1142,21 @@ describe('git', () => {
       expect(repo.submoduleForPath('sub/a').getPath()).toBe(submoduleRepoPath)
       expect(repo.submoduleForPath('sub/a/b/c/d').getPath()).toBe(submoduleRepoPath)
     })
+
+    it('returns the repository for absolute paths', () => {
+      let submoduleRepoPath = path.join(repo.getPath(), 'modules', 'sub/')
+      if (process.platform === 'win32') { submoduleRepoPath = submoduleRepoPath.replace(/\\/g, '/') }
+      const workingDirectory = repo.getWorkingDirectory()
+
+      expect(repo.submoduleForPath(workingDirectory)).toBe(null)
+      expect(repo.submoduleForPath(path.join(workingDirectory, 'a.txt'))).toBe(null)
+      expect(repo.submoduleForPath(path.join(workingDirectory, 'sub')).getPath()).toBe(submoduleRepoPath)
+      expect(repo.submoduleForPath(path.join(workingDirectory, 'sub', 'a', 'b')).getPath()).toBe(submoduleRepoPath)
+      expect(repo.submoduleForPath(path.join(workingDirectory, 'SUB', 'a'))).toBe(null)
+
+      repo.caseInsensitiveFs = true
+      expect(repo.submoduleForPath(path.join(workingDirectory, 'SUB', 'a')).getPath()).toBe(submoduleRepoPath)
+    })
   })
 
   describe('.add(path)', () => {
@@ -1109,6 +1178,1008 @@ describe('git', () => {
     it("throws an error if the file doesn't exist", () => expect(() => repo.add('missing.txt')).toThrow())
   })
 
+  describe('.getPerformanceStats()', () => {
+    beforeEach(() => {
+      repo = git.open(path.join(__dirname, 'fixtures/master.git'))
+    })
+
+    it('does not record operations until enabled', () => {
+      repo.getHead()
+      const stats = repo.getPerformanceStats()
+      expect(stats.enabled).toBe(false)
+      expect(stats.operations).toEqual({})
+    })
+
+    it('records call counts and timings for sync and async operations', async () => {
+      repo.setPerformanceStatsEnabled(true)
+      repo.getHead()
+      repo.getHead()
+      repo.getHeadBlob('a.txt')
+      await repo.getHeadAsync()
+
+      const {operations, objectCache} = repo.getPerformanceStats()
+      expect(operations.getHead.calls).toBe(2)
+      expect(operations.getHead.maxTime).toBeGreaterThan(0)
+      expect(operations.getHead.totalTime).not.toBeLessThan(operations.getHead.maxTime)
+      expect(operations.getHeadBlob.bytes).toBeGreaterThan(0)
+      expect(operations.getHeadAsync.calls).toBe(1)
+      expect(operations.getHeadAsync.queueWaitTime).not.toBeLessThan(0)
+      expect(objectCache.maxBytes).toBeGreaterThan(0)
+    })
+
+    it('records a few allocations per status scan however many paths it finds', async () => {
+      const repoDirectory = temp.mkdirSync('node-git-repo-')
+      wrench.copyDirSyncRecursive(path.join(__dirname, 'fixtures/master.git'), path.join(repoDirectory, '.git'))
+      repo = git.open(repoDirectory)
+      for (let i = 0; i < 1000; i++) {
+        fs.writeFileSync(path.join(repoDirectory, 'untracked', `file${i}.txt`), '', 'utf8')
+      }
+
+      repo.setPerformanceStatsEnabled(true)
+      const statuses = await repo.getStatusAsync()
+      expect(_.keys(statuses).length).toBe(1001)
+
+      const {allocations} = repo.getPerformanceStats().operations.getStatusAsync
+      expect(allocations).toBeGreaterThan(0)
+      expect(allocations).toBeLessThan(20)
+    })
+
+    it('clears the recorded operations when reset', () => {
+      repo.setPerformanceStatsEnabled(true)
+      repo.getHead()
+      repo.resetPerformanceStats()
+      expect(repo.getPerformanceStats().operations).toEqual({})
+    })
+  })
+
+  describe('git.dumpTrace()', () => {
+    afterEach(() => git.stopTracing())
+
+    it('returns the traced native operations as Chrome trace-event JSON', async () => {
+      repo = git.open(path.join(__dirname, 'fixtures/master.git'))
+      git.startTracing()
+      repo.getStatus()
+      await repo.getHeadAsync()
+      git.stopTracing()
+      repo.getHead()
+
+      const {traceEvents} = JSON.parse(git.dumpTrace())
+      const statusEvents = traceEvents.filter(event => event.name === 'getStatus')
+      expect(statusEvents.map(event => event.ph).slice(-2)).toEqual(['B', 'E'])
+      expect(statusEvents[statusEvents.length - 2].args.repository).toBe(repo.getPath())
+
+      const headEvents = traceEvents.filter(event => event.name === 'getHeadAsync')
+      expect(headEvents.length).toBeGreaterThan(1)
+      expect(headEvents[headEvents.length - 1].tid).not.toBe(statusEvents[0].tid)
+
+      expect(traceEvents.filter(event => event.name === 'getHead').length).toBe(0)
+    })
+  })
+
+  describe('.getStatusForDirectoryAsync(directory)', () => {
+    beforeEach(() => {
+      const repoDirectory = temp.mkdirSync('node-git-repo-')
+      wrench.copyDirSyncRecursive(path.join(__dirname, 'fixtures/subdir.git'), path.join(repoDirectory, '.git'))
+      repo = git.open(repoDirectory)
+
+      const workingDirectory = repo.getWorkingDirectory()
+      fs.writeFileSync(path.join(workingDirectory, 'dir', 'a.txt'), 'hey there', 'utf8')
+      fs.writeFileSync(path.join(workingDirectory, 'dir', 'c.txt'), '', 'utf8')
+      fs.writeFileSync(path.join(workingDirectory, 'dir2', 'd.txt'), '', 'utf8')
+      fs.writeFileSync(path.join(workingDirectory, 'b.txt'), '', 'utf8')
+    })
+
+    it('resolves with the status of the paths inside the directory', async () => {
+      const statuses = await repo.getStatusForDirectoryAsync('dir')
+      expect(_.keys(statuses).sort()).toEqual(['dir/a.txt', 'dir/c.txt'])
+      expect(repo.isStatusModified(statuses['dir/a.txt'])).toBe(true)
+      expect(repo.isStatusNew(statuses['dir/c.txt'])).toBe(true)
+    })
+
+    it('accepts absolute paths and trailing slashes', async () => {
+      const directory = path.join(repo.getWorkingDirectory(), 'dir') + '/'
+      const statuses = await repo.getStatusForDirectoryAsync(directory)
+      expect(_.keys(statuses).sort()).toEqual(['dir/a.txt', 'dir/c.txt'])
+    })
+
+    it('matches the directory literally', async () => {
+      expect(await repo.getStatusForDirectoryAsync('d*')).toEqual({})
+    })
+
+    it('resolves with the status of all paths for the working directory', async () => {
+      const statuses = await repo.getStatusForDirectoryAsync(repo.getWorkingDirectory())
+      expect(_.keys(statuses).sort()).toEqual(['b.txt', 'dir/a.txt', 'dir/c.txt', 'dir2/d.txt'])
+    })
+
+    it('resolves with an empty object for a directory outside the repository', async () => {
+      const directory = temp.mkdirSync('node-git-outside-')
+      fs.writeFileSync(path.join(directory, 'e.txt'), '', 'utf8')
+      expect(await repo.getStatusForDirectoryAsync(directory)).toEqual({})
+    })
+  })
+
+  describe('.scanStatusAsync([options])', () => {
+    beforeEach(() => {
+      const repoDirectory = temp.mkdirSync('node-git-repo-')
+      wrench.copyDirSyncRecursive(path.join(__dirname, 'fixtures/master.git'), path.join(repoDirectory, '.git'))
+      repo = git.open(repoDirectory)
+
+      const workingDirectory = repo.getWorkingDirectory()
+      fs.writeFileSync(path.join(workingDirectory, 'b.txt'), '', 'utf8')
+      fs.writeFileSync(path.join(workingDirectory, 'build', 'x', 'y.txt'), '', 'utf8')
+      fs.writeFileSync(path.join(workingDirectory, '.git/info/exclude'), 'c.txt', 'utf8')
+      fs.writeFileSync(path.join(workingDirectory, 'c.txt'), '', 'utf8')
+      fs.writeFileSync(path.join(workingDirectory, 'd.txt'), 'staged', 'utf8')
+      repo.add('d.txt')
+    })
+
+    it('resolves with the same statuses as getStatusAsync by default', async () => {
+      const {statuses, truncated} = await repo.scanStatusAsync()
+      expect(statuses).toEqual(await repo.getStatusAsync())
+      expect(statuses).toEqual({
+        'a.txt': 1 << 9,
+        'b.txt': 1 << 7,
+        'build/x/y.txt': 1 << 7,
+        'd.txt': 1 << 0
+      })
+      expect(truncated).toBe(false)
+    })
+
+    it('reports untracked directories as a single entry when collapseUntrackedDirectories is set', async () => {
+      const {statuses} = await repo.scanStatusAsync({collapseUntrackedDirectories: true})
+      expect(_.keys(statuses).sort()).toEqual(['a.txt', 'b.txt', 'build/', 'd.txt'])
+      expect(repo.isStatusNew(statuses['build/'])).toBe(true)
+    })
+
+    it('only reports tracked paths in tracked mode', async () => {
+      const {statuses} = await repo.scanStatusAsync({mode: 'tracked'})
+      expect(statuses).toEqual({'a.txt': 1 << 9, 'd.txt': 1 << 0})
+    })
+
+    it('only reports untracked paths in untracked mode', async () => {
+      const {statuses} = await repo.scanStatusAsync({mode: 'untracked'})
+      expect(statuses).toEqual({'b.txt': 1 << 7, 'build/x/y.txt': 1 << 7})
+    })
+
+    it('does not compare the index to HEAD when skipHeadToIndex is set', async () => {
+      const {statuses} = await repo.scanStatusAsync({skipHeadToIndex: true})
+      expect(_.keys(statuses).sort()).toEqual(['a.txt', 'b.txt', 'build/x/y.txt'])
+    })
+
+    it('reports ignored paths when includeIgnored is set', async () => {
+      const {statuses} = await repo.scanStatusAsync({includeIgnored: true})
+      expect(repo.isStatusIgnored(statuses['c.txt'])).toBe(true)
+    })
+
+    it('stops after maxEntries paths', async () => {
+      const {statuses, truncated} = await repo.scanStatusAsync({maxEntries: 2})
+      expect(_.keys(statuses).length).toBe(2)
+      expect(truncated).toBe(true)
+    })
+
+    it('limits the scan to the given paths', async () => {
+      const {statuses} = await repo.scanStatusAsync({paths: ['build/'], literalPaths: true})
+      expect(statuses).toEqual({'build/x/y.txt': 1 << 7})
+    })
+
+    it('folds renamed paths into a single entry when detectRenames is set', async () => {
+      fs.writeFileSync(path.join(repo.getWorkingDirectory(), 'moved.txt'), 'first line\n', 'utf8')
+      const {statuses, renames} = await repo.scanStatusAsync({detectRenames: true})
+      expect(statuses).toEqual({
+        'b.txt': 1 << 7,
+        'build/x/y.txt': 1 << 7,
+        'd.txt': 1 << 0,
+        'moved.txt': 1 << 11
+      })
+      expect(renames).toEqual({'moved.txt': 'a.txt'})
+    })
+
+    it('finds identical files past the renameLimit', async () => {
+      fs.writeFileSync(path.join(repo.getWorkingDirectory(), 'moved.txt'), 'first line\n', 'utf8')
+      const {renames} = await repo.scanStatusAsync({detectRenames: true, renameLimit: 0})
+      expect(renames).toEqual({'moved.txt': 'a.txt'})
+    })
+
+    it('does not pair up unrelated paths', async () => {
+      const {statuses, renames} = await repo.scanStatusAsync({detectRenames: true})
+      expect(statuses['a.txt']).toBe(1 << 9)
+      expect(renames).toEqual({})
+    })
+
+    it('refreshes the stat data of unchanged index entries when updateIndex is set', async () => {
+      const indexPath = path.join(repo.getWorkingDirectory(), '.git', 'index')
+      const filePath = path.join(repo.getWorkingDirectory(), 'a.txt')
+      fs.writeFileSync(filePath, 'first line\n', 'utf8')
+      fs.utimesSync(filePath, new Date(2000, 0, 1), new Date(2000, 0, 1))
+      const index = fs.readFileSync(indexPath)
+      const {statuses} = await repo.scanStatusAsync({updateIndex: true})
+      expect(statuses['a.txt']).toBeUndefined()
+      expect(fs.readFileSync(indexPath).equals(index)).toBe(false)
+    })
+
+    it('does not write the index while another process holds its lock', async () => {
+      const indexPath = path.join(repo.getWorkingDirectory(), '.git', 'index')
+      const filePath = path.join(repo.getWorkingDirectory(), 'a.txt')
+      fs.writeFileSync(filePath, 'first line\n', 'utf8')
+      fs.utimesSync(filePath, new Date(2000, 0, 1), new Date(2000, 0, 1))
+      fs.writeFileSync(`${indexPath}.lock`, '')
+      const index = fs.readFileSync(indexPath)
+      const {statuses} = await repo.scanStatusAsync({updateIndex: true})
+      expect(statuses['a.txt']).toBeUndefined()
+      expect(fs.readFileSync(indexPath).equals(index)).toBe(true)
+      expect(fs.existsSync(`${indexPath}.lock`)).toBe(true)
+    })
+
+    it('does not trust hashes of files modified while they were read', async () => {
+      const filePath = path.join(repo.getWorkingDirectory(), 'a.txt')
+      const mtime = Math.floor(Date.now() / 1000) + 60
+      fs.writeFileSync(filePath, 'first line\n', 'utf8')
+      fs.utimesSync(filePath, mtime, mtime)
+      await repo.scanStatusAsync({updateIndex: true})
+
+      fs.writeFileSync(filePath, 'other line\n', 'utf8')
+      fs.utimesSync(filePath, mtime, mtime)
+      const {statuses} = await repo.scanStatusAsync({updateIndex: true})
+      expect(statuses['a.txt']).toBe(1 << 8)
+    })
+
+    it('saves file hashes to the .git directory when the persistent hash cache is enabled', async () => {
+      const filePath = path.join(repo.getWorkingDirectory(), 'a.txt')
+      fs.writeFileSync(filePath, 'first line\n', 'utf8')
+      fs.utimesSync(filePath, new Date(2000, 0, 1), new Date(2000, 0, 1))
+      repo.setPersistentHashCacheEnabled(true)
+      await repo.scanStatusAsync({updateIndex: true})
+      expect(fs.existsSync(path.join(repo.getWorkingDirectory(), '.git', 'git-utils-hash.cache'))).toBe(true)
+      expect(repo.getMemoryUsage().hashCache).toBeGreaterThan(0)
+    })
+  })
+
+  describe('.setFileSystemMonitor(monitor)', () => {
+    let changedPaths, monitor, workingDirectory
+
+    beforeEach(() => {
+      const repoDirectory = temp.mkdirSync('node-git-repo-')
+      wrench.copyDirSyncRecursive(path.join(__dirname, 'fixtures/master.git'), path.join(repoDirectory, '.git'))
+      repo = git.open(repoDirectory)
+      workingDirectory = repo.getWorkingDirectory()
+      fs.writeFileSync(path.join(workingDirectory, 'b.txt'), '', 'utf8')
+
+      changedPaths = []
+      monitor = {
+        getChangedPaths () {
+          const result = changedPaths
+          changedPaths = []
+          return result
+        }
+      }
+      repo.setFileSystemMonitor(monitor)
+    })
+
+    it('resolves with the same statuses as a full scan', async () => {
+      expect(await repo.getStatusAsync()).toEqual(repo.getStatus())
+
+      fs.writeFileSync(path.join(workingDirectory, 'a.txt'), 'changed', 'utf8')
+      fs.unlinkSync(path.join(workingDirectory, 'b.txt'))
+      fs.writeFileSync(path.join(workingDirectory, 'dir', 'c.txt'), '', 'utf8')
+      changedPaths = [
+        path.join(workingDirectory, 'a.txt'),
+        path.join(workingDirectory, 'b.txt'),
+        path.join(workingDirectory, 'dir')
+      ]
+
+      const statuses = await repo.getStatusAsync()
+      expect(statuses).toEqual(repo.getStatus())
+      expect(statuses).toEqual({
+        'a.txt': 1 << 8,
+        'dir/c.txt': 1 << 7
+      })
+    })
+
+    it('only rescans the paths reported by the monitor', async () => {
+      await repo.getStatusAsync()
+      fs.writeFileSync(path.join(workingDirectory, 'unreported.txt'), '', 'utf8')
+      expect(await repo.getStatusAsync()).toEqual({
+        'a.txt': 1 << 9,
+        'b.txt': 1 << 7
+      })
+    })
+
+    it('rescans everything when the monitor lost track of changes', async () => {
+      await repo.getStatusAsync()
+      fs.writeFileSync(path.join(workingDirectory, 'unreported.txt'), '', 'utf8')
+      changedPaths = null
+      expect(await repo.getStatusAsync()).toEqual(repo.getStatus())
+    })
+
+    it('rescans everything when the index changes', async () => {
+      await repo.getStatusAsync()
+      fs.writeFileSync(path.join(workingDirectory, 'unreported.txt'), '', 'utf8')
+      repo.add('b.txt')
+      expect(await repo.getStatusAsync()).toEqual(repo.getStatus())
+    })
+
+    it('rescans everything when an ignore file changes', async () => {
+      await repo.getStatusAsync()
+      fs.writeFileSync(path.join(workingDirectory, '.gitignore'), 'b.txt', 'utf8')
+      changedPaths = [path.join(workingDirectory, '.gitignore')]
+      const statuses = await repo.getStatusAsync()
+      expect(statuses).toEqual(repo.getStatus())
+      expect(statuses['b.txt']).toBeUndefined()
+    })
+
+    it('stops using the snapshot when the monitor is removed', async () => {
+      await repo.getStatusAsync()
+      fs.writeFileSync(path.join(workingDirectory, 'unreported.txt'), '', 'utf8')
+      repo.setFileSystemMonitor(null)
+      expect(await repo.getStatusAsync()).toEqual(repo.getStatus())
+    })
+  })
+
+  describe('.getCachedStatusAsync()', () => {
+    let repoDirectory, workingDirectory
+
+    beforeEach(() => {
+      repoDirectory = temp.mkdirSync('node-git-repo-')
+      wrench.copyDirSyncRecursive(path.join(__dirname, 'fixtures/master.git'), path.join(repoDirectory, '.git'))
+      repo = git.open(repoDirectory)
+      workingDirectory = repo.getWorkingDirectory()
+      fs.writeFileSync(path.join(workingDirectory, 'b.txt'), '', 'utf8')
+      fs.writeFileSync(path.join(workingDirectory, 'c.txt'), '', 'utf8')
+    })
+
+    it('resolves with null when no status was saved', async () => {
+      expect(await repo.getCachedStatusAsync()).toBeNull()
+    })
+
+    describe('when the persistent status cache is enabled', () => {
+      beforeEach(async () => {
+        repo.setPersistentStatusCacheEnabled(true)
+        await repo.getStatusAsync()
+        repo.release()
+        repo = git.open(repoDirectory)
+      })
+
+      it('resolves with the status saved by a previous session', async () => {
+        expect(await repo.getCachedStatusAsync()).toEqual({
+          'a.txt': 1 << 9,
+          'b.txt': 1 << 7,
+          'c.txt': 1 << 7
+        })
+      })
+
+      it('checks the status of the paths that changed since again', async () => {
+        fs.unlinkSync(path.join(workingDirectory, 'b.txt'))
+        fs.writeFileSync(path.join(workingDirectory, 'a.txt'), 'changed', 'utf8')
+        expect(await repo.getCachedStatusAsync()).toEqual({
+          'a.txt': 1 << 8,
+          'c.txt': 1 << 7
+        })
+      })
+
+      it('checks tracked files that were unchanged when the status was saved', async () => {
+        fs.writeFileSync(path.join(workingDirectory, 'a.txt'), 'first line\n', 'utf8')
+        repo.setPersistentStatusCacheEnabled(true)
+        expect(await repo.getStatusAsync()).toEqual({'b.txt': 1 << 7, 'c.txt': 1 << 7})
+        fs.writeFileSync(path.join(workingDirectory, 'a.txt'), 'changed', 'utf8')
+        expect(await repo.getCachedStatusAsync()).toEqual({
+          'a.txt': 1 << 8,
+          'b.txt': 1 << 7,
+          'c.txt': 1 << 7
+        })
+      })
+
+      it('checks paths modified while the status was being saved again', async () => {
+        const filePath = path.join(workingDirectory, 'a.txt')
+        const mtime = Math.floor(Date.now() / 1000) + 60
+        fs.writeFileSync(filePath, 'other line\n', 'utf8')
+        fs.utimesSync(filePath, mtime, mtime)
+        repo.setPersistentStatusCacheEnabled(true)
+        expect((await repo.getStatusAsync())['a.txt']).toBe(1 << 8)
+
+        fs.writeFileSync(filePath, 'first line\n', 'utf8')
+        fs.utimesSync(filePath, mtime, mtime)
+        expect(await repo.getCachedStatusAsync()).toEqual({
+          'b.txt': 1 << 7,
+          'c.txt': 1 << 7
+        })
+      })
+
+      it('resolves with null when the index changed since', async () => {
+        repo.add('b.txt')
+        expect(await repo.getCachedStatusAsync()).toBeNull()
+      })
+    })
+  })
+
+  describe('when the same repository is opened more than once', () => {
+    let repoPath
+
+    beforeEach(() => {
+      repoPath = temp.mkdirSync('node-git-repo-')
+      wrench.copyDirSyncRecursive(path.join(__dirname, 'fixtures/master.git'), path.join(repoPath, '.git'))
+    })
+
+    it('shares native state between the instances until they are released', () => {
+      const repo1 = git.open(repoPath)
+      const repo2 = git.open(repoPath)
+      expect(repo1._getSharedReferenceCount()).toBe(2)
+      expect(repo2.getHead()).toBe(repo1.getHead())
+
+      repo2.release()
+      expect(repo2._getSharedReferenceCount()).toBe(0)
+      expect(repo1._getSharedReferenceCount()).toBe(1)
+      expect(repo1.getHeadBlob('a.txt')).not.toBeNull()
+      repo1.release()
+    })
+
+    it('shares state between instances opened from different paths into the repository', () => {
+      const repo1 = git.open(repoPath)
+      const repo2 = git.open(path.join(repoPath, '.git'))
+      expect(repo2._getSharedReferenceCount()).toBe(2)
+      repo1.release()
+      repo2.release()
+    })
+
+    it('does not share state with other repositories', () => {
+      const otherPath = temp.mkdirSync('node-git-repo-')
+      wrench.copyDirSyncRecursive(path.join(__dirname, 'fixtures/master.git'), path.join(otherPath, '.git'))
+      const repo1 = git.open(repoPath)
+      const repo2 = git.open(otherPath)
+      expect(repo1._getSharedReferenceCount()).toBe(1)
+      expect(repo2._getSharedReferenceCount()).toBe(1)
+      repo1.release()
+      repo2.release()
+    })
+
+    it('keeps async work on a released instance working', async () => {
+      const repo1 = git.open(repoPath)
+      const promise = repo1.getHeadAsync()
+      repo1.release()
+      expect(await promise).toBe('refs/heads/master')
+    })
+  })
+
+  describe('when loaded in worker threads', () => {
+    let Worker
+    try {
+      ({Worker} = require('worker_threads'))
+    } catch (error) {}
+
+    const workerScript = `
+      const {parentPort, workerData} = require('worker_threads')
+      const git = require(${JSON.stringify(path.join(__dirname, '..', 'src', 'git'))})
+
+      async function run () {
+        const repo = git.open(workerData.repoDirectory)
+        let statuses, head
+        for (let i = 0; i < 10; i++) {
+          [statuses, head] = await Promise.all([repo.getStatusAsync(), repo.getHeadAsync()])
+        }
+        repo.release()
+        parentPort.postMessage({statuses, head})
+      }
+
+      run()
+    `
+
+    it('can drive repositories concurrently from several workers', async () => {
+      if (!Worker) return
+
+      const repoDirectories = [0, 1, 2, 3].map(() => {
+        const repoDirectory = temp.mkdirSync('node-git-repo-')
+        wrench.copyDirSyncRecursive(path.join(__dirname, 'fixtures/master.git'), path.join(repoDirectory, '.git'))
+        fs.writeFileSync(path.join(repoDirectory, 'b.txt'), '', 'utf8')
+        return repoDirectory
+      })
+
+      const runWorker = workerData => new Promise((resolve, reject) => {
+        const worker = new Worker(workerScript, {eval: true, workerData})
+        let result
+        worker.on('message', message => { result = message })
+        worker.on('error', reject)
+        worker.on('exit', () => resolve(result))
+      })
+
+      // Two workers per repository, so instances in different threads share
+      // native state too.
+      const results = await Promise.all(repoDirectories.concat(repoDirectories).map(repoDirectory =>
+        runWorker({repoDirectory})
+      ))
+
+      for (const result of results) {
+        expect(result.head).toBe('refs/heads/master')
+        expect(result.statuses).toEqual({
+          'a.txt': 1 << 9,
+          'b.txt': 1 << 7
+        })
+      }
+
+      repo = git.open(repoDirectories[0])
+      expect(await repo.getStatusAsync()).toEqual(results[0].statuses)
+    })
+  })
+
+  describe('git.setCacheOptions(options)', () => {
+    let defaults
+
+    beforeEach(() => { defaults = git.getCacheOptions() })
+    afterEach(() => git.setCacheOptions(defaults))
+
+    it('updates the process-wide object cache and pack window settings', () => {
+      git.setCacheOptions({
+        maxSize: 64 * 1024 * 1024,
+        objectLimits: {blob: 1024},
+        packWindowSize: 32 * 1024 * 1024,
+        packMappedLimit: 512 * 1024 * 1024
+      })
+
+      const options = git.getCacheOptions()
+      expect(options.enabled).toBe(true)
+      expect(options.maxSize).toBe(64 * 1024 * 1024)
+      expect(options.objectLimits).toEqual({
+        commit: defaults.objectLimits.commit,
+        tree: defaults.objectLimits.tree,
+        blob: 1024,
+        tag: defaults.objectLimits.tag
+      })
+      expect(options.packWindowSize).toBe(32 * 1024 * 1024)
+      expect(options.packMappedLimit).toBe(512 * 1024 * 1024)
+    })
+
+    it('keeps lookups working with caching disabled', () => {
+      git.setCacheOptions({enabled: false})
+      expect(git.getCacheOptions().enabled).toBe(false)
+
+      repo = git.open(path.join(__dirname, 'fixtures/master.git'))
+      expect(repo.getHeadBlob('a.txt')).toBe('first line\n')
+    })
+  })
+
+  describe('.warmPacks()', () => {
+    it('resolves once the pack indexes are loaded', async () => {
+      repo = git.open(path.join(__dirname, 'fixtures/master.git'))
+      repo.setPerformanceStatsEnabled(true)
+      await repo.warmPacks()
+      expect(repo.getPerformanceStats().operations.warmPacks.calls).toBe(1)
+      expect(repo.getHead()).toBe('refs/heads/master')
+    })
+  })
+
+  describe('.getChangedPathsAsync(fromRevision, toRevision, [options])', () => {
+    beforeEach(() => {
+      repo = git.open(path.join(__dirname, 'fixtures/changed-paths.git'))
+    })
+
+    it('resolves with the paths that differ between the two revisions', async () => {
+      const {paths, statuses, oldPaths, additions} = await repo.getChangedPathsAsync('HEAD~1', 'HEAD')
+      expect(paths).toEqual(['d.txt', 'dir/sub/b.txt', 'moved/c.txt', 'other/c.txt', 'other/e.txt'])
+      expect(statuses instanceof Uint8Array).toBe(true)
+      expect(Array.from(statuses)).toEqual([2, 3, 1, 2, 1])
+      expect(oldPaths).toBeUndefined()
+      expect(additions).toBeUndefined()
+    })
+
+    it('resolves with the number of added and deleted lines when lineStats is set', async () => {
+      const {paths, additions, deletions} = await repo.getChangedPathsAsync('HEAD~1', 'HEAD', {lineStats: true})
+      expect(paths.length).toBe(5)
+      expect(additions instanceof Uint32Array).toBe(true)
+      expect(Array.from(additions)).toEqual([0, 2, 4, 0, 1])
+      expect(Array.from(deletions)).toEqual([1, 1, 0, 4, 0])
+    })
+
+    it('reports renamed paths when detectRenames is set', async () => {
+      const {paths, statuses, oldPaths} = await repo.getChangedPathsAsync('HEAD~1', 'HEAD', {detectRenames: true})
+      const changes = {}
+      paths.forEach((changedPath, index) => {
+        changes[changedPath] = {status: statuses[index], oldPath: oldPaths[index]}
+      })
+      expect(changes).toEqual({
+        'd.txt': {status: 2, oldPath: 'd.txt'},
+        'dir/sub/b.txt': {status: 3, oldPath: 'dir/sub/b.txt'},
+        'moved/c.txt': {status: 4, oldPath: 'other/c.txt'},
+        'other/e.txt': {status: 1, oldPath: 'other/e.txt'}
+      })
+    })
+
+    it('resolves with no paths for identical revisions', async () => {
+      const {paths, statuses} = await repo.getChangedPathsAsync('HEAD', 'master')
+      expect(paths).toEqual([])
+      expect(statuses.length).toBe(0)
+    })
+
+    it('rejects when a revision cannot be resolved', async () => {
+      let error
+      try {
+        await repo.getChangedPathsAsync('HEAD', 'no-such-branch')
+      } catch (e) {
+        error = e
+      }
+      expect(error.message).toBe('Cannot resolve revision no-such-branch')
+    })
+  })
+
+  describe('.grepAsync(pattern, [options], [onMatches])', () => {
+    let workingDirectory
+
+    beforeEach(() => {
+      const repoDirectory = temp.mkdirSync('node-git-repo-')
+      wrench.copyDirSyncRecursive(path.join(__dirname, 'fixtures/master.git'), path.join(repoDirectory, '.git'))
+      repo = git.open(repoDirectory)
+      workingDirectory = repo.getWorkingDirectory()
+    })
+
+    it('searches the files in HEAD', async () => {
+      const {matches, truncated} = await repo.grepAsync('line', {source: 'head'})
+      expect(matches).toEqual([{path: 'a.txt', row: 0, column: 6, length: 4, lineText: 'first line'}])
+      expect(truncated).toBe(false)
+    })
+
+    it('searches the tracked files in the working directory by default', async () => {
+      fs.writeFileSync(path.join(workingDirectory, 'a.txt'), 'zero\r\nthe first line\r\n', 'utf8')
+      fs.writeFileSync(path.join(workingDirectory, 'b.txt'), 'first line', 'utf8')
+      const {matches} = await repo.grepAsync('first')
+      expect(matches).toEqual([{path: 'a.txt', row: 1, column: 4, length: 5, lineText: 'the first line'}])
+    })
+
+    it('matches regular expressions and ignores case when asked to', async () => {
+      let {matches} = await repo.grepAsync(/F\w+T/i, {source: 'index'})
+      expect(matches.map(({row, column, length}) => [row, column, length])).toEqual([[0, 0, 5]])
+
+      matches = (await repo.grepAsync('FIRST', {source: 'head', ignoreCase: true})).matches
+      expect(matches.length).toBe(1)
+      matches = (await repo.grepAsync('FIRST', {source: 'head'})).matches
+      expect(matches.length).toBe(0)
+    })
+
+    it('only searches files below the given paths', async () => {
+      expect((await repo.grepAsync('first', {source: 'head', paths: ['build']})).matches).toEqual([])
+      expect((await repo.grepAsync('first', {source: 'head', paths: ['a.txt']})).matches.length).toBe(1)
+    })
+
+    it('streams matches to the onMatches callback as they are found', async () => {
+      const batches = []
+      const {matches} = await repo.grepAsync('first', {source: 'head'}, batch => batches.push(batch))
+      expect(matches).toEqual([])
+      expect(batches).toEqual([[{path: 'a.txt', row: 0, column: 0, length: 5, lineText: 'first line'}]])
+    })
+
+    it('reports truncated results when maxMatches is reached', async () => {
+      fs.writeFileSync(path.join(workingDirectory, 'a.txt'), 'first\nfirst\nfirst\n', 'utf8')
+      const {matches, truncated} = await repo.grepAsync('first', {maxMatches: 2})
+      expect(matches.map(({row}) => row)).toEqual([0, 1])
+      expect(truncated).toBe(true)
+    })
+
+    it('searches very long lines with regular expressions', async () => {
+      fs.writeFileSync(path.join(workingDirectory, 'a.txt'), 'first' + 'x'.repeat(1024 * 1024) + 'last', 'utf8')
+      const {matches, truncated} = await repo.grepAsync(/fir.*x/)
+      expect(matches.map(({row, column, lineText}) => [row, column, lineText.length])).toEqual([[0, 0, 1024]])
+      expect(truncated).toBe(true)
+
+      expect(await repo.grepAsync(/.*last/)).toEqual({matches: [], truncated: true})
+      expect((await repo.grepAsync(/x$/)).matches).toEqual([])
+      expect((await repo.grepAsync('first', {regex: true, source: 'head'})).truncated).toBe(false)
+    })
+
+    it('rejects invalid regular expressions', async () => {
+      let error
+      try {
+        await repo.grepAsync('(', {regex: true})
+      } catch (e) {
+        error = e
+      }
+      expect(error.message).toContain('Invalid regular expression')
+    })
+  })
+
+  describe('.cancelPendingWork()', () => {
+    beforeEach(() => {
+      repo = git.open(path.join(__dirname, 'fixtures/master.git'))
+    })
+
+    it('rejects queued async work and lets later work run', async () => {
+      const running = repo.getStatusAsync().catch(error => error)
+      const queued = [repo.getStatusAsync(), repo.getChangedPathsAsync('HEAD', 'HEAD')]
+      repo.cancelPendingWork()
+
+      for (const promise of queued) {
+        let error
+        try {
+          await promise
+        } catch (e) {
+          error = e
+        }
+        expect(error.code).toBe('ECANCELED')
+      }
+
+      const result = await running
+      if (result instanceof Error) expect(result.code).toBe('ECANCELED')
+      expect(await repo.getHeadAsync()).toBe('refs/heads/master')
+    })
+  })
+
+  describe('async work priorities', () => {
+    it('runs interactive calls ahead of queued background work', async () => {
+      repo = git.open(path.join(__dirname, 'fixtures/master.git'))
+      const order = []
+      await Promise.all([
+        repo.scanStatusAsync().then(() => order.push('first scan')),
+        repo.scanStatusAsync().then(() => order.push('second scan')),
+        repo.getHeadAsync().then(() => order.push('head'))
+      ])
+      expect(order).toEqual(['first scan', 'head', 'second scan'])
+    })
+  })
+
+  describe('git.setThreadPoolSize(size)', () => {
+    afterEach(() => git.setThreadPoolSize(0))
+
+    it('runs async work on the module thread pool', async () => {
+      expect(git.getThreadPoolSize()).toBe(0)
+      git.setThreadPoolSize(2)
+      expect(git.getThreadPoolSize()).toBe(2)
+
+      repo = git.open(path.join(__dirname, 'fixtures/master.git'))
+      const results = await Promise.all([
+        repo.getHeadAsync(),
+        repo.getStatusAsync(),
+        repo.getChangedPathsAsync('HEAD', 'HEAD')
+      ])
+      expect(results[0]).toBe('refs/heads/master')
+      expect(results[1]).toEqual(repo.getStatus())
+      expect(results[2].paths).toEqual([])
+    })
+
+    it('goes back to the libuv thread pool when set to zero', async () => {
+      git.setThreadPoolSize(2)
+      git.setThreadPoolSize(0)
+      expect(git.getThreadPoolSize()).toBe(0)
+      repo = git.open(path.join(__dirname, 'fixtures/master.git'))
+      expect(await repo.getHeadAsync()).toBe('refs/heads/master')
+    })
+  })
+
+  describe('.getTrackedPathsAsync([options])', () => {
+    const decode = ({paths, offsets}) =>
+      Array.from({length: offsets.length - 1}, (_, i) => paths.toString('utf8', offsets[i], offsets[i + 1]))
+
+    beforeEach(() => {
+      const repoDirectory = temp.mkdirSync('node-git-repo-')
+      wrench.copyDirSyncRecursive(path.join(__dirname, 'fixtures/master.git'), path.join(repoDirectory, '.git'))
+      repo = git.open(repoDirectory)
+
+      const workingDirectory = repo.getWorkingDirectory()
+      fs.mkdirSync(path.join(workingDirectory, 'dir'))
+      fs.writeFileSync(path.join(workingDirectory, 'dir/b.txt'), 'bbb', 'utf8')
+      fs.writeFileSync(path.join(workingDirectory, 'dir/c.txt'), 'cc', 'utf8')
+      repo.add('dir/b.txt')
+      repo.add('dir/c.txt')
+    })
+
+    it('resolves with the paths in the index packed into one buffer', async () => {
+      const result = await repo.getTrackedPathsAsync()
+      expect(Buffer.isBuffer(result.paths)).toBe(true)
+      expect(result.offsets instanceof Uint32Array).toBe(true)
+      expect(decode(result)).toEqual(['a.txt', 'dir/b.txt', 'dir/c.txt'])
+      expect(result.modes).toBeUndefined()
+    })
+
+    it('only includes the paths starting with the given prefix', async () => {
+      expect(decode(await repo.getTrackedPathsAsync({prefix: 'dir/'}))).toEqual(['dir/b.txt', 'dir/c.txt'])
+      expect(decode(await repo.getTrackedPathsAsync({prefix: 'dir/c'}))).toEqual(['dir/c.txt'])
+      expect(decode(await repo.getTrackedPathsAsync({prefix: 'z'}))).toEqual([])
+    })
+
+    it('includes the modes, oids and sizes of the entries when asked to', async () => {
+      const {modes, oids, sizes} = await repo.getTrackedPathsAsync({
+        prefix: 'dir/', includeModes: true, includeOids: true, includeSizes: true
+      })
+      expect(Array.from(modes)).toEqual([0o100644, 0o100644])
+      expect(oids.length).toBe(40)
+      expect(oids.toString('hex', 0, 20)).toBe('01f02e32ce8a128dd7b1d16a45f2eff66ec23c2d')
+      expect(Array.from(sizes)).toEqual([3, 2])
+    })
+
+    it('picks up changes to the index', async () => {
+      await repo.getTrackedPathsAsync()
+      fs.writeFileSync(path.join(repo.getWorkingDirectory(), 'e.txt'), 'e', 'utf8')
+      repo.add('e.txt')
+      expect(decode(await repo.getTrackedPathsAsync())).toEqual(['a.txt', 'dir/b.txt', 'dir/c.txt', 'e.txt'])
+    })
+  })
+
+  describe('.getBlameAsync(path, [options])', () => {
+    const zeroOid = '0000000000000000000000000000000000000000'
+    const commit = 'b2c96bdffe1a8f239c2d450863e4a6caa6dcb655'
+    const describeLines = ({startRows, lineCounts, commitIndices, commits}) =>
+      Array.from(startRows, (row, i) => [row, lineCounts[i], commits[commitIndices[i]]])
+
+    beforeEach(() => {
+      const repoDirectory = temp.mkdirSync('node-git-repo-')
+      wrench.copyDirSyncRecursive(path.join(__dirname, 'fixtures/master.git'), path.join(repoDirectory, '.git'))
+      repo = git.open(repoDirectory)
+    })
+
+    it('resolves with the commit that last changed each range of lines', async () => {
+      const blame = await repo.getBlameAsync('a.txt')
+      expect(blame.startRows instanceof Uint32Array).toBe(true)
+      expect(describeLines(blame)).toEqual([[0, 1, commit]])
+      expect(Array.from(blame.originalStartRows)).toEqual([0])
+    })
+
+    it('attributes lines of the given text buffer that are not in HEAD to the zero oid', async () => {
+      const blame = await repo.getBlameAsync('a.txt', {textBuffer: 'first line\nsecond line\n'})
+      expect(describeLines(blame)).toEqual([[0, 1, commit], [1, 1, zeroOid]])
+
+      const textBuffer = {getText: () => 'new line\nfirst line\n'}
+      expect(describeLines(await repo.getBlameAsync('a.txt', {textBuffer}))).toEqual([[0, 1, zeroOid], [1, 1, commit]])
+    })
+
+    it('overlays the working directory contents by default', async () => {
+      fs.writeFileSync(path.join(repo.getWorkingDirectory(), 'a.txt'), 'first line\nsecond line\n', 'utf8')
+      expect(describeLines(await repo.getBlameAsync('a.txt'))).toEqual([[0, 1, commit], [1, 1, zeroOid]])
+    })
+
+    it('rejects paths that are not in HEAD', async () => {
+      let error
+      try {
+        await repo.getBlameAsync('missing.txt')
+      } catch (e) {
+        error = e
+      }
+      expect(error instanceof Error).toBe(true)
+    })
+  })
+
+  describe('.getPathHistoryStream(path, [options], [onChunk])', () => {
+    const summaries = commits => commits.map(({summary}) => summary)
+
+    beforeEach(() => {
+      repo = git.open(path.join(__dirname, 'fixtures/path-history.git'))
+    })
+
+    it('resolves with the commits that changed the path, newest first', async () => {
+      const {commits, count, usedChangedPathFilters} = await repo.getPathHistoryStream('a.txt')
+      expect(usedChangedPathFilters).toBe(true)
+      expect(count).toBe(3)
+      expect(summaries(commits)).toEqual(['Change a again', 'Change a', 'Add files'])
+      expect(commits[0]).toEqual({
+        oid: 'd5bcfd7970359614b269a665092d5b6c7ede6a09',
+        author: 'Test Author',
+        time: 1578225600,
+        summary: 'Change a again'
+      })
+    })
+
+    it('follows the side of a merge that the path changed on', async () => {
+      const {commits} = await repo.getPathHistoryStream('dir/b.txt')
+      expect(summaries(commits)).toEqual(['Change b', 'Change b on side', 'Add files'])
+      expect(summaries((await repo.getPathHistoryStream('dir/')).commits)).toEqual(summaries(commits))
+    })
+
+    it('streams the commits to the chunk callback', async () => {
+      const chunks = []
+      const {commits, count} = await repo.getPathHistoryStream('c.txt', chunk => chunks.push(chunk))
+      expect(commits).toEqual([])
+      expect(count).toBe(2)
+      expect(summaries([].concat(...chunks))).toEqual(['Change c', 'Add files'])
+    })
+
+    it('stops after the given number of commits', async () => {
+      const {commits} = await repo.getPathHistoryStream('a.txt', {limit: 2})
+      expect(summaries(commits)).toEqual(['Change a again', 'Change a'])
+    })
+
+    it('lists the same commits without a commit-graph', async () => {
+      const repoDirectory = temp.mkdirSync('node-git-repo-')
+      wrench.copyDirSyncRecursive(path.join(__dirname, 'fixtures/path-history.git'), path.join(repoDirectory, '.git'))
+      fs.removeSync(path.join(repoDirectory, '.git', 'objects', 'info', 'commit-graph'))
+      repo = git.open(repoDirectory)
+
+      for (const historyPath of ['a.txt', 'c.txt', 'dir/b.txt', 'missing.txt']) {
+        const {commits, usedChangedPathFilters} = await repo.getPathHistoryStream(historyPath)
+        expect(usedChangedPathFilters).toBe(false)
+        const filtered = await git.open(path.join(__dirname, 'fixtures/path-history.git')).getPathHistoryStream(historyPath)
+        expect(commits).toEqual(filtered.commits)
+      }
+    })
+  })
+
+  describe('.getCommitsAsync(oids, [options])', () => {
+    const merge = '1e8ce598db469d78063d4afca105a310e8b5a47c'
+    const root = 'b4867794331019027aec0c4eb4a652bcca2738fb'
+
+    beforeEach(() => {
+      repo = git.open(path.join(__dirname, 'fixtures/path-history.git'))
+    })
+
+    it('resolves with columns of the requested fields, in the order of the given oids', async () => {
+      const result = await repo.getCommitsAsync([merge, root])
+      expect(Array.from(result.found)).toEqual([1, 1])
+      expect(result.authorNames).toEqual(['Test Author', 'Test Author'])
+      expect(result.authorEmails).toEqual(['test@example.com', 'test@example.com'])
+      expect(result.authorTimes instanceof Float64Array).toBe(true)
+      expect(Array.from(result.authorTimes)).toEqual([1578312000, 1577880000])
+      expect(result.summaries).toEqual(['Merge side', 'Add files'])
+      expect(result.parents).toBeUndefined()
+    })
+
+    it('only includes the requested fields', async () => {
+      const result = await repo.getCommitsAsync([root, merge], {fields: ['parents', 'committerTime']})
+      expect(Object.keys(result).sort()).toEqual(['committerTimes', 'found', 'parentCounts', 'parents'])
+      expect(Array.from(result.parentCounts)).toEqual([0, 2])
+      expect(result.parents).toEqual(['d5bcfd7970359614b269a665092d5b6c7ede6a09', '99b0a63907f63f096050e3a5ade54bf29ebd5fbd'])
+
+      const {summaries} = await repo.getCommitsAsync([root], {fields: ['summary']})
+      expect(summaries).toEqual(['Add files'])
+    })
+
+    it('marks oids that are not commits as not found', async () => {
+      const tree = 'b6f80804a853453ae206646bde6f2dbc613cab2e'
+      const result = await repo.getCommitsAsync(['0000000000000000000000000000000000000000', 'nope', tree, root])
+      expect(Array.from(result.found)).toEqual([0, 0, 0, 1])
+      expect(result.summaries).toEqual([null, null, null, 'Add files'])
+    })
+  })
+
+  describe('memory usage and trimming', () => {
+    beforeEach(() => {
+      const repoDirectory = temp.mkdirSync('node-git-repo-')
+      wrench.copyDirSyncRecursive(path.join(__dirname, 'fixtures/master.git'), path.join(repoDirectory, '.git'))
+      repo = git.open(repoDirectory)
+    })
+
+    afterEach(() => git.setMemoryBudget({}))
+
+    it('breaks down the native memory held by a repository', async () => {
+      await repo.grepAsync('line', {source: 'head'})
+      await repo.getCommitsAsync([repo.getReferenceTarget('HEAD')])
+      const usage = repo.getMemoryUsage()
+      expect(usage.grepCache).toBeGreaterThan(0)
+      expect(usage.commitCache).toBeGreaterThan(0)
+      expect(usage.index).toBeGreaterThan(0)
+      expect(usage.total).toBe(usage.statusCache + usage.grepCache + usage.blameCache + usage.trackedPaths +
+        usage.commitCache + usage.commitGraph + usage.hashCache + usage.index)
+    })
+
+    it('drops caches when trimmed and loads everything again on demand', async () => {
+      const head = repo.getHead()
+      const {matches} = await repo.grepAsync('line', {source: 'head'})
+      repo.trimMemory()
+      const usage = repo.getMemoryUsage()
+      expect(usage.grepCache).toBe(0)
+      expect(usage.total).toBe(0)
+      expect(repo._getSharedReferenceCount()).toBe(0)
+
+      expect(repo.getHead()).toBe(head)
+      expect(repo._getSharedReferenceCount()).toBe(1)
+      expect(await repo.getHeadAsync()).toBe(head)
+      expect((await repo.grepAsync('line', {source: 'head'})).matches).toEqual(matches)
+    })
+
+    it('trims idle repositories', async () => {
+      await repo.grepAsync('line', {source: 'head'})
+      expect(git.trimMemory()).toBeGreaterThan(0)
+      expect(repo.getMemoryUsage().grepCache).toBe(0)
+      expect(git.getMemoryUsage().repositoryCount).toBeGreaterThan(0)
+    })
+
+    it('keeps the async handle of repositories with work in flight', async () => {
+      const head = repo.getHead()
+      const promise = repo.getHeadAsync()
+      repo.trimMemory()
+      expect(repo._getSharedReferenceCount()).toBeGreaterThan(0)
+      expect(await promise).toBe(head)
+    })
+
+    it('remembers the memory budget', () => {
+      git.setMemoryBudget({maxBytes: 1024 * 1024, idleTimeout: 60000})
+      expect(git.getMemoryBudget()).toEqual({maxBytes: 1024 * 1024, idleTimeout: 60000})
+      git.setMemoryBudget({})
+      expect(git.getMemoryBudget()).toEqual({maxBytes: 0, idleTimeout: 0})
+    })
+  })
+
   it('can handle multiple simultaneous async calls', async () => {
     repoDirectory = temp.mkdirSync('node-git-repo-')
     wrench.copyDirSyncRecursive(
@@ -0,0 +1,73 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "blame-cache.h"
+
+namespace {
+
+const size_t kMaxEntries = 32;
+
+}  // namespace
+
+std::shared_ptr<git_blame> BlameCache::Lookup(const std::string& path,
+                                              const git_oid& head) {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto it = entries.begin(); it != entries.end(); ++it) {
+    if (it->path == path && git_oid_equal(&it->head, &head)) {
+      entries.splice(entries.begin(), entries, it);
+      return entries.front().blame;
+    }
+  }
+  return nullptr;
+}
+
+void BlameCache::Store(const std::string& path, const git_oid& head,
+                       std::shared_ptr<git_blame> blame) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // An older blame of the same path is for a HEAD that has since moved.
+  for (auto it = entries.begin(); it != entries.end(); ++it) {
+    if (it->path == path) {
+      entries.erase(it);
+      break;
+    }
+  }
+
+  entries.push_front({path, head, blame});
+  if (entries.size() > kMaxEntries)
+    entries.pop_back();
+}
+
+void BlameCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  entries.clear();
+}
+
+size_t BlameCache::MemoryUsage() {
+  std::lock_guard<std::mutex> lock(mutex);
+  size_t bytes = 0;
+  for (const Entry& entry : entries) {
+    bytes += sizeof(Entry) + entry.path.capacity() +
+             git_blame_get_hunk_count(entry.blame.get()) *
+             sizeof(git_blame_hunk);
+  }
+  return bytes;
+}
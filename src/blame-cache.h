@@ -0,0 +1,64 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_BLAME_CACHE_H_
+#define SRC_BLAME_CACHE_H_
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "git2.h"
+
+// Blames of recently opened files as of a given HEAD commit. Blaming walks
+// the file's history, while overlaying edits on a cached blame with
+// git_blame_buffer only diffs the new contents against the blamed blob.
+class BlameCache {
+ public:
+  BlameCache() {}
+
+  std::shared_ptr<git_blame> Lookup(const std::string& path,
+                                    const git_oid& head);
+  void Store(const std::string& path, const git_oid& head,
+             std::shared_ptr<git_blame> blame);
+  void Clear();
+
+  // An estimate of the heap memory held by the cached blames.
+  size_t MemoryUsage();
+
+  // Takes ownership of |blame|.
+  static std::shared_ptr<git_blame> Wrap(git_blame* blame) {
+    return std::shared_ptr<git_blame>(blame, git_blame_free);
+  }
+
+ private:
+  struct Entry {
+    std::string path;
+    git_oid head;
+    std::shared_ptr<git_blame> blame;
+  };
+
+  std::mutex mutex;
+  std::list<Entry> entries;  // Most recently used first.
+};
+
+#endif  // SRC_BLAME_CACHE_H_
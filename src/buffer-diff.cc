@@ -0,0 +1,168 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "buffer-diff.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace {
+
+// How much of a file libgit2 checks for a NUL byte to tell it is binary.
+const size_t kBinaryCheckSize = 8000;
+
+// Comparing with memcmp in blocks lets libc's vectorized version skip over
+// the identical parts before the mismatch is found byte by byte.
+const size_t kCompareBlockSize = 4096;
+
+bool IsBinary(const char* data, size_t size) {
+  return memchr(data, 0, std::min(size, kBinaryCheckSize)) != nullptr;
+}
+
+size_t CountLines(const char* data, size_t size) {
+  size_t lines = std::count(data, data + size, '\n');
+  if (size > 0 && data[size - 1] != '\n')
+    lines++;
+  return lines;
+}
+
+size_t CommonPrefix(const char* a, const char* b, size_t size) {
+  size_t length = 0;
+  while (length + kCompareBlockSize <= size &&
+         memcmp(a + length, b + length, kCompareBlockSize) == 0)
+    length += kCompareBlockSize;
+  while (length < size && a[length] == b[length])
+    length++;
+  return length;
+}
+
+// Compares backwards from the ends of |a| and |b|.
+size_t CommonSuffix(const char* a_end, const char* b_end, size_t size) {
+  size_t length = 0;
+  while (length + kCompareBlockSize <= size &&
+         memcmp(a_end - length - kCompareBlockSize,
+                b_end - length - kCompareBlockSize, kCompareBlockSize) == 0)
+    length += kCompareBlockSize;
+  while (length < size && a_end[-1 - static_cast<ptrdiff_t>(length)] ==
+                          b_end[-1 - static_cast<ptrdiff_t>(length)])
+    length++;
+  return length;
+}
+
+}  // namespace
+
+BufferDiff::BufferDiff(git_blob* blob, const char* text, size_t text_size)
+  : blob(blob),
+    old_data(static_cast<const char*>(git_blob_rawcontent(blob))),
+    old_size(static_cast<size_t>(git_blob_rawsize(blob))),
+    new_data(text), new_size(text_size),
+    prefix_size(0), prefix_lines(0), suffix_size(0),
+    hunk_cb(nullptr), line_cb(nullptr), payload(nullptr) {
+  Trim();
+}
+
+void BufferDiff::Trim() {
+  size_t common_size = std::min(old_size, new_size);
+  prefix_size = CommonPrefix(old_data, new_data, common_size);
+  if (prefix_size == old_size && prefix_size == new_size)
+    return;
+
+  // Only whole lines are trimmed, so the prefix ends after a newline...
+  while (prefix_size > 0 && old_data[prefix_size - 1] != '\n')
+    prefix_size--;
+  prefix_lines = std::count(old_data, old_data + prefix_size, '\n');
+
+  // ...and the suffix starts after one on both sides. The suffix is the same
+  // on both sides, so moving its start past its first newline does that.
+  suffix_size = CommonSuffix(old_data + old_size, new_data + new_size,
+                             common_size - prefix_size);
+  size_t old_start = old_size - suffix_size;
+  size_t new_start = new_size - suffix_size;
+  bool at_line_start =
+    (old_start == prefix_size || old_data[old_start - 1] == '\n') &&
+    (new_start == prefix_size || new_data[new_start - 1] == '\n');
+  if (suffix_size > 0 && !at_line_start) {
+    const char* newline = static_cast<const char*>(
+      memchr(old_data + old_start, '\n', suffix_size));
+    suffix_size = newline ? old_data + old_size - (newline + 1) : 0;
+  }
+}
+
+int BufferDiff::Diff(const git_diff_options* options, git_diff_hunk_cb hunk_cb,
+                     git_diff_line_cb line_cb, void* payload) {
+  if (old_size + new_size < kTrimThreshold || IsBinary(old_data, old_size) ||
+      IsBinary(new_data, new_size)) {
+    return git_diff_blob_to_buffer(blob, NULL, new_data, new_size, NULL,
+                                   options, NULL, NULL, hunk_cb, line_cb,
+                                   payload);
+  }
+  if (prefix_size == old_size && prefix_size == new_size)
+    return GIT_OK;
+
+  this->hunk_cb = hunk_cb;
+  this->line_cb = line_cb;
+  this->payload = payload;
+  return git_diff_buffers(
+    old_data + prefix_size, old_size - prefix_size - suffix_size, NULL,
+    new_data + prefix_size, new_size - prefix_size - suffix_size, NULL,
+    options, NULL, NULL, hunk_cb ? HunkCallback : NULL,
+    line_cb ? LineCallback : NULL, this);
+}
+
+git_diff_hunk BufferDiff::ChangedRegion() const {
+  git_diff_hunk hunk;
+  memset(&hunk, 0, sizeof(hunk));
+  hunk.old_lines = CountLines(old_data + prefix_size,
+                              old_size - prefix_size - suffix_size);
+  hunk.new_lines = CountLines(new_data + prefix_size,
+                              new_size - prefix_size - suffix_size);
+  hunk.old_start = prefix_lines + (hunk.old_lines > 0 ? 1 : 0);
+  hunk.new_start = prefix_lines + (hunk.new_lines > 0 ? 1 : 0);
+  return hunk;
+}
+
+git_diff_hunk BufferDiff::Offset(const git_diff_hunk& hunk) const {
+  git_diff_hunk offset_hunk = hunk;
+  offset_hunk.old_start += prefix_lines;
+  offset_hunk.new_start += prefix_lines;
+  return offset_hunk;
+}
+
+int BufferDiff::HunkCallback(const git_diff_delta* delta,
+                             const git_diff_hunk* hunk, void* payload) {
+  BufferDiff* diff = static_cast<BufferDiff*>(payload);
+  git_diff_hunk offset_hunk = diff->Offset(*hunk);
+  return diff->hunk_cb(delta, &offset_hunk, diff->payload);
+}
+
+int BufferDiff::LineCallback(const git_diff_delta* delta,
+                             const git_diff_hunk* hunk,
+                             const git_diff_line* line, void* payload) {
+  BufferDiff* diff = static_cast<BufferDiff*>(payload);
+  git_diff_hunk offset_hunk = diff->Offset(*hunk);
+  git_diff_line offset_line = *line;
+  if (offset_line.old_lineno > 0)
+    offset_line.old_lineno += diff->prefix_lines;
+  if (offset_line.new_lineno > 0)
+    offset_line.new_lineno += diff->prefix_lines;
+  return diff->line_cb(delta, &offset_hunk, &offset_line, diff->payload);
+}
@@ -0,0 +1,73 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_BUFFER_DIFF_H_
+#define SRC_BUFFER_DIFF_H_
+
+#include <stddef.h>
+
+#include "git2.h"
+
+// Diffs a blob against the text of an editor buffer. The lines both start
+// and end with are found with a byte comparison first, and for large inputs
+// only the changed region between them is handed to libgit2, whose diff
+// costs grow much faster than the input. Hunks and lines passed to the
+// callbacks are numbered as in the whole file either way.
+class BufferDiff {
+ public:
+  // Inputs smaller than this are diffed whole, exactly as libgit2 would.
+  static const size_t kTrimThreshold = 64 * 1024;
+
+  BufferDiff(git_blob* blob, const char* text, size_t text_size);
+
+  int Diff(const git_diff_options* options, git_diff_hunk_cb hunk_cb,
+           git_diff_line_cb line_cb, void* payload);
+
+  // A single hunk spanning every line between the common prefix and suffix,
+  // for callers that give up on a diff with too many hunks.
+  git_diff_hunk ChangedRegion() const;
+
+ private:
+  static int HunkCallback(const git_diff_delta* delta,
+                          const git_diff_hunk* hunk, void* payload);
+  static int LineCallback(const git_diff_delta* delta,
+                          const git_diff_hunk* hunk, const git_diff_line* line,
+                          void* payload);
+
+  void Trim();
+  git_diff_hunk Offset(const git_diff_hunk& hunk) const;
+
+  git_blob* blob;
+  const char* old_data;
+  size_t old_size;
+  const char* new_data;
+  size_t new_size;
+
+  size_t prefix_size;  // Bytes, ending at a line boundary.
+  size_t prefix_lines;
+  size_t suffix_size;  // Bytes, starting at a line boundary.
+
+  git_diff_hunk_cb hunk_cb;
+  git_diff_line_cb line_cb;
+  void* payload;
+};
+
+#endif  // SRC_BUFFER_DIFF_H_
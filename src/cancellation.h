@@ -0,0 +1,87 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_CANCELLATION_H_
+#define SRC_CANCELLATION_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+class CancellationToken;
+
+// Lets JS abandon the async work it queued on a repository. Every worker
+// takes a token when it is queued; cancelling moves the source on to a new
+// generation, which all tokens taken before then observe.
+class CancellationSource {
+ public:
+  CancellationSource() : generation(0) {}
+
+  CancellationToken Token() const;
+  void Cancel() { generation++; }
+
+ private:
+  friend class CancellationToken;
+
+  std::atomic<uint64_t> generation;
+};
+
+class CancellationToken {
+ public:
+  // A token that is never cancelled.
+  CancellationToken() : source(nullptr), generation(0) {}
+
+  bool IsCancelled() const {
+    return source != nullptr && source->generation.load() != generation;
+  }
+
+  // The token of the async worker running on this thread, so that libgit2
+  // callbacks and loops deep inside a worker can give up early. Outside of a
+  // Scope this is a token that is never cancelled.
+  static const CancellationToken& Current();
+
+  // Makes |token| the current token of this thread while it is alive.
+  class Scope {
+   public:
+    explicit Scope(const CancellationToken* token);
+    ~Scope();
+
+   private:
+    const CancellationToken* previous;
+  };
+
+ private:
+  friend class CancellationSource;
+
+  CancellationToken(const CancellationSource* source, uint64_t generation)
+    : source(source), generation(generation) {}
+
+  const CancellationSource* source;
+  uint64_t generation;
+
+  static thread_local const CancellationToken* current;
+};
+
+inline CancellationToken CancellationSource::Token() const {
+  return CancellationToken(this, generation.load());
+}
+
+#endif  // SRC_CANCELLATION_H_
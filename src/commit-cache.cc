@@ -0,0 +1,266 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "commit-cache.h"
+
+#include <string.h>
+
+namespace {
+
+const size_t kMaxCounts = 64;
+
+std::string Key(const git_oid& oid) {
+  return std::string(reinterpret_cast<const char*>(oid.id), GIT_OID_RAWSZ);
+}
+
+bool HasPrefix(const char* line, const char* end, const char* prefix) {
+  size_t length = strlen(prefix);
+  return static_cast<size_t>(end - line) >= length &&
+         memcmp(line, prefix, length) == 0;
+}
+
+bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' ||
+         c == '\f';
+}
+
+// Parses a signature of the form "Name <email> 1234567890 +0100". As in
+// libgit2, the email is delimited by the last angle brackets on the line.
+void ParseSignature(const char* start, const char* end, uint32_t fields,
+                    uint32_t name_field, uint32_t email_field,
+                    uint32_t time_field, std::string* name,
+                    std::string* email, int64_t* time) {
+  const char* open = nullptr;
+  const char* close = nullptr;
+  for (const char* c = end; c > start; c--) {
+    if (!close && c[-1] == '>') {
+      close = c - 1;
+    } else if (close && c[-1] == '<') {
+      open = c - 1;
+      break;
+    }
+  }
+  if (!open)
+    return;
+
+  if (fields & name_field) {
+    const char* name_end = open;
+    while (name_end > start && IsSpace(name_end[-1]))
+      name_end--;
+    name->assign(start, name_end);
+  }
+  if (fields & email_field)
+    email->assign(open + 1, close);
+  if (fields & time_field) {
+    const char* digit = close + 1;
+    while (digit < end && *digit == ' ')
+      digit++;
+    int64_t value = 0;
+    for (; digit < end && *digit >= '0' && *digit <= '9'; digit++)
+      value = value * 10 + (*digit - '0');
+    *time = value;
+  }
+}
+
+// Joins the lines of the message's first paragraph with spaces, the way
+// git_commit_summary does.
+std::string Summarize(const char* message, const char* end) {
+  std::string summary;
+  const char* space = nullptr;
+  bool space_has_newline = false;
+  for (const char* c = message; c < end; c++) {
+    if (*c == '\n' && (c + 1 == end || c[1] == '\n'))
+      break;
+    if (IsSpace(*c)) {
+      if (!space)
+        space = c;
+      space_has_newline |= *c == '\n';
+    } else {
+      if (space) {
+        if (space_has_newline)
+          summary += ' ';
+        else
+          summary.append(space, c);
+        space = nullptr;
+        space_has_newline = false;
+      }
+      summary += *c;
+    }
+  }
+  return summary;
+}
+
+}  // namespace
+
+bool CommitInfo::Parse(const char* data, size_t size, uint32_t fields) {
+  const char* line = data;
+  const char* end = data + size;
+  if (!HasPrefix(line, end, "tree "))
+    return false;
+
+  const uint32_t author_fields = kAuthorName | kAuthorEmail | kAuthorTime;
+  const uint32_t committer_fields =
+      kCommitterName | kCommitterEmail | kCommitterTime;
+  const uint32_t message_fields = kSummary | kMessage;
+  uint32_t pending = fields & (author_fields | committer_fields);
+  if (fields & kParents)
+    parents.clear();
+
+  const char* message = end;
+  bool signature_seen = false;
+  while (line < end) {
+    const char* line_end =
+        static_cast<const char*>(memchr(line, '\n', end - line));
+    if (!line_end)
+      line_end = end;
+    if (line_end == line) {
+      message = line + 1;
+      break;
+    }
+
+    if (HasPrefix(line, line_end, "parent ")) {
+      if ((fields & kParents) && line_end - line >= 7 + GIT_OID_HEXSZ) {
+        git_oid parent;
+        if (git_oid_fromstrn(&parent, line + 7, GIT_OID_HEXSZ) != GIT_OK)
+          return false;
+        parents.push_back(parent);
+      }
+    } else if (HasPrefix(line, line_end, "author ")) {
+      ParseSignature(line + 7, line_end, fields, kAuthorName, kAuthorEmail,
+                     kAuthorTime, &author_name, &author_email, &author_time);
+      pending &= ~author_fields;
+      signature_seen = true;
+    } else if (HasPrefix(line, line_end, "committer ")) {
+      ParseSignature(line + 10, line_end, fields, kCommitterName,
+                     kCommitterEmail, kCommitterTime, &committer_name,
+                     &committer_email, &committer_time);
+      pending &= ~committer_fields;
+      signature_seen = true;
+    }
+
+    line = line_end + 1;
+    // The header lists the parents before the signatures, so once the
+    // requested signatures have been read only the message is left.
+    if (pending == 0 && !(fields & message_fields) &&
+        (signature_seen || !(fields & kParents)))
+      break;
+  }
+
+  if (fields & message_fields) {
+    while (message < end && *message == '\n')
+      message++;
+    if (fields & kSummary)
+      summary = Summarize(message, end);
+    if (fields & kMessage)
+      this->message.assign(message, end);
+  }
+
+  this->fields |= fields;
+  return true;
+}
+
+int CommitCache::Get(git_odb* odb, const git_oid& oid, uint32_t fields,
+                     CommitInfo* info) {
+  std::string key = Key(oid);
+  *info = CommitInfo();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto cached = index.find(key);
+    if (cached != index.end()) {
+      entries.splice(entries.begin(), entries, cached->second);
+      *info = cached->second->info;
+      if ((info->fields & fields) == fields)
+        return GIT_OK;
+    }
+  }
+
+  git_odb_object* object;
+  int error = git_odb_read(&object, odb, &oid);
+  if (error != GIT_OK)
+    return error;
+  bool parsed = git_odb_object_type(object) == GIT_OBJ_COMMIT &&
+      info->Parse(static_cast<const char*>(git_odb_object_data(object)),
+                  git_odb_object_size(object), fields & ~info->fields);
+  git_odb_object_free(object);
+  if (!parsed)
+    return GIT_ENOTFOUND;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto cached = index.find(key);
+  if (cached != index.end()) {
+    // Another worker may have parsed other fields in the meantime.
+    if ((cached->second->info.fields & ~info->fields) == 0)
+      cached->second->info = *info;
+  } else if (capacity > 0) {
+    entries.push_front(Entry{key, *info});
+    index[key] = entries.begin();
+    while (entries.size() > capacity) {
+      index.erase(entries.back().key);
+      entries.pop_back();
+    }
+  }
+  return GIT_OK;
+}
+
+bool CommitCache::LookupCounts(const git_oid& left, const git_oid& right,
+                               unsigned* ahead, unsigned* behind) {
+  std::string key = Key(left) + Key(right);
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto entry = counts.begin(); entry != counts.end(); ++entry) {
+    if (entry->key == key) {
+      *ahead = entry->ahead;
+      *behind = entry->behind;
+      counts.splice(counts.begin(), counts, entry);
+      return true;
+    }
+  }
+  return false;
+}
+
+void CommitCache::StoreCounts(const git_oid& left, const git_oid& right,
+                              unsigned ahead, unsigned behind) {
+  std::lock_guard<std::mutex> lock(mutex);
+  counts.push_front(Counts{Key(left) + Key(right), ahead, behind});
+  if (counts.size() > kMaxCounts)
+    counts.pop_back();
+}
+
+void CommitCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  entries.clear();
+  index.clear();
+  counts.clear();
+}
+
+size_t CommitCache::MemoryUsage() {
+  std::lock_guard<std::mutex> lock(mutex);
+  size_t bytes = counts.size() * sizeof(Counts);
+  for (const Entry& entry : entries) {
+    const CommitInfo& info = entry.info;
+    bytes += sizeof(Entry) + entry.key.capacity() +
+             info.author_name.capacity() + info.author_email.capacity() +
+             info.committer_name.capacity() +
+             info.committer_email.capacity() + info.summary.capacity() +
+             info.message.capacity() +
+             info.parents.capacity() * sizeof(git_oid);
+  }
+  return bytes;
+}
@@ -0,0 +1,108 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_COMMIT_CACHE_H_
+#define SRC_COMMIT_CACHE_H_
+
+#include <stdint.h>
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "git2.h"
+
+// The parts of a commit's header and message that have been parsed.
+struct CommitInfo {
+  enum Field {
+    kAuthorName = 1 << 0,
+    kAuthorEmail = 1 << 1,
+    kAuthorTime = 1 << 2,
+    kCommitterName = 1 << 3,
+    kCommitterEmail = 1 << 4,
+    kCommitterTime = 1 << 5,
+    kSummary = 1 << 6,
+    kMessage = 1 << 7,
+    kParents = 1 << 8,
+  };
+
+  CommitInfo() : fields(0), author_time(0), committer_time(0) {}
+
+  uint32_t fields;  // The Fields that are filled in.
+  std::string author_name;
+  std::string author_email;
+  int64_t author_time;
+  std::string committer_name;
+  std::string committer_email;
+  int64_t committer_time;
+  std::string summary;
+  std::string message;
+  std::vector<git_oid> parents;
+
+  // Fills in |fields| from a raw commit object, leaving the rest of the
+  // header unparsed. Returns false if the object is not a valid commit.
+  bool Parse(const char* data, size_t size, uint32_t fields);
+};
+
+// The most recently used commits of a repository with whichever of their
+// fields were asked for, and the ahead/behind counts of recently compared
+// commits. Commits never change, so entries only leave the cache to make
+// room for newer ones.
+class CommitCache {
+ public:
+  explicit CommitCache(size_t capacity = 4096) : capacity(capacity) {}
+
+  // Fills |info| with at least |fields| of the commit |oid|, reading the
+  // commit from |odb| only when the cached entry lacks some of them.
+  int Get(git_odb* odb, const git_oid& oid, uint32_t fields, CommitInfo* info);
+
+  bool LookupCounts(const git_oid& left, const git_oid& right,
+                    unsigned* ahead, unsigned* behind);
+  void StoreCounts(const git_oid& left, const git_oid& right, unsigned ahead,
+                   unsigned behind);
+
+  void Clear();
+
+  // An estimate of the heap memory held by the cached commits.
+  size_t MemoryUsage();
+
+ private:
+  struct Entry {
+    std::string key;
+    CommitInfo info;
+  };
+
+  struct Counts {
+    std::string key;
+    unsigned ahead;
+    unsigned behind;
+  };
+
+  std::mutex mutex;
+  size_t capacity;
+  std::list<Entry> entries;  // Most recently used first.
+  std::unordered_map<std::string, std::list<Entry>::iterator> index;
+  std::list<Counts> counts;  // Most recently used first.
+};
+
+#endif  // SRC_COMMIT_CACHE_H_
@@ -0,0 +1,308 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "commit-graph.h"
+
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+namespace {
+
+const uint32_t kSignature = 0x43475048;  // "CGPH"
+const uint32_t kChunkFanout = 0x4f494446;  // "OIDF"
+const uint32_t kChunkOids = 0x4f49444c;  // "OIDL"
+const uint32_t kChunkBloomIndexes = 0x42494458;  // "BIDX"
+const uint32_t kChunkBloomData = 0x42444154;  // "BDAT"
+const size_t kHeaderSize = 8;
+const size_t kChunkEntrySize = 12;
+const size_t kFanoutSize = 256 * 4;
+const size_t kBloomDataHeaderSize = 12;
+
+uint32_t ReadUInt32(const unsigned char* data) {
+  return (static_cast<uint32_t>(data[0]) << 24) |
+         (static_cast<uint32_t>(data[1]) << 16) |
+         (static_cast<uint32_t>(data[2]) << 8) |
+         static_cast<uint32_t>(data[3]);
+}
+
+uint64_t ReadUInt64(const unsigned char* data) {
+  return (static_cast<uint64_t>(ReadUInt32(data)) << 32) |
+         ReadUInt32(data + 4);
+}
+
+uint32_t RotateLeft(uint32_t value, int count) {
+  return (value << count) | (value >> (32 - count));
+}
+
+// The 32-bit murmur3 hash git uses for Bloom filter keys. Version 1 filters
+// were written by a git that sign-extended bytes above 0x7f before mixing
+// them in, so reading them has to do the same.
+template <typename Byte>
+uint32_t Murmur3(uint32_t seed, const char* key, size_t length) {
+  const Byte* data = reinterpret_cast<const Byte*>(key);
+  const uint32_t c1 = 0xcc9e2d51;
+  const uint32_t c2 = 0x1b873593;
+  uint32_t hash = seed;
+
+  size_t blocks = length / 4;
+  for (size_t i = 0; i < blocks; i++) {
+    uint32_t k = static_cast<uint32_t>(data[4 * i]) |
+                 (static_cast<uint32_t>(data[4 * i + 1]) << 8) |
+                 (static_cast<uint32_t>(data[4 * i + 2]) << 16) |
+                 (static_cast<uint32_t>(data[4 * i + 3]) << 24);
+    k *= c1;
+    k = RotateLeft(k, 15);
+    k *= c2;
+    hash ^= k;
+    hash = RotateLeft(hash, 13) * 5 + 0xe6546b64;
+  }
+
+  const Byte* tail = data + blocks * 4;
+  uint32_t k = 0;
+  switch (length & 3) {
+    case 3:
+      k ^= static_cast<uint32_t>(tail[2]) << 16;
+      // Fall through.
+    case 2:
+      k ^= static_cast<uint32_t>(tail[1]) << 8;
+      // Fall through.
+    case 1:
+      k ^= static_cast<uint32_t>(tail[0]);
+      k *= c1;
+      k = RotateLeft(k, 15);
+      k *= c2;
+      hash ^= k;
+  }
+
+  hash ^= static_cast<uint32_t>(length);
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+}  // namespace
+
+BloomKeys::BloomKeys(const std::string& path, uint32_t hash_count,
+                     uint32_t hash_version)
+  : hash_count(hash_count) {
+  size_t length = path.size();
+  while (length > 0 && path[length - 1] == '/')
+    length--;
+
+  while (length > 0) {
+    const char* key = path.data();
+    uint32_t hash0, hash1;
+    if (hash_version == 1) {
+      hash0 = Murmur3<signed char>(0x293ae76f, key, length);
+      hash1 = Murmur3<signed char>(0x7e646e2c, key, length);
+    } else {
+      hash0 = Murmur3<unsigned char>(0x293ae76f, key, length);
+      hash1 = Murmur3<unsigned char>(0x7e646e2c, key, length);
+    }
+    for (uint32_t i = 0; i < hash_count; i++)
+      hashes.push_back(hash0 + i * hash1);
+
+    size_t separator = path.rfind('/', length - 1);
+    length = separator == std::string::npos ? 0 : separator;
+  }
+}
+
+CommitGraph::CommitGraph(const std::string& path)
+  : file(path), commit_count(0), fanout(nullptr), oids(nullptr),
+    bloom_indexes(nullptr), bloom_data(nullptr), bloom_data_size(0),
+    bloom_hash_count(0), bloom_hash_version(0) {}
+
+std::shared_ptr<const CommitGraph> CommitGraph::Open(const std::string& path) {
+  std::shared_ptr<CommitGraph> graph(new CommitGraph(path));
+  if (!graph->Parse())
+    return nullptr;
+  return graph;
+}
+
+bool CommitGraph::Parse() {
+  const unsigned char* data =
+      reinterpret_cast<const unsigned char*>(file.data);
+  // The file ends with a checksum of the rest of it.
+  if (!data || file.size < kHeaderSize + kChunkEntrySize + GIT_OID_RAWSZ)
+    return false;
+  size_t end = file.size - GIT_OID_RAWSZ;
+
+  // Only SHA-1 graphs that do not build on a chain of base graphs.
+  if (ReadUInt32(data) != kSignature || data[4] != 1 || data[5] != 1 ||
+      data[7] != 0)
+    return false;
+
+  uint32_t chunk_count = data[6];
+  if (kHeaderSize + (chunk_count + 1) * kChunkEntrySize > end)
+    return false;
+
+  const unsigned char* bloom_chunk = nullptr;
+  size_t bloom_chunk_size = 0;
+  size_t bloom_indexes_size = 0;
+  size_t oids_size = 0;
+  for (uint32_t i = 0; i < chunk_count; i++) {
+    const unsigned char* entry = data + kHeaderSize + i * kChunkEntrySize;
+    uint64_t offset = ReadUInt64(entry + 4);
+    uint64_t next_offset = ReadUInt64(entry + kChunkEntrySize + 4);
+    if (offset > next_offset || next_offset > end)
+      return false;
+
+    size_t size = next_offset - offset;
+    switch (ReadUInt32(entry)) {
+      case kChunkFanout:
+        if (size != kFanoutSize)
+          return false;
+        fanout = data + offset;
+        break;
+      case kChunkOids:
+        oids = data + offset;
+        oids_size = size;
+        break;
+      case kChunkBloomIndexes:
+        bloom_indexes = data + offset;
+        bloom_indexes_size = size;
+        break;
+      case kChunkBloomData:
+        bloom_chunk = data + offset;
+        bloom_chunk_size = size;
+        break;
+    }
+  }
+
+  if (!fanout || !oids)
+    return false;
+  commit_count = ReadUInt32(fanout + kFanoutSize - 4);
+  if (oids_size != static_cast<size_t>(commit_count) * GIT_OID_RAWSZ)
+    return false;
+
+  // The filters are optional, and ignored when unusable rather than making
+  // the whole graph so.
+  if (bloom_indexes && bloom_chunk &&
+      bloom_indexes_size == static_cast<size_t>(commit_count) * 4 &&
+      bloom_chunk_size >= kBloomDataHeaderSize) {
+    uint32_t version = ReadUInt32(bloom_chunk);
+    uint32_t hash_count = ReadUInt32(bloom_chunk + 4);
+    if ((version == 1 || version == 2) && hash_count > 0 && hash_count <= 32) {
+      bloom_hash_version = version;
+      bloom_hash_count = hash_count;
+      bloom_data = bloom_chunk + kBloomDataHeaderSize;
+      bloom_data_size = bloom_chunk_size - kBloomDataHeaderSize;
+    }
+  }
+  if (!bloom_data)
+    bloom_indexes = nullptr;
+  return true;
+}
+
+bool CommitGraph::Find(const git_oid& commit, uint32_t* position) const {
+  unsigned char first = commit.id[0];
+  uint32_t low = first == 0 ? 0 : ReadUInt32(fanout + (first - 1) * 4);
+  uint32_t high = ReadUInt32(fanout + first * 4);
+  if (high > commit_count)
+    return false;
+
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    int compare = memcmp(oids + static_cast<size_t>(middle) * GIT_OID_RAWSZ,
+                         commit.id, GIT_OID_RAWSZ);
+    if (compare == 0) {
+      *position = middle;
+      return true;
+    }
+    if (compare < 0)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return false;
+}
+
+bool CommitGraph::MaybeChanged(const git_oid& commit,
+                               const BloomKeys& keys) const {
+  uint32_t position;
+  if (!bloom_data || keys.HashCount() != bloom_hash_count ||
+      !Find(commit, &position))
+    return true;
+
+  // Each index entry is where the commit's filter ends, so a commit's
+  // filter starts where the previous one ends.
+  size_t start = position == 0 ? 0 :
+      ReadUInt32(bloom_indexes + (position - 1) * 4);
+  size_t end = ReadUInt32(bloom_indexes + position * 4);
+  if (start >= end || end > bloom_data_size)
+    return true;
+
+  const unsigned char* filter = bloom_data + start;
+  uint64_t bit_count = static_cast<uint64_t>(end - start) * 8;
+  const std::vector<uint32_t>& hashes = keys.Hashes();
+  for (size_t key = 0; key < hashes.size(); key += bloom_hash_count) {
+    for (uint32_t i = 0; i < bloom_hash_count; i++) {
+      uint64_t bit = hashes[key + i] % bit_count;
+      if (!(filter[bit / 8] & (1 << (bit % 8))))
+        return false;
+    }
+  }
+  return true;
+}
+
+std::shared_ptr<const CommitGraph> CommitGraphCache::Get(
+    git_repository* repository) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (path.empty()) {
+    git_buf objects = {0};
+    if (git_repository_item_path(&objects, repository,
+                                 GIT_REPOSITORY_ITEM_OBJECTS) != GIT_OK)
+      return nullptr;
+    path = std::string(objects.ptr, objects.size) + "info/commit-graph";
+    git_buf_dispose(&objects);
+  }
+
+  // Git replaces the file rather than updating it in place, so its mtime
+  // and size tell when it has been rewritten.
+  int64_t file_mtime = 0, file_size = -1;
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0) {
+    file_mtime = st.st_mtime;
+    file_size = st.st_size;
+  }
+  if (file_mtime != mtime || file_size != size) {
+    mtime = file_mtime;
+    size = file_size;
+    current = file_size > 0 ? CommitGraph::Open(path) : nullptr;
+  }
+  return current;
+}
+
+void CommitGraphCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  current.reset();
+  mtime = 0;
+  size = -1;
+}
+
+size_t CommitGraphCache::MemoryUsage() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return current ? current->MappedSize() : 0;
+}
@@ -0,0 +1,106 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_COMMIT_GRAPH_H_
+#define SRC_COMMIT_GRAPH_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "git2.h"
+#include "mapped-file.h"
+
+// The hashes of a path in a changed-path Bloom filter. Looking up a path
+// also looks up each of its leading directories, since git adds those to a
+// commit's filter too.
+class BloomKeys {
+ public:
+  BloomKeys(const std::string& path, uint32_t hash_count,
+            uint32_t hash_version);
+
+  const std::vector<uint32_t>& Hashes() const { return hashes; }
+  uint32_t HashCount() const { return hash_count; }
+
+ private:
+  uint32_t hash_count;
+  std::vector<uint32_t> hashes;  // |hash_count| hashes per key.
+};
+
+// A read-only view of a repository's objects/info/commit-graph file, used
+// for the changed-path Bloom filters written by
+// `git commit-graph write --changed-paths`. Split commit-graph chains are
+// not read.
+class CommitGraph {
+ public:
+  static std::shared_ptr<const CommitGraph> Open(const std::string& path);
+
+  size_t MappedSize() const { return file.size; }
+  bool HasBloomFilters() const { return bloom_data != nullptr; }
+  uint32_t BloomHashCount() const { return bloom_hash_count; }
+  uint32_t BloomHashVersion() const { return bloom_hash_version; }
+
+  // Whether |commit| may have changed any of the paths in |keys| relative to
+  // its first parent. Commits missing from the graph, or without a
+  // filter, may have.
+  bool MaybeChanged(const git_oid& commit, const BloomKeys& keys) const;
+
+ private:
+  explicit CommitGraph(const std::string& path);
+
+  bool Parse();
+  bool Find(const git_oid& commit, uint32_t* position) const;
+
+  MappedFile file;
+  uint32_t commit_count;
+  const unsigned char* fanout;
+  const unsigned char* oids;
+  const unsigned char* bloom_indexes;
+  const unsigned char* bloom_data;
+  size_t bloom_data_size;
+  uint32_t bloom_hash_count;
+  uint32_t bloom_hash_version;
+};
+
+// The commit-graph of a repository, opened again only when the file is
+// rewritten.
+class CommitGraphCache {
+ public:
+  CommitGraphCache() : mtime(0), size(-1) {}
+
+  std::shared_ptr<const CommitGraph> Get(git_repository* repository);
+
+  // Unmaps the file until the next Get().
+  void Clear();
+  size_t MemoryUsage();
+
+ private:
+  std::mutex mutex;
+  std::shared_ptr<const CommitGraph> current;
+  std::string path;
+  int64_t mtime;
+  int64_t size;
+};
+
+#endif  // SRC_COMMIT_GRAPH_H_
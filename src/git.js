@@ -1,6 +1,7 @@
 const path = require('path')
 const fs = require('fs-plus')
-const {Repository} = require('../build/Release/git.node')
+const native = require('../build/Release/git.node')
+const {Repository} = native
 
 const statusIndexNew = 1 << 0
 const statusIndexModified = 1 << 1
@@ -153,97 +154,31 @@ Repository.prototype.checkoutReference = function (branch, create) {
 }
 
 Repository.prototype.relativize = function (path) {
-  let workingDirectory
   if (!path) return path
-
-  if (process.platform === 'win32') {
-    path = path.replace(/\\/g, '/')
-  } else {
-    if (path[0] !== '/') return path
-  }
-
-  if (this.caseInsensitiveFs) {
-    const lowerCasePath = path.toLowerCase()
-
-    workingDirectory = this.getWorkingDirectory()
-    if (workingDirectory) {
-      workingDirectory = workingDirectory.toLowerCase()
-      if (lowerCasePath.startsWith(`${workingDirectory}/`)) {
-        return path.substring(workingDirectory.length + 1)
-      } else if (lowerCasePath === workingDirectory) {
-        return ''
-      }
-    }
-
-    if (this.openedWorkingDirectory) {
-      workingDirectory = this.openedWorkingDirectory.toLowerCase()
-      if (lowerCasePath.startsWith(`${workingDirectory}/`)) {
-        return path.substring(workingDirectory.length + 1)
-      } else if (lowerCasePath === workingDirectory) {
-        return ''
-      }
-    }
-  } else {
-    workingDirectory = this.getWorkingDirectory()
-    if (workingDirectory) {
-      if (path.startsWith(`${workingDirectory}/`)) {
-        return path.substring(workingDirectory.length + 1)
-      } else if (path === workingDirectory) {
-        return ''
-      }
-    }
-
-    if (this.openedWorkingDirectory) {
-      if (path.startsWith(`${this.openedWorkingDirectory}/`)) {
-        return path.substring(this.openedWorkingDirectory.length + 1)
-      } else if (path === this.openedWorkingDirectory) {
-        return ''
-      }
-    }
-  }
-
-  return path
+  return this._relativize(path, Boolean(this.caseInsensitiveFs))
 }
 
 Repository.prototype.submoduleForPath = function (path) {
-  path = this.relativize(path)
   if (!path) return null
 
-  for (let submodulePath in this.submodules) {
-    const submoduleRepo = this.submodules[submodulePath]
-    if (path === submodulePath) {
-      return submoduleRepo
-    } else if (path.startsWith(`${submodulePath}/`)) {
-      path = path.substring(submodulePath.length + 1)
-      return submoduleRepo.submoduleForPath(path) || submoduleRepo
-    }
+  const owner = this._submoduleIndexForPath(path, Boolean(this.caseInsensitiveFs))
+  if (owner > 0 && this._pathTableRepositories) {
+    return this._pathTableRepositories[owner - 1]
+  } else {
+    return null
   }
-
-  return null
 }
 
 Repository.prototype.isWorkingDirectory = function (path) {
   if (!path) return false
-
-  if (process.platform === 'win32') {
-    path = path.replace(/\\/g, '/')
-  } else {
-    if (path[0] !== '/') return false
-  }
-
-  if (this.caseInsensitiveFs) {
-    const lowerCasePath = path.toLowerCase()
-    const workingDirectory = this.getWorkingDirectory()
-    if (workingDirectory && workingDirectory.toLowerCase() === lowerCasePath) return true
-    if (this.openedWorkingDirectory && this.openedWorkingDirectory.toLowerCase() === lowerCasePath) return true
-  } else {
-    return path === this.getWorkingDirectory() || path === this.openedWorkingDirectory
-  }
-
-  return false
+  return this._isWorkingDirectory(path, Boolean(this.caseInsensitiveFs))
 }
 
-const {getHeadAsync, getStatus, getStatusAsync, getStatusForPath} = Repository.prototype
+const {
+  getBlameAsync, getCachedStatusAsync, getChangedPathsAsync, getCommitsAsync, getHeadAsync,
+  getPathHistoryStream, getStatus, getStatusAsync, getStatusForPath, getTrackedPathsAsync, grepAsync,
+  scanStatusAsync, warmPacks
+} = Repository.prototype
 delete Repository.prototype.getStatusForPath
 
 Repository.prototype.getStatusForPaths = function (paths) {
@@ -263,32 +198,192 @@ Repository.prototype.getStatus = function (path) {
 }
 
 Repository.prototype.getHeadAsync = function () {
-  return performAsyncWork(this, done => getHeadAsync.call(this, done))
+  return performAsyncWork(this, done => getHeadAsync.call(this, done), 'interactive')
 }
 
 Repository.prototype.getStatusAsync = function () {
-  return performAsyncWork(this, done => getStatusAsync.call(this, done))
+  return performAsyncWork(this, done => {
+    this._pollFileSystemMonitor()
+    getStatusAsync.call(this, done)
+  })
+}
+
+Repository.prototype.getCachedStatusAsync = function () {
+  return performAsyncWork(this, done => getCachedStatusAsync.call(this, done), 'interactive')
+}
+
+Repository.prototype.setPersistentStatusCacheEnabled = function (enabled) {
+  this._setStatusCachePersistent(Boolean(enabled))
+}
+
+Repository.prototype.setPersistentHashCacheEnabled = function (enabled) {
+  this._setHashCachePersistent(Boolean(enabled))
+}
+
+Repository.prototype.getChangedPathsAsync = function (fromRevision, toRevision, options = {}) {
+  return performAsyncWork(this, done => getChangedPathsAsync.call(
+    this, done, fromRevision, toRevision, Boolean(options.detectRenames), Boolean(options.lineStats)
+  ))
+}
+
+Repository.prototype.getBlameAsync = function (filePath, options = {}) {
+  let text = options.textBuffer
+  if (text != null && typeof text !== 'string') text = text.getText()
+  return performAsyncWork(this, done => getBlameAsync.call(this, done, this.relativize(filePath), text), 'interactive')
+}
+
+Repository.prototype.getTrackedPathsAsync = function (options = {}) {
+  options = Object.assign({}, options)
+  if (options.prefix && path.isAbsolute(options.prefix)) {
+    options.prefix = this.relativize(options.prefix)
+  }
+  return performAsyncWork(this, done => getTrackedPathsAsync.call(this, done, options))
+}
+
+Repository.prototype.grepAsync = function (pattern, options = {}, onMatches) {
+  if (typeof options === 'function') {
+    onMatches = options
+    options = {}
+  }
+  options = Object.assign({}, options)
+  if (pattern instanceof RegExp) {
+    options.regex = true
+    options.ignoreCase = pattern.ignoreCase
+    pattern = pattern.source
+  }
+  if (options.paths) {
+    options.paths = options.paths.map(searchPath => (this.relativize(searchPath) || '').replace(/\/+$/, ''))
+  }
+  return performAsyncWork(this, done => grepAsync.call(this, done, String(pattern), options, onMatches))
+}
+
+Repository.prototype.getCommitsAsync = function (oids, options = {}) {
+  const fields = options.fields || ['authorName', 'authorEmail', 'authorTime', 'summary']
+  return performAsyncWork(this, done => getCommitsAsync.call(this, done, Array.from(oids, String), fields))
+}
+
+Repository.prototype.getPathHistoryStream = function (filePath, options = {}, onChunk) {
+  if (typeof options === 'function') {
+    onChunk = options
+    options = {}
+  }
+  const relativePath = (this.relativize(filePath) || '').replace(/\/+$/, '')
+  if (!relativePath) {
+    return Promise.reject(new Error(`${filePath} is not a path inside the repository`))
+  }
+  return performAsyncWork(this, done => getPathHistoryStream.call(this, done, relativePath, options.limit, onChunk))
+}
+
+// Rejects all queued async work with an error whose code is 'ECANCELED', and
+// makes the call that is running give up as soon as it can.
+Repository.prototype.cancelPendingWork = function () {
+  const queue = this._asyncQueue
+  if (queue) {
+    const pending = queue.interactive.concat(queue.background)
+    queue.interactive = []
+    queue.background = []
+    for (const work of pending) work.reject(cancelledError())
+  }
+  this._cancelPendingWork()
+}
+
+Repository.prototype.trimMemory = function () {
+  for (let submodulePath in this.submodules) {
+    const submoduleRepo = this.submodules[submodulePath]
+    if (submoduleRepo) submoduleRepo.trimMemory()
+  }
+  this._trimMemory()
+}
+
+Repository.prototype.warmPacks = function () {
+  return performAsyncWork(this, done => warmPacks.call(this, done))
+}
+
+Repository.prototype.setFileSystemMonitor = function (monitor) {
+  this._fileSystemMonitor = monitor || null
+  this._setStatusCacheEnabled(Boolean(monitor))
+}
+
+Repository.prototype._pollFileSystemMonitor = function () {
+  if (!this._fileSystemMonitor) return
+
+  const changedPaths = this._fileSystemMonitor.getChangedPaths()
+  if (changedPaths == null) {
+    this._invalidateStatusCache()
+  } else if (changedPaths.length > 0) {
+    const relativePaths = []
+    for (const changedPath of changedPaths) {
+      const relativePath = this.relativize(changedPath).replace(/\/+$/, '')
+      if (!path.isAbsolute(relativePath)) relativePaths.push(relativePath)
+    }
+    this._markPathsChanged(relativePaths)
+  }
 }
 
 Repository.prototype.getStatusForPathsAsync = function (paths) {
-  return performAsyncWork(this, done => getStatusAsync.call(this, done, paths))
+  return performAsyncWork(this, done => getStatusAsync.call(this, done, paths), 'interactive')
+}
+
+Repository.prototype.getStatusForDirectoryAsync = function (directory) {
+  directory = (this.relativize(directory) || '').replace(/\/+$/, '')
+  if (path.isAbsolute(directory)) return Promise.resolve({})
+  const paths = directory ? [`${directory}/`] : null
+  return performAsyncWork(this, done => getStatusAsync.call(this, done, paths, true))
 }
 
-function performAsyncWork (repo, fn) {
-  fn = promisify(fn)
+Repository.prototype.scanStatusAsync = function (options = {}) {
+  return performAsyncWork(this, done => scanStatusAsync.call(this, done, options))
+}
 
-  if (repo._lastAsyncPromise) {
-    repo._lastAsyncPromise = repo._lastAsyncPromise.then(fn, fn)
-  } else {
-    repo._lastAsyncPromise = fn()
+// Async work on a repository runs one call at a time, as the native handle
+// it uses isn't thread-safe. Interactive calls are started ahead of any
+// background work still waiting in the queue.
+function performAsyncWork (repo, fn, lane = 'background') {
+  if (!repo._asyncQueue) {
+    repo._asyncQueue = {running: false, idle: true, interactive: [], background: []}
   }
-  return repo._lastAsyncPromise
+  return new Promise((resolve, reject) => {
+    repo._asyncQueue[lane].push({fn, resolve, reject})
+    runNextAsyncWork(repo)
+  })
 }
 
-function promisify (fn) {
-  return () => new Promise((resolve, reject) =>
-    fn((error, result) => error ? reject(error) : resolve(result))
-  )
+function runNextAsyncWork (repo) {
+  const queue = repo._asyncQueue
+  if (queue.running) return
+
+  // The native side only releases the async handle of repositories that
+  // have no async work in flight.
+  const work = queue.interactive.shift() || queue.background.shift()
+  if (!work) {
+    if (!queue.idle) repo._setAsyncIdle(true)
+    queue.idle = true
+    return
+  }
+  if (queue.idle) repo._setAsyncIdle(false)
+  queue.idle = false
+
+  queue.running = true
+  const done = (error, result) => {
+    queue.running = false
+    if (error) {
+      work.reject(error)
+    } else {
+      work.resolve(result)
+    }
+    runNextAsyncWork(repo)
+  }
+  try {
+    work.fn(done)
+  } catch (error) {
+    done(error)
+  }
+}
+
+function cancelledError () {
+  const error = new Error('Operation cancelled')
+  error.code = 'ECANCELED'
+  return error
 }
 
 function realpath (unrealPath) {
@@ -330,6 +425,38 @@ function openRepository (repositoryPath, search) {
   }
 }
 
+// Registers the repository's working directories and those of all of its
+// nested submodules with the native path table used by `relativize`,
+// `isWorkingDirectory` and `submoduleForPath`.
+function buildPathTable (repository) {
+  const submodulePaths = []
+  const submoduleRepos = []
+  const collectSubmodules = (repo, prefix) => {
+    for (let relativePath in repo.submodules) {
+      const submodulePath = prefix ? `${prefix}/${relativePath}` : relativePath
+      submodulePaths.push(submodulePath)
+      submoduleRepos.push(repo.submodules[relativePath])
+      collectSubmodules(repo.submodules[relativePath], submodulePath)
+    }
+  }
+  collectSubmodules(repository, '')
+
+  const prefixes = []
+  const owners = []
+  for (let workingDirectory of [repository.getWorkingDirectory(), repository.openedWorkingDirectory]) {
+    if (!workingDirectory) continue
+    prefixes.push(workingDirectory)
+    owners.push(0)
+    submodulePaths.forEach((submodulePath, index) => {
+      prefixes.push(`${workingDirectory}/${submodulePath}`)
+      owners.push(index + 1)
+    })
+  }
+
+  repository._pathTableRepositories = submoduleRepos
+  repository._setPathTable(prefixes, owners)
+}
+
 function openSubmodules (repository) {
   repository.submodules = {}
 
@@ -347,6 +474,8 @@ function openSubmodules (repository) {
       }
     }
   }
+
+  buildPathTable(repository)
 }
 
 exports.open = function (repositoryPath, search = true) {
@@ -354,3 +483,69 @@ exports.open = function (repositoryPath, search = true) {
   if (repository) openSubmodules(repository)
   return repository
 }
+
+exports.startTracing = function () {
+  native.startTracing()
+}
+
+exports.stopTracing = function () {
+  native.stopTracing()
+}
+
+exports.dumpTrace = function () {
+  return native.dumpTrace()
+}
+
+exports.setCacheOptions = function (options) {
+  native.setCacheOptions(options)
+}
+
+exports.getCacheOptions = function () {
+  return native.getCacheOptions()
+}
+
+exports.setThreadPoolSize = function (size) {
+  native.setThreadPoolSize(size || 0)
+}
+
+exports.getThreadPoolSize = function () {
+  return native.getThreadPoolSize()
+}
+
+// How often the memory budget is checked, in milliseconds.
+const memoryBudgetInterval = 5000
+let memoryBudget = {maxBytes: 0, idleTimeout: 0}
+let memoryBudgetTimer = null
+
+function enforceMemoryBudget () {
+  if (memoryBudget.idleTimeout > 0) native._trimRepositories(0, memoryBudget.idleTimeout)
+  if (memoryBudget.maxBytes > 0) native._trimRepositories(memoryBudget.maxBytes, 0)
+}
+
+exports.setMemoryBudget = function (options = {}) {
+  memoryBudget = {
+    maxBytes: Math.max(Number(options.maxBytes) || 0, 0),
+    idleTimeout: Math.max(Number(options.idleTimeout) || 0, 0)
+  }
+  if (memoryBudgetTimer) clearInterval(memoryBudgetTimer)
+  memoryBudgetTimer = null
+  if (memoryBudget.maxBytes > 0 || memoryBudget.idleTimeout > 0) {
+    const interval = memoryBudget.idleTimeout > 0
+      ? Math.min(memoryBudget.idleTimeout, memoryBudgetInterval)
+      : memoryBudgetInterval
+    memoryBudgetTimer = setInterval(enforceMemoryBudget, interval)
+    if (memoryBudgetTimer.unref) memoryBudgetTimer.unref()
+  }
+}
+
+exports.getMemoryBudget = function () {
+  return Object.assign({}, memoryBudget)
+}
+
+exports.trimMemory = function () {
+  return native._trimRepositories(0, 0)
+}
+
+exports.getMemoryUsage = function () {
+  return native._getProcessMemoryUsage()
+}
@@ -0,0 +1,556 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "grep.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+// Like git, files with a NUL byte in their first 8000 bytes are binary.
+const size_t kBinaryCheckLength = 8000;
+
+// Longer lines are cut off in the reported text.
+const size_t kMaxLineLength = 1024;
+
+const size_t kMaxCachedPatterns = 4;
+const size_t kMaxCachedMatches = 100000;
+
+std::string OidKey(const git_oid& oid) {
+  return std::string(reinterpret_cast<const char*>(oid.id), GIT_OID_RAWSZ);
+}
+
+// The number of UTF-16 code units needed for |length| bytes of UTF-8.
+uint32_t Utf16Length(const char* data, size_t length) {
+  uint32_t units = 0;
+  for (size_t i = 0; i < length; i++) {
+    unsigned char c = data[i];
+    if ((c & 0xC0) != 0x80)
+      units++;
+    if (c >= 0xF0)
+      units++;
+  }
+  return units;
+}
+
+void AddMatch(const char* line, size_t line_length, size_t offset,
+              size_t length, uint32_t row, std::vector<GrepMatch>* matches) {
+  if (line_length > 0 && line[line_length - 1] == '\r')
+    line_length--;
+  offset = std::min(offset, line_length);
+  length = std::min(length, line_length - offset);
+
+  size_t text_length = line_length;
+  if (text_length > kMaxLineLength) {
+    text_length = kMaxLineLength;
+    while (text_length > 0 && (line[text_length] & 0xC0) == 0x80)
+      text_length--;
+  }
+
+  GrepMatch match;
+  match.row = row;
+  match.column = Utf16Length(line, offset);
+  match.length = Utf16Length(line + offset, length);
+  match.text.assign(line, text_length);
+  matches->push_back(std::move(match));
+}
+
+const char* FindLiteral(const char* begin, const char* end,
+                        const std::string& needle) {
+  size_t length = needle.size();
+  if (static_cast<size_t>(end - begin) < length)
+    return nullptr;
+  const char* last = end - length;
+  while (begin <= last) {
+    const char* candidate = static_cast<const char*>(
+      memchr(begin, needle[0], last - begin + 1));
+    if (candidate == nullptr)
+      return nullptr;
+    if (memcmp(candidate + 1, needle.data() + 1, length - 1) == 0)
+      return candidate;
+    begin = candidate + 1;
+  }
+  return nullptr;
+}
+
+void FoldCase(std::string* text) {
+  for (char& c : *text) {
+    if (c >= 'A' && c <= 'Z')
+      c += 'a' - 'A';
+  }
+}
+
+bool ReadFile(const std::string& path, std::string* contents) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr)
+    return false;
+  char buffer[16384];
+  size_t count;
+  while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    contents->append(buffer, count);
+  bool ok = ferror(file) == 0;
+  fclose(file);
+  return ok;
+}
+
+bool IsAtOrBelow(const std::string& path, const std::string& prefix) {
+  return path.compare(0, prefix.size(), prefix) == 0 &&
+    (path.size() == prefix.size() || path[prefix.size()] == '/');
+}
+
+bool IsSelected(const std::string& path,
+                const std::vector<std::string>& paths) {
+  if (paths.empty())
+    return true;
+  for (const std::string& prefix : paths) {
+    if (IsAtOrBelow(path, prefix))
+      return true;
+  }
+  return false;
+}
+
+// Whether a directory may hold selected files.
+bool MayContainSelected(const std::string& directory,
+                        const std::vector<std::string>& paths) {
+  if (paths.empty())
+    return true;
+  for (const std::string& prefix : paths) {
+    if (IsAtOrBelow(directory, prefix) || IsAtOrBelow(prefix, directory))
+      return true;
+  }
+  return false;
+}
+
+std::vector<std::string> NormalizePaths(const std::vector<std::string>& paths) {
+  std::vector<std::string> normalized;
+  for (std::string path : paths) {
+    while (!path.empty() && path.back() == '/')
+      path.pop_back();
+    if (path.empty())
+      return std::vector<std::string>();
+    normalized.push_back(path);
+  }
+  return normalized;
+}
+
+bool IsSearchable(uint32_t mode) {
+  return mode != GIT_FILEMODE_LINK && mode != GIT_FILEMODE_COMMIT &&
+    mode != GIT_FILEMODE_TREE;
+}
+
+}  // namespace
+
+GrepPattern::GrepPattern(const std::string& pattern, bool regex,
+                         bool ignore_case)
+  : ignore_case(ignore_case) {
+  key = std::string(regex ? "r" : "l") + (ignore_case ? "i:" : "c:") + pattern;
+  if (pattern.empty()) {
+    error = "The search pattern can't be empty";
+    return;
+  }
+
+  if (!regex) {
+    literal = pattern;
+    if (ignore_case)
+      FoldCase(&literal);
+    return;
+  }
+
+  auto flags = std::regex::ECMAScript | std::regex::optimize;
+  if (ignore_case)
+    flags |= std::regex::icase;
+  try {
+    this->regex.reset(new std::regex(pattern, flags));
+  } catch (const std::regex_error& e) {
+    error = std::string("Invalid regular expression: ") + e.what();
+  }
+}
+
+bool GrepPattern::Search(const char* data, size_t size,
+                         std::vector<GrepMatch>* matches) const {
+  if (memchr(data, 0, std::min(size, kBinaryCheckLength)) != nullptr)
+    return true;
+
+  if (regex) {
+    return SearchRegex(data, size, matches);
+  } else if (ignore_case) {
+    static thread_local std::string folded;
+    folded.assign(data, size);
+    FoldCase(&folded);
+    SearchLiteral(folded.data(), size, data, matches);
+  } else {
+    SearchLiteral(data, size, data, matches);
+  }
+  return true;
+}
+
+// Searches |data| but takes the reported text from |original|, which has the
+// same layout and differs only in case.
+void GrepPattern::SearchLiteral(const char* data, size_t size,
+                                const char* original,
+                                std::vector<GrepMatch>* matches) const {
+  const char* end = data + size;
+  const char* line_start = data;
+  const char* cursor = data;
+  uint32_t row = 0;
+  while (const char* found = FindLiteral(cursor, end, literal)) {
+    while (const char* newline = static_cast<const char*>(
+             memchr(line_start, '\n', found - line_start))) {
+      line_start = newline + 1;
+      row++;
+    }
+    const char* line_end = static_cast<const char*>(
+      memchr(found, '\n', end - found));
+    if (line_end == nullptr)
+      line_end = end;
+
+    AddMatch(original + (line_start - data), line_end - line_start,
+             found - line_start, literal.size(), row, matches);
+    if (line_end == end)
+      break;
+    cursor = line_start = line_end + 1;
+    row++;
+  }
+}
+
+bool GrepPattern::SearchRegex(const char* data, size_t size,
+                              std::vector<GrepMatch>* matches) const {
+  const char* end = data + size;
+  const char* line_start = data;
+  uint32_t row = 0;
+  bool searched_in_full = true;
+  std::cmatch match;
+  while (line_start < end) {
+    const char* line_end = static_cast<const char*>(
+      memchr(line_start, '\n', end - line_start));
+    if (line_end == nullptr)
+      line_end = end;
+    const char* content_end = line_end;
+    if (content_end > line_start && content_end[-1] == '\r')
+      content_end--;
+
+    // std::regex recurses once per character it matches, so searching a
+    // long minified line can overflow the thread's stack. Only the part of
+    // the line that gets reported is searched, and the cut isn't treated as
+    // the end of the line. Patterns that backtrack too much within it make
+    // regex_search throw, which counts as no match.
+    const char* search_end = content_end;
+    auto flags = std::regex_constants::match_default;
+    if (static_cast<size_t>(search_end - line_start) > kMaxLineLength) {
+      search_end = line_start + kMaxLineLength;
+      flags |= std::regex_constants::match_not_eol;
+      searched_in_full = false;
+    }
+    bool found = false;
+    try {
+      found = std::regex_search(line_start, search_end, match, *regex, flags);
+    } catch (const std::regex_error&) {
+    }
+    if (found) {
+      AddMatch(line_start, line_end - line_start, match.position(0),
+               match.length(0), row, matches);
+    }
+
+    line_start = line_end + 1;
+    row++;
+  }
+  return searched_in_full;
+}
+
+GrepCache::GrepCache() {}
+
+GrepCache::PatternResults* GrepCache::Find(const std::string& pattern_key) {
+  for (auto it = patterns.begin(); it != patterns.end(); ++it) {
+    if (it->key == pattern_key) {
+      if (it != patterns.begin())
+        patterns.splice(patterns.begin(), patterns, it);
+      return &patterns.front();
+    }
+  }
+  return nullptr;
+}
+
+bool GrepCache::Lookup(const std::string& pattern_key, const git_oid& oid,
+                       std::vector<GrepMatch>* matches) {
+  std::lock_guard<std::mutex> lock(mutex);
+  PatternResults* results = Find(pattern_key);
+  if (results == nullptr)
+    return false;
+  auto blob = results->blobs.find(OidKey(oid));
+  if (blob == results->blobs.end())
+    return false;
+  *matches = blob->second;
+  return true;
+}
+
+void GrepCache::Store(const std::string& pattern_key, const git_oid& oid,
+                      const std::vector<GrepMatch>& matches) {
+  std::lock_guard<std::mutex> lock(mutex);
+  PatternResults* results = Find(pattern_key);
+  if (results == nullptr) {
+    patterns.emplace_front();
+    results = &patterns.front();
+    results->key = pattern_key;
+    results->match_count = 0;
+    results->bytes = 0;
+    if (patterns.size() > kMaxCachedPatterns)
+      patterns.pop_back();
+  }
+
+  // Patterns that match nearly every line aren't worth keeping in memory.
+  if (results->match_count + matches.size() > kMaxCachedMatches)
+    return;
+  if (results->blobs.emplace(OidKey(oid), matches).second) {
+    results->match_count += matches.size();
+    results->bytes += GIT_OID_RAWSZ + sizeof(std::vector<GrepMatch>) +
+                      matches.size() * sizeof(GrepMatch);
+    for (const GrepMatch& match : matches)
+      results->bytes += match.text.capacity();
+  }
+}
+
+void GrepCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  patterns.clear();
+}
+
+size_t GrepCache::MemoryUsage() {
+  std::lock_guard<std::mutex> lock(mutex);
+  size_t bytes = 0;
+  for (const PatternResults& results : patterns)
+    bytes += results.bytes;
+  return bytes;
+}
+
+Grep::Grep(git_repository* repository, const GrepPattern& pattern,
+           GrepCache* cache)
+  : repository(repository), pattern(pattern), cache(cache), odb(nullptr),
+    bytes_scanned(0), partially_searched(false) {
+  const char* path = git_repository_workdir(repository);
+  if (path != nullptr)
+    workdir = path;
+}
+
+Grep::~Grep() {
+  git_odb_free(odb);
+}
+
+int Grep::Collect(Source source, const std::vector<std::string>& paths) {
+  files.clear();
+  if (odb == nullptr) {
+    int error = git_repository_odb(&odb, repository);
+    if (error != GIT_OK)
+      return error;
+  }
+
+  std::vector<std::string> normalized = NormalizePaths(paths);
+  switch (source) {
+    case kHead:
+      return CollectTree(normalized);
+    case kIndex:
+      return CollectIndex(normalized, false);
+    case kWorkdir:
+      return CollectIndex(normalized, !workdir.empty());
+  }
+  return GIT_OK;
+}
+
+int Grep::CollectTree(const std::vector<std::string>& paths) {
+  if (git_repository_head_unborn(repository) == 1)
+    return GIT_OK;
+
+  git_object* tree;
+  int error = git_revparse_single(&tree, repository, "HEAD^{tree}");
+  if (error != GIT_OK)
+    return error;
+
+  struct WalkState {
+    const std::vector<std::string>* paths;
+    std::vector<File>* files;
+  } state = {&paths, &files};
+
+  auto callback = [](const char* root, const git_tree_entry* entry,
+                     void* payload) -> int {
+    WalkState* state = static_cast<WalkState*>(payload);
+    std::string path = std::string(root) + git_tree_entry_name(entry);
+    git_filemode_t mode = git_tree_entry_filemode(entry);
+    if (mode == GIT_FILEMODE_TREE)
+      return MayContainSelected(path, *state->paths) ? 0 : 1;
+    if (IsSearchable(mode) && IsSelected(path, *state->paths))
+      state->files->push_back({path, *git_tree_entry_id(entry), false});
+    return 0;
+  };
+  error = git_tree_walk(reinterpret_cast<git_tree*>(tree), GIT_TREEWALK_PRE,
+                        callback, &state);
+  git_object_free(tree);
+  return error;
+}
+
+// In the working directory, files whose size and modification time still
+// match the index entry are read from the ODB, where their results may be
+// cached, and only the rest are read from disk. Entries modified within the
+// same second as the index was written can't be trusted, like in git.
+int Grep::CollectIndex(const std::vector<std::string>& paths, bool workdir) {
+  git_index* index;
+  int error = git_repository_index(&index, repository);
+  if (error != GIT_OK)
+    return error;
+  error = git_index_read(index, 0);
+  if (error != GIT_OK) {
+    git_index_free(index);
+    return error;
+  }
+
+  int64_t index_mtime = 0;
+  if (workdir) {
+    struct stat st;
+    if (git_index_path(index) && stat(git_index_path(index), &st) == 0)
+      index_mtime = st.st_mtime;
+  }
+
+  size_t count = git_index_entrycount(index);
+  for (size_t i = 0; i < count; i++) {
+    const git_index_entry* entry = git_index_get_byindex(index, i);
+    if (git_index_entry_stage(entry) != 0 || !IsSearchable(entry->mode))
+      continue;
+    std::string path = entry->path;
+    if (!IsSelected(path, paths))
+      continue;
+    if (!workdir) {
+      files.push_back({path, entry->id, false});
+      continue;
+    }
+
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64((this->workdir + path).c_str(), &st) != 0)
+      continue;
+#else
+    struct stat st;
+    if (lstat((this->workdir + path).c_str(), &st) != 0)
+      continue;
+#endif
+    if ((st.st_mode & S_IFMT) != S_IFREG)
+      continue;
+
+    bool unchanged =
+      entry->file_size == static_cast<uint32_t>(st.st_size) &&
+      entry->mtime.seconds == static_cast<int32_t>(st.st_mtime) &&
+      entry->mtime.seconds < index_mtime;
+#if defined(__APPLE__)
+    unchanged = unchanged &&
+      entry->mtime.nanoseconds == static_cast<uint32_t>(st.st_mtimespec.tv_nsec);
+#elif !defined(_WIN32)
+    unchanged = unchanged &&
+      entry->mtime.nanoseconds == static_cast<uint32_t>(st.st_mtim.tv_nsec);
+#endif
+    files.push_back({path, entry->id, !unchanged});
+  }
+
+  git_index_free(index);
+  return GIT_OK;
+}
+
+void Grep::Scan(const File& file, std::vector<GrepMatch>* matches) {
+  if (file.on_disk) {
+    std::string contents;
+    if (ReadFile(workdir + file.path, &contents)) {
+      bytes_scanned += contents.size();
+      if (!pattern.Search(contents.data(), contents.size(), matches))
+        partially_searched = true;
+    }
+    return;
+  }
+
+  if (cache && cache->Lookup(pattern.Key(), file.oid, matches))
+    return;
+
+  git_odb_object* object;
+  if (git_odb_read(&object, odb, &file.oid) != GIT_OK)
+    return;
+  size_t size = git_odb_object_size(object);
+  bytes_scanned += size;
+  bool searched_in_full = pattern.Search(
+    static_cast<const char*>(git_odb_object_data(object)), size, matches);
+  git_odb_object_free(object);
+  // Partly searched blobs aren't cached so every search reports them.
+  if (!searched_in_full)
+    partially_searched = true;
+  else if (cache)
+    cache->Store(pattern.Key(), file.oid, *matches);
+}
+
+bool Grep::Run(size_t thread_count, size_t max_matches, const Sink& sink) {
+  std::atomic<size_t> next_file(0);
+  std::atomic<size_t> match_count(0);
+  std::atomic<bool> truncated(false);
+  const CancellationToken& token = CancellationToken::Current();
+
+  auto scan_files = [&]() {
+    std::vector<GrepMatch> matches;
+    for (;;) {
+      size_t index = next_file++;
+      if (index >= files.size() || token.IsCancelled())
+        return;
+      if (max_matches != 0 && match_count >= max_matches) {
+        truncated = true;
+        return;
+      }
+
+      matches.clear();
+      Scan(files[index], &matches);
+      if (matches.empty())
+        continue;
+
+      if (max_matches != 0) {
+        size_t previous = match_count.fetch_add(matches.size());
+        if (previous >= max_matches) {
+          truncated = true;
+          return;
+        }
+        if (previous + matches.size() > max_matches) {
+          matches.resize(max_matches - previous);
+          truncated = true;
+        }
+      }
+
+      GrepFileMatches result;
+      result.path = files[index].path;
+      result.matches.swap(matches);
+      sink(&result);
+    }
+  };
+
+  thread_count = std::max<size_t>(1, std::min(thread_count, files.size()));
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < thread_count; i++)
+    threads.emplace_back(scan_files);
+  scan_files();
+  for (std::thread& thread : threads)
+    thread.join();
+  return truncated;
+}
@@ -0,0 +1,168 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_GREP_H_
+#define SRC_GREP_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cancellation.h"
+#include "git2.h"
+
+// A matching line. Columns and lengths are in UTF-16 code units so they can
+// be used as JS string offsets into |text|.
+struct GrepMatch {
+  uint32_t row;  // Zero-based.
+  uint32_t column;
+  uint32_t length;
+  std::string text;  // The line without its line ending, truncated if long.
+};
+
+struct GrepFileMatches {
+  std::string path;
+  std::vector<GrepMatch> matches;
+};
+
+// A literal string or ECMAScript regular expression to look for. Literal
+// patterns are found with memchr, which libc vectorizes, plus a memcmp at
+// each candidate; regexes are run line by line.
+class GrepPattern {
+ public:
+  GrepPattern(const std::string& pattern, bool regex, bool ignore_case);
+
+  bool IsValid() const { return error.empty(); }
+  const std::string& Error() const { return error; }
+
+  // Identifies the pattern and its flags in the result cache.
+  const std::string& Key() const { return key; }
+
+  // Adds the first match on each matching line of |data|. Files with a NUL
+  // byte near the start are treated as binary and skipped. Returns false if
+  // a line was too long for a regex to search all of it.
+  bool Search(const char* data, size_t size,
+              std::vector<GrepMatch>* matches) const;
+
+ private:
+  void SearchLiteral(const char* data, size_t size, const char* original,
+                     std::vector<GrepMatch>* matches) const;
+  bool SearchRegex(const char* data, size_t size,
+                   std::vector<GrepMatch>* matches) const;
+
+  std::string literal;
+  bool ignore_case;
+  std::unique_ptr<std::regex> regex;
+  std::string key;
+  std::string error;
+};
+
+// Matches per blob for the last few patterns searched. Blobs are keyed by
+// oid, so results stay valid however the tree, index or branch change, and
+// repeating a search only has to scan files that were edited since.
+class GrepCache {
+ public:
+  GrepCache();
+
+  bool Lookup(const std::string& pattern_key, const git_oid& oid,
+              std::vector<GrepMatch>* matches);
+  void Store(const std::string& pattern_key, const git_oid& oid,
+             const std::vector<GrepMatch>& matches);
+  void Clear();
+
+  // An estimate of the heap memory held by the cached matches.
+  size_t MemoryUsage();
+
+ private:
+  struct PatternResults {
+    std::string key;
+    std::unordered_map<std::string, std::vector<GrepMatch>> blobs;
+    size_t match_count;
+    size_t bytes;
+  };
+
+  PatternResults* Find(const std::string& pattern_key);
+
+  std::mutex mutex;
+  std::list<PatternResults> patterns;  // Most recently used first.
+};
+
+// Searches the files of HEAD's tree, the index or the working directory.
+// The file list is built on the calling thread; the files are then read and
+// scanned on several threads at once.
+class Grep {
+ public:
+  enum Source { kHead, kIndex, kWorkdir };
+
+  // Called from the scanning threads with each file that has matches.
+  typedef std::function<void(GrepFileMatches*)> Sink;
+
+  Grep(git_repository* repository, const GrepPattern& pattern,
+       GrepCache* cache);
+  ~Grep();
+
+  // Lists the regular files in |source| at or below any of |paths|, or all of
+  // them when |paths| is empty.
+  int Collect(Source source, const std::vector<std::string>& paths);
+
+  // Scans the collected files with up to |thread_count| threads and stops
+  // once |max_matches| matches were found, if it is not zero, or when the
+  // current thread's cancellation token is cancelled. Returns true if
+  // matches were dropped because of the limit.
+  bool Run(size_t thread_count, size_t max_matches, const Sink& sink);
+
+  size_t FileCount() const { return files.size(); }
+  size_t BytesScanned() const { return bytes_scanned; }
+
+  // Whether a line was too long for a regex to search all of it, so matches
+  // past its start may be missing.
+  bool PartiallySearched() const { return partially_searched; }
+
+ private:
+  struct File {
+    std::string path;
+    git_oid oid;
+    bool on_disk;  // Read from the working directory instead of the ODB.
+  };
+
+  int CollectTree(const std::vector<std::string>& paths);
+  int CollectIndex(const std::vector<std::string>& paths, bool workdir);
+  void Scan(const File& file, std::vector<GrepMatch>* matches);
+
+  git_repository* repository;
+  const GrepPattern& pattern;
+  GrepCache* cache;
+  git_odb* odb;
+  std::string workdir;
+  std::vector<File> files;
+  std::atomic<size_t> bytes_scanned;
+  std::atomic<bool> partially_searched;
+};
+
+#endif  // SRC_GREP_H_
@@ -0,0 +1,193 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "hash-cache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "mapped-file.h"
+
+namespace {
+
+const char kMagic[4] = {'G', 'U', 'H', 'C'};
+const uint32_t kVersion = 2;
+
+struct FileHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t entry_count;
+  uint32_t reserved;
+};
+
+// Each record is followed by its path, padded to a multiple of 8 bytes.
+struct EntryHeader {
+  int64_t mtime_seconds;
+  uint32_t mtime_nanoseconds;
+  uint32_t path_length;
+  uint64_t size;
+  uint64_t inode;
+  unsigned char oid[GIT_OID_RAWSZ];
+  uint32_t reserved;
+};
+
+size_t Padded(size_t length) {
+  return (length + 7) & ~static_cast<size_t>(7);
+}
+
+}  // namespace
+
+bool HashCache::Lookup(const std::string& path, const FileStat& stat,
+                       git_oid* oid) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto entry = entries.find(path);
+  if (entry == entries.end() || !(entry->second.stat == stat))
+    return false;
+  git_oid_cpy(oid, &entry->second.oid);
+  return true;
+}
+
+void HashCache::Store(const std::string& path, const FileStat& stat,
+                      const git_oid& oid, int64_t read_time) {
+  if (stat.mtime_seconds >= read_time)
+    return;
+  std::lock_guard<std::mutex> lock(mutex);
+  Entry& entry = entries[path];
+  entry.stat = stat;
+  git_oid_cpy(&entry.oid, &oid);
+  dirty = true;
+}
+
+void HashCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  entries.clear();
+  dirty = false;
+  // A persistent cache is read from disk again on its next use.
+  loaded = false;
+}
+
+void HashCache::SetPersistent(bool persistent) {
+  std::lock_guard<std::mutex> lock(mutex);
+  this->persistent = persistent;
+  if (!persistent)
+    loaded = false;
+}
+
+std::string HashCache::PathFor(git_repository* repository) {
+  return std::string(git_repository_path(repository)) + "git-utils-hash.cache";
+}
+
+void HashCache::Load(git_repository* repository) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!persistent || loaded)
+    return;
+  loaded = true;
+
+  MappedFile file(PathFor(repository));
+  if (!file.data || file.size < sizeof(FileHeader))
+    return;
+  FileHeader header;
+  memcpy(&header, file.data, sizeof(header));
+  if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion)
+    return;
+
+  size_t offset = sizeof(header);
+  for (uint32_t i = 0; i < header.entry_count; i++) {
+    EntryHeader record;
+    if (file.size - offset < sizeof(record))
+      return;
+    memcpy(&record, file.data + offset, sizeof(record));
+    offset += sizeof(record);
+    if (file.size - offset < Padded(record.path_length))
+      return;
+
+    // Hashes computed in this session are newer than the saved ones.
+    std::string path(file.data + offset, record.path_length);
+    offset += Padded(record.path_length);
+    if (entries.count(path))
+      continue;
+    Entry& entry = entries[path];
+    entry.stat.mtime_seconds = record.mtime_seconds;
+    entry.stat.mtime_nanoseconds = record.mtime_nanoseconds;
+    entry.stat.size = record.size;
+    entry.stat.inode = record.inode;
+    git_oid_fromraw(&entry.oid, record.oid);
+  }
+}
+
+void HashCache::Save(git_repository* repository) {
+  std::string contents;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!persistent || !dirty)
+      return;
+    dirty = false;
+
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.entry_count = entries.size();
+    contents.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& entry : entries) {
+      EntryHeader record;
+      memset(&record, 0, sizeof(record));
+      record.mtime_seconds = entry.second.stat.mtime_seconds;
+      record.mtime_nanoseconds = entry.second.stat.mtime_nanoseconds;
+      record.path_length = entry.first.size();
+      record.size = entry.second.stat.size;
+      record.inode = entry.second.stat.inode;
+      memcpy(record.oid, entry.second.oid.id, GIT_OID_RAWSZ);
+      contents.append(reinterpret_cast<const char*>(&record), sizeof(record));
+      contents.append(entry.first);
+      contents.append(Padded(entry.first.size()) - entry.first.size(), '\0');
+    }
+  }
+
+  std::string path = PathFor(repository);
+  std::string temporary_path = path + ".lock";
+  FILE* file = fopen(temporary_path.c_str(), "wb");
+  if (!file)
+    return;
+  bool written =
+    fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+  written = fclose(file) == 0 && written;
+
+#ifdef _WIN32
+  if (written)
+    remove(path.c_str());
+#endif
+  if (!written || rename(temporary_path.c_str(), path.c_str()) != 0)
+    remove(temporary_path.c_str());
+}
+
+size_t HashCache::MemoryUsage() {
+  std::lock_guard<std::mutex> lock(mutex);
+  size_t bytes = entries.bucket_count() * sizeof(void*);
+  for (const auto& entry : entries) {
+    bytes += sizeof(std::pair<const std::string, Entry>) + sizeof(void*) +
+             entry.first.capacity();
+  }
+  return bytes;
+}
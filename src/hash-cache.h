@@ -0,0 +1,90 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_HASH_CACHE_H_
+#define SRC_HASH_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "git2.h"
+
+// The stat data of a working directory file that a hash was computed for.
+struct FileStat {
+  int64_t mtime_seconds;
+  uint32_t mtime_nanoseconds;
+  uint64_t size;
+  uint64_t inode;
+
+  bool operator==(const FileStat& other) const {
+    return mtime_seconds == other.mtime_seconds &&
+           mtime_nanoseconds == other.mtime_nanoseconds &&
+           size == other.size && inode == other.inode;
+  }
+};
+
+// The blob oids of working directory files, keyed by path and stat data, so
+// a file whose stat data can't be trusted against the index is only hashed
+// again once it actually changes. The cache can be saved under the .git
+// directory to survive restarts.
+class HashCache {
+ public:
+  HashCache() : persistent(false), loaded(false), dirty(false) {}
+
+  bool Lookup(const std::string& path, const FileStat& stat, git_oid* oid);
+
+  // |read_time| is when reading the file started, in seconds. Hashes of
+  // files modified no earlier than that are not kept, as another write
+  // within the same timestamp tick could leave the stat data unchanged.
+  void Store(const std::string& path, const FileStat& stat, const git_oid& oid,
+             int64_t read_time);
+  void Clear();
+
+  // Loads the saved cache the first time it is called after persistence is
+  // turned on, and saves the cache when it changed since.
+  void Load(git_repository* repository);
+  void Save(git_repository* repository);
+
+  void SetPersistent(bool persistent);
+
+  // An estimate of the heap memory held by the cache.
+  size_t MemoryUsage();
+
+ private:
+  struct Entry {
+    FileStat stat;
+    git_oid oid;
+  };
+
+  static std::string PathFor(git_repository* repository);
+
+  std::mutex mutex;
+  std::unordered_map<std::string, Entry> entries;
+  bool persistent;
+  bool loaded;
+  bool dirty;
+};
+
+#endif  // SRC_HASH_CACHE_H_
@@ -0,0 +1,442 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "index-refresh.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <io.h>
+#endif
+#include <fcntl.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cancellation.h"
+#include "instrumentation.h"
+
+namespace {
+
+// An index entry whose file has to be hashed to tell whether it changed,
+// along with the entry it gets if it didn't.
+struct Candidate {
+  std::string path;
+  FileStat stat;
+  git_index_entry refreshed;
+  git_oid oid;
+  bool hashed;
+  bool cached;
+};
+
+bool IsFile(uint32_t mode) {
+  return mode == GIT_FILEMODE_BLOB || mode == GIT_FILEMODE_BLOB_EXECUTABLE;
+}
+
+// Stats a regular working directory file, filling in |entry| the way
+// libgit2 does when it adds the file to the index.
+bool StatFile(const std::string& path, FileStat* stat,
+              git_index_entry* entry) {
+#ifdef _WIN32
+  struct _stat64 st;
+  if (_stat64(path.c_str(), &st) != 0)
+    return false;
+#else
+  struct stat st;
+  if (lstat(path.c_str(), &st) != 0)
+    return false;
+#endif
+  if ((st.st_mode & S_IFMT) != S_IFREG)
+    return false;
+
+  stat->mtime_seconds = st.st_mtime;
+  stat->mtime_nanoseconds = 0;
+  entry->ctime.nanoseconds = 0;
+#if defined(__APPLE__)
+  stat->mtime_nanoseconds = st.st_mtimespec.tv_nsec;
+  entry->ctime.nanoseconds = st.st_ctimespec.tv_nsec;
+#elif !defined(_WIN32)
+  stat->mtime_nanoseconds = st.st_mtim.tv_nsec;
+  entry->ctime.nanoseconds = st.st_ctim.tv_nsec;
+#endif
+  stat->size = st.st_size;
+  stat->inode = st.st_ino;
+
+  entry->ctime.seconds = static_cast<int32_t>(st.st_ctime);
+  entry->mtime.seconds = static_cast<int32_t>(st.st_mtime);
+  entry->mtime.nanoseconds = stat->mtime_nanoseconds;
+  entry->dev = st.st_dev;
+  entry->ino = static_cast<uint32_t>(st.st_ino);
+  entry->uid = st.st_uid;
+  entry->gid = st.st_gid;
+  entry->file_size = static_cast<uint32_t>(st.st_size);
+  return true;
+}
+
+// Whether libgit2's status would have to hash the file to know if it
+// changed. A different size already tells it did, and only seconds of the
+// modification time are compared, as libgit2 is built without GIT_USE_NSEC.
+// Files modified no earlier than the index was written are racy: they may
+// have changed again within the same second.
+bool NeedsHash(const git_index_entry& entry, const git_index_entry& current,
+               int64_t index_mtime) {
+  if (entry.file_size != current.file_size)
+    return false;
+  return entry.mtime.seconds != current.mtime.seconds ||
+         entry.ctime.seconds != current.ctime.seconds ||
+         entry.ino != current.ino ||
+         entry.uid != current.uid ||
+         entry.gid != current.gid ||
+         current.mtime.seconds >= index_mtime;
+}
+
+bool ReadFile(const std::string& path, std::string* contents) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file)
+    return false;
+  contents->clear();
+  char buffer[64 * 1024];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    contents->append(buffer, read);
+  bool failed = ferror(file) != 0;
+  fclose(file);
+  return !failed;
+}
+
+bool WriteFile(const std::string& path, const std::string& contents) {
+  FILE* file = fopen(path.c_str(), "wb");
+  if (!file)
+    return false;
+  bool written =
+    fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+  return fclose(file) == 0 && written;
+}
+
+// Creates |path| only if it doesn't exist, which is how git locks a file.
+bool CreateLockFile(const std::string& path) {
+#ifdef _WIN32
+  int fd = _open(path.c_str(), _O_CREAT | _O_EXCL | _O_WRONLY,
+                 _S_IREAD | _S_IWRITE);
+  if (fd < 0)
+    return false;
+  _close(fd);
+#else
+  int fd = open(path.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0666);
+  if (fd < 0)
+    return false;
+  close(fd);
+#endif
+  return true;
+}
+
+uint32_t ReadUint32(const char* data) {
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+  return (static_cast<uint32_t>(bytes[0]) << 24) | (bytes[1] << 16) |
+         (bytes[2] << 8) | bytes[3];
+}
+
+// Whether the index file in |contents| has extensions that libgit2 drops
+// when it writes the index, such as git's untracked cache (UNTR) or
+// fsmonitor data (FSMN). Indexes that can't be parsed count as having them.
+bool HasForeignExtensions(const std::string& contents) {
+  const size_t kHeaderSize = 12;
+  const size_t kEntryPathOffset = 62;
+  if (contents.size() < kHeaderSize + GIT_OID_RAWSZ ||
+      memcmp(contents.data(), "DIRC", 4) != 0)
+    return true;
+  const char* data = contents.data();
+  uint32_t version = ReadUint32(data + 4);
+  uint32_t count = ReadUint32(data + 8);
+  size_t end = contents.size() - GIT_OID_RAWSZ;
+  if (version < 2 || version > 4)
+    return true;
+
+  size_t offset = kHeaderSize;
+  for (uint32_t i = 0; i < count; i++) {
+    if (end - offset < kEntryPathOffset)
+      return true;
+    size_t path_offset = kEntryPathOffset;
+    uint16_t flags = (static_cast<unsigned char>(data[offset + 60]) << 8) |
+                     static_cast<unsigned char>(data[offset + 61]);
+    if (version >= 3 && (flags & 0x4000))
+      path_offset += 2;
+    if (version == 4) {
+      // The path is prefix-compressed: a varint, then a NUL-terminated
+      // suffix, with no padding.
+      size_t position = offset + path_offset;
+      while (position < end && (data[position] & 0x80))
+        position++;
+      if (position >= end)
+        return true;
+      const void* nul = memchr(data + position + 1, '\0', end - position - 1);
+      if (!nul)
+        return true;
+      offset = static_cast<const char*>(nul) - data + 1;
+    } else {
+      size_t position = offset + path_offset;
+      if (position >= end)
+        return true;
+      const void* nul = memchr(data + position, '\0', end - position);
+      if (!nul)
+        return true;
+      size_t path_length = static_cast<const char*>(nul) - data - position;
+      offset += (path_offset + path_length + 8) & ~static_cast<size_t>(7);
+      if (offset > end)
+        return true;
+    }
+  }
+
+  while (offset < end) {
+    if (end - offset < 8)
+      return true;
+    const char* signature = data + offset;
+    uint32_t size = ReadUint32(data + offset + 4);
+    if (memcmp(signature, "TREE", 4) != 0 &&
+        memcmp(signature, "REUC", 4) != 0 &&
+        memcmp(signature, "NAME", 4) != 0)
+      return true;
+    if (end - offset - 8 < size)
+      return true;
+    offset += 8 + size;
+  }
+  return false;
+}
+
+// Applies |refreshed| to the index as read from disk. Entries that were
+// racy against that index and aren't refreshed have their size zeroed, as
+// git and libgit2 do on write, so the newer index timestamp doesn't make
+// them look clean.
+bool UpdateEntries(git_index* index, int64_t index_mtime,
+                   const std::vector<git_index_entry>& refreshed) {
+  std::vector<git_index_entry> smudged;
+  std::vector<std::string> smudged_paths;
+  size_t count = git_index_entrycount(index);
+  for (size_t i = 0; i < count; i++) {
+    const git_index_entry* entry = git_index_get_byindex(index, i);
+    if (git_index_entry_stage(entry) != 0 || entry->file_size == 0 ||
+        entry->mtime.seconds < index_mtime)
+      continue;
+    smudged.push_back(*entry);
+    smudged.back().file_size = 0;
+    smudged_paths.push_back(entry->path);
+  }
+  for (size_t i = 0; i < smudged.size(); i++) {
+    smudged[i].path = smudged_paths[i].c_str();
+    if (git_index_add(index, &smudged[i]) != GIT_OK)
+      return false;
+  }
+  for (const git_index_entry& entry : refreshed) {
+    if (git_index_add(index, &entry) != GIT_OK)
+      return false;
+  }
+  return true;
+}
+
+// Writes |refreshed| to the index at |path| while holding git's lock on it
+// the whole time, so no other writer can slip in between checking that the
+// index is still the one the entries were computed from and replacing it.
+// The index as read under the lock is copied to a staging file, updated
+// there through libgit2 and renamed into place.
+bool WriteIndex(const std::string& path, const git_oid& checksum,
+                int64_t index_mtime,
+                const std::vector<git_index_entry>& refreshed) {
+  std::string lock_path = path + ".lock";
+  if (!CreateLockFile(lock_path))
+    return false;
+
+  std::string contents;
+  std::string staging_path = path + ".git-utils";
+  bool written = false;
+  if (ReadFile(path, &contents) && !HasForeignExtensions(contents) &&
+      memcmp(contents.data() + contents.size() - GIT_OID_RAWSZ, checksum.id,
+             GIT_OID_RAWSZ) == 0 &&
+      WriteFile(staging_path, contents)) {
+    git_index* staging;
+    if (git_index_open(&staging, staging_path.c_str()) == GIT_OK) {
+      written = UpdateEntries(staging, index_mtime, refreshed) &&
+                git_index_write(staging) == GIT_OK;
+      git_index_free(staging);
+    }
+#ifdef _WIN32
+    if (written)
+      remove(path.c_str());
+#endif
+    written = written && rename(staging_path.c_str(), path.c_str()) == 0;
+    if (!written)
+      remove(staging_path.c_str());
+  }
+  remove(lock_path.c_str());
+  return written;
+}
+
+}  // namespace
+
+int IndexRefresh::Run(size_t thread_count) {
+  const char* workdir = git_repository_workdir(repository);
+  if (!workdir)
+    return GIT_OK;
+
+  git_index* index;
+  int error = git_repository_index(&index, repository);
+  if (error != GIT_OK)
+    return error;
+  error = git_index_read(index, 0);
+  if (error != GIT_OK) {
+    git_index_free(index);
+    return error;
+  }
+  git_oid checksum;
+  git_oid_cpy(&checksum, git_index_checksum(index));
+
+  int64_t index_mtime = 0;
+  struct stat st;
+  if (git_index_path(index) && stat(git_index_path(index), &st) == 0)
+    index_mtime = st.st_mtime;
+
+  std::vector<Candidate> candidates;
+  std::string path = workdir;
+  const size_t workdir_length = path.size();
+  size_t count = git_index_entrycount(index);
+  for (size_t i = 0; i < count; i++) {
+    const git_index_entry* entry = git_index_get_byindex(index, i);
+    if (git_index_entry_stage(entry) != 0 || !IsFile(entry->mode) ||
+        (entry->flags_extended & (GIT_INDEX_ENTRY_INTENT_TO_ADD |
+                                  GIT_INDEX_ENTRY_SKIP_WORKTREE)))
+      continue;
+
+    Candidate candidate;
+    candidate.refreshed = *entry;
+    path.resize(workdir_length);
+    path.append(entry->path);
+    if (!StatFile(path, &candidate.stat, &candidate.refreshed) ||
+        !NeedsHash(*entry, candidate.refreshed, index_mtime))
+      continue;
+    candidate.path = entry->path;
+    candidate.cached = cache->Lookup(candidate.path, candidate.stat,
+                                     &candidate.oid);
+    candidate.hashed = candidate.cached;
+    candidates.push_back(std::move(candidate));
+  }
+
+  // Files with filters such as CRLF conversion are hashed through libgit2
+  // on this thread. The rest are read and hashed as is by every thread.
+  // A file modified no earlier than reading started may be written again
+  // with the same size and timestamp, so its hash is only used for this
+  // scan and neither cached nor recorded in the index.
+  const int64_t read_time = time(nullptr);
+  std::vector<size_t> unfiltered;
+  const CancellationToken& token = CancellationToken::Current();
+  for (size_t i = 0; i < candidates.size(); i++) {
+    Candidate& candidate = candidates[i];
+    if (candidate.hashed)
+      continue;
+    if (token.IsCancelled()) {
+      git_index_free(index);
+      return GIT_EUSER;
+    }
+
+    git_filter_list* filters = nullptr;
+    if (git_filter_list_load(&filters, repository, nullptr,
+                             candidate.path.c_str(), GIT_FILTER_TO_ODB,
+                             GIT_FILTER_DEFAULT) != GIT_OK)
+      continue;
+    if (!filters) {
+      unfiltered.push_back(i);
+      continue;
+    }
+    git_filter_list_free(filters);
+    candidate.hashed = git_repository_hashfile(
+      &candidate.oid, repository, candidate.path.c_str(), GIT_OBJ_BLOB,
+      nullptr) == GIT_OK;
+    if (candidate.hashed) {
+      OperationTimer::AddBytes(candidate.stat.size);
+      files_hashed++;
+    }
+  }
+
+  std::atomic<size_t> next_file(0);
+  std::atomic<size_t> hashed_count(0);
+  auto hash_files = [&]() {
+    std::string file_path = workdir;
+    std::string contents;
+    for (;;) {
+      size_t index = next_file++;
+      if (index >= unfiltered.size() || token.IsCancelled())
+        return;
+      Candidate& candidate = candidates[unfiltered[index]];
+      file_path.resize(workdir_length);
+      file_path.append(candidate.path);
+      if (!ReadFile(file_path, &contents))
+        continue;
+      candidate.hashed = git_odb_hash(&candidate.oid, contents.data(),
+                                      contents.size(), GIT_OBJ_BLOB) == GIT_OK;
+      if (candidate.hashed)
+        hashed_count++;
+    }
+  };
+  thread_count = std::max<size_t>(1, std::min(thread_count, unfiltered.size()));
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < thread_count; i++)
+    threads.emplace_back(hash_files);
+  hash_files();
+  for (std::thread& thread : threads)
+    thread.join();
+  files_hashed += hashed_count;
+  if (token.IsCancelled()) {
+    git_index_free(index);
+    return GIT_EUSER;
+  }
+
+  for (size_t i : unfiltered) {
+    if (candidates[i].hashed)
+      OperationTimer::AddBytes(candidates[i].stat.size);
+  }
+
+  std::vector<git_index_entry> refreshed;
+  for (Candidate& candidate : candidates) {
+    if (candidate.hashed && !candidate.cached)
+      cache->Store(candidate.path, candidate.stat, candidate.oid, read_time);
+    if (!candidate.hashed || candidate.stat.mtime_seconds >= read_time ||
+        !git_oid_equal(&candidate.oid, &candidate.refreshed.id))
+      continue;
+    candidate.refreshed.path = candidate.path.c_str();
+    refreshed.push_back(candidate.refreshed);
+  }
+
+  // The repository's own index object is left as read. It reloads the
+  // rewritten file the next time it is read.
+  if (!refreshed.empty() && git_index_path(index) &&
+      WriteIndex(git_index_path(index), checksum, index_mtime, refreshed))
+    entries_updated = refreshed.size();
+  git_index_free(index);
+  return GIT_OK;
+}
@@ -0,0 +1,59 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_INDEX_REFRESH_H_
+#define SRC_INDEX_REFRESH_H_
+
+#include <stddef.h>
+
+#include "git2.h"
+#include "hash-cache.h"
+
+// Brings the stat data of index entries up to date, like
+// `git update-index --refresh`. Files whose stat data doesn't match their
+// entry, or is too recent to be trusted, are otherwise hashed one at a time
+// by every status scan, which after a checkout means the whole working
+// directory. Here they are hashed once, spread over several threads, and
+// entries whose contents are unchanged get the current stat data of their
+// file so the next scan can skip them.
+class IndexRefresh {
+ public:
+  IndexRefresh(git_repository* repository, HashCache* cache)
+    : repository(repository), cache(cache), files_hashed(0),
+      entries_updated(0) {}
+
+  // Returns GIT_EUSER when the current async work is cancelled. Not writing
+  // the index, because another process holds its lock or changed it, or
+  // because it has extensions libgit2 would drop, is not an error: the next
+  // refresh tries again.
+  int Run(size_t thread_count);
+
+  size_t FilesHashed() const { return files_hashed; }
+  size_t EntriesUpdated() const { return entries_updated; }
+
+ private:
+  git_repository* repository;
+  HashCache* cache;
+  size_t files_hashed;
+  size_t entries_updated;
+};
+
+#endif  // SRC_INDEX_REFRESH_H_
@@ -0,0 +1,254 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "instrumentation.h"
+
+#include <stdio.h>
+#include <uv.h>
+
+#include <unordered_map>
+#include <vector>
+
+thread_local OperationTimer* OperationTimer::active = NULL;
+
+uint64_t PerformanceStats::Now() {
+  return uv_hrtime();
+}
+
+void PerformanceStats::Record(const char* operation, uint64_t elapsed,
+                              uint64_t queue_wait, uint64_t bytes,
+                              uint64_t allocations) {
+  std::lock_guard<std::mutex> lock(mutex);
+  OperationStats& stats = operations[operation];
+  stats.calls++;
+  stats.total_time += elapsed;
+  if (elapsed > stats.max_time)
+    stats.max_time = elapsed;
+  stats.queue_wait_time += queue_wait;
+  stats.bytes += bytes;
+  stats.allocations += allocations;
+}
+
+void PerformanceStats::Reset() {
+  std::lock_guard<std::mutex> lock(mutex);
+  operations.clear();
+}
+
+std::map<std::string, OperationStats> PerformanceStats::Snapshot() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return operations;
+}
+
+namespace {
+
+const size_t kTraceBufferSize = 1 << 16;
+
+struct TraceEvent {
+  // Zero while the slot is empty or being written, otherwise the event's
+  // position in the stream plus one.
+  std::atomic<uint64_t> sequence;
+  std::atomic<uint64_t> timestamp;
+  std::atomic<const char*> operation;
+  std::atomic<uint32_t> name_id;
+  std::atomic<uint32_t> path_count;
+  std::atomic<uint32_t> thread_id;
+  std::atomic<char> phase;
+};
+
+TraceEvent* trace_events = NULL;
+std::atomic<uint64_t> next_trace_event(0);
+std::atomic<uint32_t> next_thread_id(1);
+
+// Names are repository paths, so there is one per repository ever opened,
+// however many times it is opened.
+std::mutex trace_names_mutex;
+std::vector<std::string> trace_names;
+std::unordered_map<std::string, uint32_t> trace_name_ids;
+
+uint32_t CurrentThreadId() {
+  static thread_local uint32_t thread_id = next_thread_id++;
+  return thread_id;
+}
+
+void AppendJSONString(std::string* out, const std::string& value) {
+  out->push_back('"');
+  for (size_t i = 0; i < value.size(); i++) {
+    unsigned char c = value[i];
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(c);
+    } else if (c < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out->append(escaped);
+    } else {
+      out->push_back(c);
+    }
+  }
+  out->push_back('"');
+}
+
+}  // namespace
+
+std::atomic<bool> Tracing::enabled(false);
+
+void Tracing::Start() {
+  static std::once_flag allocated;
+  std::call_once(allocated, [] {
+    trace_events = new TraceEvent[kTraceBufferSize]();
+  });
+  enabled.store(true);
+}
+
+void Tracing::Stop() {
+  enabled.store(false);
+}
+
+uint32_t Tracing::RegisterName(const std::string& name) {
+  std::lock_guard<std::mutex> lock(trace_names_mutex);
+  auto inserted = trace_name_ids.emplace(name, trace_names.size());
+  if (inserted.second)
+    trace_names.push_back(name);
+  return inserted.first->second;
+}
+
+void Tracing::Emit(char phase, const char* operation, uint32_t name_id,
+                   uint32_t path_count) {
+  uint64_t index = next_trace_event.fetch_add(1, std::memory_order_relaxed);
+  TraceEvent& event = trace_events[index % kTraceBufferSize];
+  event.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  event.timestamp.store(PerformanceStats::Now(), std::memory_order_relaxed);
+  event.operation.store(operation, std::memory_order_relaxed);
+  event.name_id.store(name_id, std::memory_order_relaxed);
+  event.path_count.store(path_count, std::memory_order_relaxed);
+  event.thread_id.store(CurrentThreadId(), std::memory_order_relaxed);
+  event.phase.store(phase, std::memory_order_relaxed);
+  event.sequence.store(index + 1, std::memory_order_release);
+}
+
+std::string Tracing::Dump() {
+  std::vector<std::string> names;
+  {
+    std::lock_guard<std::mutex> lock(trace_names_mutex);
+    names = trace_names;
+  }
+
+  std::string json("{\"traceEvents\":[");
+  if (trace_events != NULL) {
+    uint64_t end = next_trace_event.load(std::memory_order_acquire);
+    uint64_t begin = end > kTraceBufferSize ? end - kTraceBufferSize : 0;
+    uv_pid_t pid = uv_os_getpid();
+    bool first = true;
+    for (uint64_t index = begin; index < end; index++) {
+      TraceEvent& event = trace_events[index % kTraceBufferSize];
+      if (event.sequence.load(std::memory_order_acquire) != index + 1)
+        continue;
+      uint64_t timestamp = event.timestamp.load(std::memory_order_relaxed);
+      const char* operation = event.operation.load(std::memory_order_relaxed);
+      uint32_t name_id = event.name_id.load(std::memory_order_relaxed);
+      uint32_t path_count = event.path_count.load(std::memory_order_relaxed);
+      uint32_t thread_id = event.thread_id.load(std::memory_order_relaxed);
+      char phase = event.phase.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      // Skip the slot if a writer lapped us while it was being copied.
+      if (event.sequence.load(std::memory_order_relaxed) != index + 1)
+        continue;
+
+      char fields[128];
+      snprintf(fields, sizeof(fields),
+               "\"cat\":\"git\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u",
+               phase, timestamp / 1e3, static_cast<int>(pid), thread_id);
+      if (!first)
+        json.push_back(',');
+      first = false;
+      json.append("{\"name\":");
+      AppendJSONString(&json, operation);
+      json.push_back(',');
+      json.append(fields);
+      if (phase == 'B') {
+        json.append(",\"args\":{\"repository\":");
+        AppendJSONString(&json, name_id < names.size() ? names[name_id] : "");
+        json.push_back('}');
+      } else {
+        char args[64];
+        snprintf(args, sizeof(args), ",\"args\":{\"paths\":%u}", path_count);
+        json.append(args);
+      }
+      json.push_back('}');
+    }
+  }
+  json.append("],\"displayTimeUnit\":\"ms\"}");
+  return json;
+}
+
+OperationTimer::OperationTimer(PerformanceStats* stats, const char* operation,
+                               Mode mode)
+    : stats(mode == kRecord && stats != NULL && stats->IsEnabled() ?
+            stats : NULL),
+      operation(operation),
+      tracing(Tracing::IsEnabled()),
+      trace_id(stats != NULL ? stats->TraceId() : 0),
+      path_count(0),
+      start(0),
+      extra_time(0),
+      queue_wait(0),
+      bytes(0),
+      allocations(0),
+      previous(NULL) {
+  if (this->stats == NULL && !tracing)
+    return;
+
+  previous = active;
+  active = this;
+  if (tracing)
+    Tracing::Emit('B', operation, trace_id, 0);
+  if (this->stats != NULL)
+    start = PerformanceStats::Now();
+}
+
+OperationTimer::~OperationTimer() {
+  if (stats == NULL && !tracing)
+    return;
+
+  active = previous;
+  if (stats != NULL) {
+    uint64_t elapsed = PerformanceStats::Now() - start + extra_time;
+    stats->Record(operation, elapsed, queue_wait, bytes, allocations);
+  }
+  if (tracing)
+    Tracing::Emit('E', operation, trace_id, path_count);
+}
+
+void OperationTimer::AddBytes(size_t count) {
+  if (active != NULL)
+    active->bytes += count;
+}
+
+void OperationTimer::AddAllocations(size_t count) {
+  if (active != NULL)
+    active->allocations += count;
+}
+
+void OperationTimer::SetPathCount(size_t count) {
+  if (active != NULL)
+    active->path_count = count;
+}
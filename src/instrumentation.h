@@ -0,0 +1,125 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_INSTRUMENTATION_H_
+#define SRC_INSTRUMENTATION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+
+struct OperationStats {
+  uint64_t calls;
+  uint64_t total_time;
+  uint64_t max_time;
+  uint64_t queue_wait_time;
+  uint64_t bytes;
+  uint64_t allocations;
+};
+
+// Per-repository call counters and timings. All times are in nanoseconds.
+// Recording is a no-op until the stats are enabled.
+class PerformanceStats {
+ public:
+  PerformanceStats() : enabled(false), trace_id(0) {}
+
+  bool IsEnabled() const { return enabled.load(std::memory_order_relaxed); }
+  void SetEnabled(bool value) { enabled.store(value); }
+
+  // The repository name events are tagged with in traces.
+  uint32_t TraceId() const { return trace_id; }
+  void SetTraceId(uint32_t id) { trace_id = id; }
+
+  void Record(const char* operation, uint64_t elapsed, uint64_t queue_wait,
+              uint64_t bytes, uint64_t allocations);
+  void Reset();
+  std::map<std::string, OperationStats> Snapshot();
+
+  static uint64_t Now();
+
+ private:
+  std::atomic<bool> enabled;
+  uint32_t trace_id;
+  std::mutex mutex;
+  std::map<std::string, OperationStats> operations;
+};
+
+// Process-wide recorder of begin/end spans in Chrome's trace-event format.
+// Events are written into a fixed-size ring buffer without taking locks, so
+// the oldest events are overwritten once the buffer is full.
+class Tracing {
+ public:
+  static bool IsEnabled() { return enabled.load(std::memory_order_acquire); }
+  static void Start();
+  static void Stop();
+
+  static uint32_t RegisterName(const std::string& name);
+  static void Emit(char phase, const char* operation, uint32_t name_id,
+                   uint32_t path_count);
+
+  // Serializes the buffered events as a chrome://tracing JSON document.
+  static std::string Dump();
+
+ private:
+  static std::atomic<bool> enabled;
+};
+
+// Times the enclosing scope, records it against |stats| when it ends and
+// emits a trace span around it. Bytes copied across the V8 boundary, heap
+// allocations made by native result containers and the number of paths
+// handled while the timer is active on the current thread are attributed to
+// it through AddBytes(), AddAllocations() and SetPathCount().
+class OperationTimer {
+ public:
+  enum Mode { kRecord, kTraceOnly };
+
+  OperationTimer(PerformanceStats* stats, const char* operation,
+                 Mode mode = kRecord);
+  ~OperationTimer();
+
+  void AddElapsed(uint64_t elapsed) { extra_time += elapsed; }
+  void SetQueueWait(uint64_t wait) { queue_wait = wait; }
+
+  static void AddBytes(size_t count);
+  static void AddAllocations(size_t count);
+  static void SetPathCount(size_t count);
+
+ private:
+  PerformanceStats* stats;
+  const char* operation;
+  bool tracing;
+  uint32_t trace_id;
+  uint32_t path_count;
+  uint64_t start;
+  uint64_t extra_time;
+  uint64_t queue_wait;
+  uint64_t bytes;
+  uint64_t allocations;
+  OperationTimer* previous;
+
+  static thread_local OperationTimer* active;
+};
+
+#endif  // SRC_INSTRUMENTATION_H_
@@ -0,0 +1,187 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "path-history.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "cancellation.h"
+
+namespace {
+
+std::string Key(const git_oid* oid) {
+  return std::string(reinterpret_cast<const char*>(oid->id), GIT_OID_RAWSZ);
+}
+
+bool IsNewer(git_commit* a, git_commit* b) {
+  return git_commit_time(a) < git_commit_time(b);
+}
+
+}  // namespace
+
+PathHistory::PathHistory(git_repository* repository, const std::string& path,
+                         std::shared_ptr<const CommitGraph> graph)
+  : repository(repository), path(path), graph(graph), commits_walked(0),
+    filter_skips(0) {
+  if (graph && graph->HasBloomFilters())
+    keys.reset(new BloomKeys(path, graph->BloomHashCount(),
+                             graph->BloomHashVersion()));
+}
+
+PathHistory::~PathHistory() {
+  for (git_commit* commit : queue)
+    git_commit_free(commit);
+}
+
+int PathHistory::Push(const git_oid* oid) {
+  if (!seen.insert(Key(oid)).second)
+    return GIT_OK;
+
+  git_commit* commit;
+  int error = git_commit_lookup(&commit, repository, oid);
+  if (error != GIT_OK)
+    return error;
+  queue.push_back(commit);
+  std::push_heap(queue.begin(), queue.end(), IsNewer);
+  return GIT_OK;
+}
+
+int PathHistory::LookupEntry(const git_commit* commit, Entry* entry) {
+  std::string key = Key(git_commit_id(commit));
+  auto cached = entries.find(key);
+  if (cached != entries.end()) {
+    *entry = cached->second;
+    return GIT_OK;
+  }
+
+  git_tree* tree;
+  int error = git_commit_tree(&tree, commit);
+  if (error != GIT_OK)
+    return error;
+
+  git_tree_entry* tree_entry;
+  error = git_tree_entry_bypath(&tree_entry, tree, path.c_str());
+  if (error == GIT_OK) {
+    git_oid_cpy(&entry->oid, git_tree_entry_id(tree_entry));
+    entry->mode = git_tree_entry_filemode(tree_entry);
+    git_tree_entry_free(tree_entry);
+  } else if (error == GIT_ENOTFOUND) {
+    memset(&entry->oid, 0, sizeof(entry->oid));
+    entry->mode = 0;
+    error = GIT_OK;
+  }
+  git_tree_free(tree);
+
+  if (error == GIT_OK)
+    entries[key] = *entry;
+  return error;
+}
+
+// Sets |parent| to the index of the first parent |commit| is TREESAME to for
+// the path, or to -1 when the path differs from all of them. A root commit
+// is TREESAME when it does not have the path.
+int PathHistory::FindSameParent(git_commit* commit, int* parent) {
+  if (keys && !graph->MaybeChanged(*git_commit_id(commit), *keys)) {
+    filter_skips++;
+    *parent = 0;
+    return GIT_OK;
+  }
+
+  Entry entry;
+  int error = LookupEntry(commit, &entry);
+  if (error != GIT_OK)
+    return error;
+
+  unsigned int count = git_commit_parentcount(commit);
+  if (count == 0) {
+    *parent = entry.mode == 0 ? 0 : -1;
+    return GIT_OK;
+  }
+
+  for (unsigned int i = 0; i < count; i++) {
+    git_commit* parent_commit;
+    error = git_commit_parent(&parent_commit, commit, i);
+    if (error != GIT_OK)
+      return error;
+
+    Entry parent_entry;
+    error = LookupEntry(parent_commit, &parent_entry);
+    git_commit_free(parent_commit);
+    if (error != GIT_OK)
+      return error;
+
+    if (parent_entry.mode == entry.mode &&
+        git_oid_equal(&parent_entry.oid, &entry.oid)) {
+      *parent = i;
+      return GIT_OK;
+    }
+  }
+  *parent = -1;
+  return GIT_OK;
+}
+
+int PathHistory::Walk(const git_oid& start, size_t limit, const Sink& sink) {
+  int error = Push(&start);
+  size_t listed = 0;
+  while (error == GIT_OK && !queue.empty()) {
+    if (CancellationToken::Current().IsCancelled()) {
+      error = GIT_EUSER;
+      break;
+    }
+
+    std::pop_heap(queue.begin(), queue.end(), IsNewer);
+    git_commit* commit = queue.back();
+    queue.pop_back();
+    commits_walked++;
+
+    int parent;
+    unsigned int parent_count = git_commit_parentcount(commit);
+    error = FindSameParent(commit, &parent);
+    if (error == GIT_OK && parent >= 0) {
+      if (static_cast<unsigned int>(parent) < parent_count)
+        error = Push(git_commit_parent_id(commit, parent));
+    } else if (error == GIT_OK) {
+      for (unsigned int i = 0; error == GIT_OK && i < parent_count; i++)
+        error = Push(git_commit_parent_id(commit, i));
+
+      PathHistoryCommit listing;
+      char sha[GIT_OID_HEXSZ + 1];
+      listing.oid = git_oid_tostr(sha, sizeof(sha), git_commit_id(commit));
+      const git_signature* author = git_commit_author(commit);
+      listing.author = author->name;
+      listing.time = author->when.time;
+      const char* summary = git_commit_summary(commit);
+      listing.summary = summary ? summary : "";
+      sink(&listing);
+      listed++;
+    }
+
+    // Children are almost always newer than their parents, so the commit's
+    // entry is rarely needed again once it has been walked.
+    entries.erase(Key(git_commit_id(commit)));
+    git_commit_free(commit);
+    if (limit > 0 && listed >= limit)
+      break;
+  }
+  return error;
+}
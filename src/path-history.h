@@ -0,0 +1,87 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_PATH_HISTORY_H_
+#define SRC_PATH_HISTORY_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "commit-graph.h"
+#include "git2.h"
+
+struct PathHistoryCommit {
+  std::string oid;
+  std::string author;
+  int64_t time;  // The author time, in seconds since the epoch.
+  std::string summary;
+};
+
+// Lists the commits that changed a path, newest first, the way
+// `git log -- <path>` does: a commit is listed when the path differs from
+// each of its parents, and only the first parent the path is the same in is
+// followed past a merge. Comparing a commit with its first parent checks the
+// commit-graph's changed-path Bloom filter before reading any trees.
+class PathHistory {
+ public:
+  typedef std::function<void(PathHistoryCommit*)> Sink;
+
+  PathHistory(git_repository* repository, const std::string& path,
+              std::shared_ptr<const CommitGraph> graph);
+  ~PathHistory();
+
+  // Walks back from |start| until |limit| commits have been listed, or the
+  // whole history has been walked when |limit| is 0. Returns GIT_EUSER when
+  // the current async work is cancelled.
+  int Walk(const git_oid& start, size_t limit, const Sink& sink);
+
+  bool UsesChangedPathFilters() const { return keys != nullptr; }
+  size_t CommitsWalked() const { return commits_walked; }
+  size_t FilterSkips() const { return filter_skips; }
+
+ private:
+  struct Entry {
+    git_oid oid;
+    uint32_t mode;  // 0 when the path does not exist.
+  };
+
+  int Push(const git_oid* oid);
+  int LookupEntry(const git_commit* commit, Entry* entry);
+  int FindSameParent(git_commit* commit, int* parent);
+
+  git_repository* repository;
+  std::string path;
+  std::shared_ptr<const CommitGraph> graph;
+  std::unique_ptr<BloomKeys> keys;
+  std::vector<git_commit*> queue;  // A heap, newest commit first.
+  std::unordered_set<std::string> seen;
+  std::unordered_map<std::string, Entry> entries;
+  size_t commits_walked;
+  size_t filter_skips;
+};
+
+#endif  // SRC_PATH_HISTORY_H_
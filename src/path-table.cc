@@ -0,0 +1,152 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "path-table.h"
+
+#include <string.h>
+
+namespace {
+
+const size_t kNoNode = static_cast<size_t>(-1);
+
+// Children are keyed by their folded name whether or not a lookup ignores
+// case. Lookups fold into a reused buffer, so they don't allocate.
+const std::string& FoldCase(const char* data, size_t length) {
+  static thread_local std::string folded;
+  folded.assign(data, length);
+  for (size_t i = 0; i < length; i++) {
+    if (folded[i] >= 'A' && folded[i] <= 'Z')
+      folded[i] += 'a' - 'A';
+  }
+  return folded;
+}
+
+}  // namespace
+
+PathTable::PathTable() {
+  Clear();
+}
+
+void PathTable::Clear() {
+  nodes.clear();
+  nodes.push_back(Node());
+  nodes[0].owner = -1;
+  nodes[0].rank = 0;
+  root_prefix.clear();
+  next_rank = 0;
+}
+
+void PathTable::Add(const std::string& prefix, int owner) {
+  size_t length = prefix.size();
+  while (length > 1 && prefix[length - 1] == '/')
+    length--;
+  if (length == 0)
+    return;
+
+  size_t node = 0;
+  size_t start = 0;
+  while (true) {
+    const char* component = prefix.data() + start;
+    const char* slash = static_cast<const char*>(
+        memchr(component, '/', length - start));
+    size_t end = slash ? slash - prefix.data() : length;
+
+    size_t child = FindChild(node, component, end - start, false);
+    if (child == kNoNode) {
+      child = nodes.size();
+      nodes.push_back(Node());
+      nodes[child].name.assign(component, end - start);
+      nodes[child].owner = -1;
+      nodes[child].rank = 0;
+      nodes[node].children[FoldCase(component, end - start)].push_back(child);
+    }
+    node = child;
+
+    if (end == length)
+      break;
+    start = end + 1;
+  }
+
+  if (nodes[node].owner == -1) {
+    nodes[node].owner = owner;
+    nodes[node].rank = next_rank++;
+    if (owner == 0 && root_prefix.empty())
+      root_prefix.assign(prefix, 0, length);
+  }
+}
+
+size_t PathTable::FindChild(size_t node, const char* component, size_t length,
+                            bool case_insensitive) const {
+  const Node& parent = nodes[node];
+  if (parent.children.empty())
+    return kNoNode;
+
+  auto candidates = parent.children.find(FoldCase(component, length));
+  if (candidates == parent.children.end())
+    return kNoNode;
+
+  for (size_t child : candidates->second) {
+    if (case_insensitive)
+      return child;
+    const std::string& name = nodes[child].name;
+    if (name.size() == length && memcmp(name.data(), component, length) == 0)
+      return child;
+  }
+  return kNoNode;
+}
+
+void PathTable::Route(const std::string& path, bool case_insensitive,
+                      Match* root, Match* deepest) const {
+  root->owner = -1;
+  root->length = 0;
+  deepest->owner = -1;
+  deepest->length = 0;
+  unsigned root_rank = 0;
+
+  size_t node = 0;
+  size_t start = 0;
+  size_t length = path.size();
+  while (start <= length) {
+    const char* component = path.data() + start;
+    const char* slash = static_cast<const char*>(
+        memchr(component, '/', length - start));
+    size_t end = slash ? slash - path.data() : length;
+
+    node = FindChild(node, component, end - start, case_insensitive);
+    if (node == kNoNode)
+      break;
+
+    const Node& current = nodes[node];
+    if (current.owner != -1) {
+      deepest->owner = current.owner;
+      deepest->length = end;
+      if (current.owner == 0 && (root->owner == -1 || current.rank < root_rank)) {
+        root->owner = 0;
+        root->length = end;
+        root_rank = current.rank;
+      }
+    }
+
+    if (end == length)
+      break;
+    start = end + 1;
+  }
+}
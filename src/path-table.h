@@ -0,0 +1,71 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_PATH_TABLE_H_
+#define SRC_PATH_TABLE_H_
+
+#include <stddef.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A trie of absolute directory paths keyed by path component, used to map a
+// path to the repository that owns it. Owner 0 is the repository itself and
+// higher owners are its (possibly nested) submodules. Lookups cost one hash
+// probe per component of the queried path, however many entries there are.
+class PathTable {
+ public:
+  struct Match {
+    int owner;
+    size_t length;  // Length of the matched prefix of the queried path.
+  };
+
+  PathTable();
+
+  void Clear();
+  void Add(const std::string& prefix, int owner);
+
+  // Finds the first-added owner 0 prefix of |path| and the deepest prefix of
+  // any owner. Either match has an owner of -1 when there is none.
+  // Case-insensitive matching folds ASCII letters only.
+  void Route(const std::string& path, bool case_insensitive,
+             Match* root, Match* deepest) const;
+
+  const std::string& RootPrefix() const { return root_prefix; }
+
+ private:
+  struct Node {
+    std::string name;
+    int owner;
+    unsigned rank;
+    std::unordered_map<std::string, std::vector<size_t>> children;
+  };
+
+  size_t FindChild(size_t node, const char* component, size_t length,
+                   bool case_insensitive) const;
+
+  std::vector<Node> nodes;
+  std::string root_prefix;
+  unsigned next_rank;
+};
+
+#endif  // SRC_PATH_TABLE_H_
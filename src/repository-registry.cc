@@ -0,0 +1,65 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "repository-registry.h"
+
+std::mutex RepositoryRegistry::mutex;
+std::map<SharedRepository::Key, std::weak_ptr<SharedRepository>>
+  RepositoryRegistry::entries;
+
+SharedRepository::~SharedRepository() {
+  {
+    std::lock_guard<std::mutex> lock(RepositoryRegistry::mutex);
+    auto entry = RepositoryRegistry::entries.find(Key(path, thread));
+    if (entry != RepositoryRegistry::entries.end() && entry->second.expired())
+      RepositoryRegistry::entries.erase(entry);
+  }
+  git_odb_free(odb);
+}
+
+void SharedRepository::Attach(git_repository* repository) const {
+  git_repository_set_odb(repository, odb);
+}
+
+std::shared_ptr<SharedRepository> RepositoryRegistry::Acquire(
+    git_repository* repository) {
+  SharedRepository::Key key(git_repository_path(repository),
+                           std::this_thread::get_id());
+
+  std::lock_guard<std::mutex> lock(mutex);
+  std::shared_ptr<SharedRepository> shared = entries[key].lock();
+  if (shared)
+    return shared;
+
+  git_odb* odb;
+  if (git_repository_odb(&odb, repository) != GIT_OK) {
+    entries.erase(key);
+    return nullptr;
+  }
+  shared.reset(new SharedRepository(key, odb));
+  entries[key] = shared;
+  return shared;
+}
+
+size_t RepositoryRegistry::Size() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return entries.size();
+}
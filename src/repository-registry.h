@@ -0,0 +1,91 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_REPOSITORY_REGISTRY_H_
+#define SRC_REPOSITORY_REGISTRY_H_
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "git2.h"
+
+// Native state shared by every Repository opened at the same .git path on
+// the same JS thread. The object database holds the open pack files, their
+// index maps and the loose object backend, so sharing it keeps a single copy
+// of those per repository however many JS wrappers use it.
+//
+// Only the synchronous handles, which are driven by the thread that opened
+// them, read through it. libgit2's object database is not safe to use from
+// several threads at once: a lookup that misses rescans the pack directory
+// and rebuilds the pack list without a lock. So every async handle, and
+// every other thread's JS environment, keeps an object database of its own.
+//
+// Index objects are not shared either: every handle reloads its own from
+// disk anyway.
+class SharedRepository {
+ public:
+  ~SharedRepository();
+
+  const std::string& Path() const { return path; }
+  git_odb* Odb() const { return odb; }
+
+  // Makes |repository| read objects through the shared object database.
+  void Attach(git_repository* repository) const;
+
+ private:
+  friend class RepositoryRegistry;
+
+  typedef std::pair<std::string, std::thread::id> Key;
+
+  SharedRepository(const Key& key, git_odb* odb)
+    : path(key.first), thread(key.second), odb(odb) {}
+
+  std::string path;
+  std::thread::id thread;
+  git_odb* odb;
+};
+
+// Process-wide table of SharedRepository objects keyed by the resolved
+// git_repository_path() and the calling thread. Entries live as long as some
+// Repository holds a reference to them.
+class RepositoryRegistry {
+ public:
+  // Returns the calling thread's shared state for |repository|'s path,
+  // creating it from |repository|'s own object database the first time.
+  // Returns null if the object database can't be opened.
+  static std::shared_ptr<SharedRepository> Acquire(git_repository* repository);
+
+  // The number of paths and threads with live shared state.
+  static size_t Size();
+
+ private:
+  friend class SharedRepository;
+
+  static std::mutex mutex;
+  static std::map<SharedRepository::Key, std::weak_ptr<SharedRepository>>
+    entries;
+};
+
+#endif  // SRC_REPOSITORY_REGISTRY_H_
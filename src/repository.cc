@@ -20,13 +20,53 @@
 // WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "repository.h"
+#include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <algorithm>
+#include <iterator>
 #include <map>
+#include <mutex>
+#include <thread>
 #include <utility>
 
+#include "buffer-diff.h"
+#include "git2/sys/repository.h"
+#include "index-refresh.h"
+#include "path-history.h"
+#include "status-cache-file.h"
+#include "status-renames.h"
+#include "thread-pool.h"
+#include "tree-diff.h"
+
+// The repositories open in this thread's JS environment, for trimming them
+// as a group.
+static thread_local std::vector<Repository*> live_repositories;
+
+#if NODE_MAJOR_VERSION >= 10
+// The environment's repositories are closed first so their handles, object
+// databases and pack mappings don't outlive its reference to libgit2. If a
+// worker thread may still be using an async handle, the reference is kept
+// for the rest of the process instead.
+static void ShutdownLibgit2(void* arg) {
+  if (Repository::CloseAll())
+    git_libgit2_shutdown();
+}
+#endif
+
+// Runs once per JS environment that loads the module: the main thread and
+// every worker thread. Nothing here is cached across environments, and
+// libgit2's init and shutdown are refcounted, so each environment holds its
+// own reference until it is torn down.
 void Repository::Init(Local<Object> target) {
   Nan::HandleScope scope;
   git_libgit2_init();
+#if NODE_MAJOR_VERSION >= 10
+  node::AddEnvironmentCleanupHook(Isolate::GetCurrent(), ShutdownLibgit2,
+                                  nullptr);
+#endif
 
   Local<FunctionTemplate> newTemplate = Nan::New<FunctionTemplate>(
       Repository::New);
@@ -49,6 +89,18 @@ void Repository::Init(Local<Object> target) {
   Nan::SetMethod(proto, "getStatus", Repository::GetStatus);
   Nan::SetMethod(proto, "getStatusForPath", Repository::GetStatusForPath);
   Nan::SetMethod(proto, "getStatusAsync", Repository::GetStatusAsync);
+  Nan::SetMethod(proto, "scanStatusAsync", Repository::ScanStatusAsync);
+  Nan::SetMethod(proto, "getCachedStatusAsync",
+                  Repository::GetCachedStatusAsync);
+  Nan::SetMethod(proto, "_setStatusCachePersistent",
+                  Repository::SetStatusCachePersistent);
+  Nan::SetMethod(proto, "_setHashCachePersistent",
+                  Repository::SetHashCachePersistent);
+  Nan::SetMethod(proto, "_setStatusCacheEnabled",
+                  Repository::SetStatusCacheEnabled);
+  Nan::SetMethod(proto, "_markPathsChanged", Repository::MarkPathsChanged);
+  Nan::SetMethod(proto, "_invalidateStatusCache",
+                  Repository::InvalidateStatusCache);
   Nan::SetMethod(proto, "checkoutHead", Repository::CheckoutHead);
   Nan::SetMethod(proto, "getReferenceTarget", Repository::GetReferenceTarget);
   Nan::SetMethod(proto, "getDiffStats", Repository::GetDiffStats);
@@ -56,19 +108,57 @@ void Repository::Init(Local<Object> target) {
   Nan::SetMethod(proto, "getHeadBlob", Repository::GetHeadBlob);
   Nan::SetMethod(proto, "compareCommits", Repository::CompareCommits);
   Nan::SetMethod(proto, "compareCommitsAsync", Repository::CompareCommitsAsync);
+  Nan::SetMethod(proto, "getChangedPathsAsync",
+                  Repository::GetChangedPathsAsync);
+  Nan::SetMethod(proto, "grepAsync", Repository::GrepAsync);
+  Nan::SetMethod(proto, "getTrackedPathsAsync",
+                  Repository::GetTrackedPathsAsync);
+  Nan::SetMethod(proto, "getBlameAsync", Repository::GetBlameAsync);
+  Nan::SetMethod(proto, "getCommitsAsync", Repository::GetCommitsAsync);
+  Nan::SetMethod(proto, "getPathHistoryStream",
+                 Repository::GetPathHistoryStream);
   Nan::SetMethod(proto, "_release", Repository::Release);
+  Nan::SetMethod(proto, "_getSharedReferenceCount",
+                  Repository::GetSharedReferenceCount);
   Nan::SetMethod(proto, "getLineDiffs", Repository::GetLineDiffs);
   Nan::SetMethod(proto, "getLineDiffDetails", Repository::GetLineDiffDetails);
   Nan::SetMethod(proto, "getReferences", Repository::GetReferences);
   Nan::SetMethod(proto, "checkoutRef", Repository::CheckoutReference);
   Nan::SetMethod(proto, "add", Repository::Add);
+  Nan::SetMethod(proto, "warmPacks", Repository::WarmPacks);
+  Nan::SetMethod(proto, "_cancelPendingWork", Repository::CancelPendingWork);
+  Nan::SetMethod(proto, "getMemoryUsage", Repository::GetMemoryUsage);
+  Nan::SetMethod(proto, "_trimMemory", Repository::TrimMemory);
+  Nan::SetMethod(proto, "_setAsyncIdle", Repository::SetAsyncIdle);
+  Nan::SetMethod(proto, "getPerformanceStats",
+                  Repository::GetPerformanceStats);
+  Nan::SetMethod(proto, "resetPerformanceStats",
+                  Repository::ResetPerformanceStats);
+  Nan::SetMethod(proto, "setPerformanceStatsEnabled",
+                  Repository::SetPerformanceStatsEnabled);
+  Nan::SetMethod(proto, "_setPathTable", Repository::SetPathTable);
+  Nan::SetMethod(proto, "_relativize", Repository::Relativize);
+  Nan::SetMethod(proto, "_isWorkingDirectory",
+                  Repository::IsWorkingDirectory);
+  Nan::SetMethod(proto, "_submoduleIndexForPath",
+                  Repository::SubmoduleIndexForPath);
 
   Nan::Set(target,
             Nan::New<String>("Repository").ToLocalChecked(),
             Nan::GetFunction(newTemplate).ToLocalChecked());
+  Nan::SetMethod(target, "startTracing", Repository::StartTracing);
+  Nan::SetMethod(target, "stopTracing", Repository::StopTracing);
+  Nan::SetMethod(target, "dumpTrace", Repository::DumpTrace);
+  Nan::SetMethod(target, "setCacheOptions", Repository::SetCacheOptions);
+  Nan::SetMethod(target, "getCacheOptions", Repository::GetCacheOptions);
+  Nan::SetMethod(target, "setThreadPoolSize", Repository::SetThreadPoolSize);
+  Nan::SetMethod(target, "getThreadPoolSize", Repository::GetThreadPoolSize);
+  Nan::SetMethod(target, "_trimRepositories", Repository::TrimRepositories);
+  Nan::SetMethod(target, "_getProcessMemoryUsage",
+                 Repository::GetProcessMemoryUsage);
 }
 
-NODE_MODULE(git, Repository::Init)
+NAN_MODULE_WORKER_ENABLED(git, Repository::Init)
 
 NAN_METHOD(Repository::New) {
   Nan::HandleScope scope;
@@ -79,11 +169,24 @@ NAN_METHOD(Repository::New) {
 }
 
 git_repository* Repository::GetRepository(Nan::NAN_METHOD_ARGS_TYPE args) {
-  return Nan::ObjectWrap::Unwrap<Repository>(args.This())->repository;
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(args.This());
+  repo->Touch();
+  return repo->repository;
 }
 
 git_repository* Repository::GetAsyncRepository(Nan::NAN_METHOD_ARGS_TYPE args) {
-  return Nan::ObjectWrap::Unwrap<Repository>(args.This())->async_repository;
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(args.This());
+  repo->Touch();
+  return repo->async_repository;
+}
+
+PerformanceStats* Repository::GetStats(Nan::NAN_METHOD_ARGS_TYPE args) {
+  return &Nan::ObjectWrap::Unwrap<Repository>(args.This())->stats;
+}
+
+CancellationToken Repository::GetCancellationToken(
+    Nan::NAN_METHOD_ARGS_TYPE args) {
+  return Nan::ObjectWrap::Unwrap<Repository>(args.This())->cancellation.Token();
 }
 
 int Repository::GetBlob(Nan::NAN_METHOD_ARGS_TYPE args,
@@ -158,14 +261,158 @@ git_diff_options Repository::CreateDefaultGitDiffOptions() {
   return options;
 }
 
+// The error async work is rejected with after cancelPendingWork().
+static Local<Value> CancelledError() {
+  Local<Value> error = Nan::Error("Operation cancelled");
+  Nan::Set(Local<Object>::Cast(error), Nan::New("code").ToLocalChecked(),
+           Nan::New("ECANCELED").ToLocalChecked());
+  return error;
+}
+
+// Times a worker's Execute() and Finish() against the repository's
+// performance stats under the given operation name, and tracks whether it
+// was cancelled. Work cancelled before it started is skipped; inside
+// Execute() the token is available as CancellationToken::Current().
+class AsyncWorkTimer {
+  PerformanceStats *stats;
+  CancellationToken token;
+  const char *operation;
+  uint64_t queued_at;
+  uint64_t queue_wait;
+  uint64_t execute_time;
+  bool cancelled;
+
+ public:
+  AsyncWorkTimer(PerformanceStats *stats, const CancellationToken& token,
+                 const char *operation)
+    : stats(stats), token(token), operation(operation), queued_at(0),
+      queue_wait(0), execute_time(0), cancelled(false) {
+    if (stats->IsEnabled())
+      queued_at = PerformanceStats::Now();
+  }
+
+  bool IsCancelled() const { return token.IsCancelled(); }
+
+  // Runs on the thread pool.
+  template <typename Execute>
+  void Run(Execute execute) {
+    if (token.IsCancelled()) {
+      cancelled = true;
+      return;
+    }
+
+    OperationTimer span(stats, operation, OperationTimer::kTraceOnly);
+    CancellationToken::Scope scope(&token);
+    if (queued_at == 0) {
+      execute();
+    } else {
+      uint64_t started_at = PerformanceStats::Now();
+      queue_wait = started_at - queued_at;
+      execute();
+      execute_time = PerformanceStats::Now() - started_at;
+    }
+    cancelled = token.IsCancelled();
+  }
+
+  // Runs on the JS thread and passes the result of |finish| to |callback|,
+  // or rejects with CancelledError() without calling it.
+  template <typename Finish>
+  void Complete(Nan::Callback *callback, Finish finish) {
+    if (cancelled) {
+      Local<Value> argv[] = {CancelledError(), Nan::Null()};
+      callback->Call(2, argv);
+      return;
+    }
+
+    std::pair<Local<Value>, Local<Value>> result;
+    {
+      OperationTimer timer(stats, operation, queued_at == 0 ?
+                           OperationTimer::kTraceOnly : OperationTimer::kRecord);
+      timer.SetQueueWait(queue_wait);
+      timer.AddElapsed(execute_time);
+      result = finish();
+    }
+    Local<Value> argv[] = {result.first, result.second};
+    callback->Call(2, argv);
+  }
+};
+
+// Runs a worker's Execute() on the thread pool and passes the result of its
+// Finish() to the JS callback, timed and cancelled by an AsyncWorkTimer.
+template <typename Worker>
+class RepositoryAsyncWorker : public Nan::AsyncWorker {
+  Worker worker;
+  AsyncWorkTimer timer;
+
+ public:
+  void Execute() {
+    timer.Run([this]() { worker.Execute(); });
+  }
+
+  void HandleOKCallback() {
+    timer.Complete(callback, [this]() { return worker.Finish(); });
+  }
+
+  template <typename... Args>
+  RepositoryAsyncWorker(Nan::Callback *callback, PerformanceStats *stats,
+                        const CancellationToken& token, const char *operation,
+                        Args... args)
+    : Nan::AsyncWorker(callback), worker(args...),
+      timer(stats, token, operation) {}
+};
+
+// Like RepositoryAsyncWorker, for workers that report partial results while
+// they run: Execute() gets the progress handle to signal with, and each
+// signal calls the worker's Progress() on the JS thread until the work is
+// cancelled.
+template <typename Worker>
+class RepositoryProgressWorker : public Nan::AsyncProgressWorker {
+  Worker worker;
+  AsyncWorkTimer timer;
+
+ public:
+  void Execute(const ExecutionProgress& progress) {
+    timer.Run([&]() { worker.Execute(progress); });
+  }
+
+  void HandleProgressCallback(const char* data, size_t size) {
+    Nan::HandleScope scope;
+    if (!timer.IsCancelled())
+      worker.Progress();
+  }
+
+  void HandleOKCallback() {
+    Nan::HandleScope scope;
+    timer.Complete(callback, [this]() { return worker.Finish(); });
+  }
+
+  template <typename... Args>
+  RepositoryProgressWorker(Nan::Callback *callback, PerformanceStats *stats,
+                           const CancellationToken& token,
+                           const char *operation, Args&&... args)
+    : Nan::AsyncProgressWorker(callback),
+      worker(std::forward<Args>(args)...), timer(stats, token, operation) {}
+};
+
+// Queues an async worker, keeping the JS repository object (and with it the
+// native handles the worker uses) alive until the worker completes. Workers
+// run on the module's own thread pool when one is configured.
+static void QueueAsyncWorker(Nan::NAN_METHOD_ARGS_TYPE info,
+                             Nan::AsyncWorker *worker) {
+  worker->SaveToPersistent("repository", info.This());
+  AsyncWorkerPool::Queue(worker);
+}
+
 NAN_METHOD(Repository::Exists) {
   Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "exists");
 
   info.GetReturnValue().Set(Nan::New<Boolean>(GetRepository(info) != NULL));
 }
 
 NAN_METHOD(Repository::GetPath) {
   Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "getPath");
   git_repository* repository = GetRepository(info);
   const char* path = git_repository_path(repository);
 
@@ -174,6 +421,7 @@ NAN_METHOD(Repository::GetPath) {
 
 NAN_METHOD(Repository::GetWorkingDirectory) {
   Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "_getWorkingDirectory");
   git_repository* repository = GetRepository(info);
   const char* path = git_repository_workdir(repository);
   info.GetReturnValue().Set(Nan::New<String>(path).ToLocalChecked());
@@ -181,6 +429,7 @@ NAN_METHOD(Repository::GetWorkingDirectory) {
 
 NAN_METHOD(Repository::GetSubmodulePaths) {
   Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "getSubmodulePaths");
   git_repository* repository = GetRepository(info);
   std::vector<std::string> paths;
   git_submodule_foreach(repository, SubmoduleCallback, &paths);
@@ -224,33 +473,22 @@ class HeadWorker {
 };
 
 NAN_METHOD(Repository::GetHead) {
+  OperationTimer timer(GetStats(info), "getHead");
   HeadWorker worker(GetRepository(info));
   worker.Execute();
   info.GetReturnValue().Set(worker.Finish().second);
 }
 
 NAN_METHOD(Repository::GetHeadAsync) {
-  class HeadAsyncWorker : public Nan::AsyncWorker {
-    HeadWorker worker;
-
-   public:
-    void Execute () { worker.Execute(); }
-
-    void HandleOKCallback() {
-      auto result = worker.Finish();
-      Local<Value> argv[] = {result.first, result.second};
-      callback->Call(2, argv);
-    }
-
-    HeadAsyncWorker(Nan::Callback *callback, git_repository *repository) : Nan::AsyncWorker(callback), worker(repository) {}
-  };
-
   auto callback = new Nan::Callback(Local<Function>::Cast(info[0]));
-  Nan::AsyncQueueWorker(new HeadAsyncWorker(callback, GetAsyncRepository(info)));
+  QueueAsyncWorker(info, new RepositoryAsyncWorker<HeadWorker>(
+    callback, GetStats(info), GetCancellationToken(info),
+    "getHeadAsync", GetAsyncRepository(info)));
 }
 
 NAN_METHOD(Repository::RefreshIndex) {
   Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "refreshIndex");
   git_repository* repository = GetRepository(info);
   git_index* index;
   if (git_repository_index(&index, repository) == GIT_OK) {
@@ -262,6 +500,7 @@ NAN_METHOD(Repository::RefreshIndex) {
 
 NAN_METHOD(Repository::IsIgnored) {
   Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "isIgnored");
   if (info.Length() < 1)
     return info.GetReturnValue().Set(Nan::New<Boolean>(false));
 
@@ -278,6 +517,7 @@ NAN_METHOD(Repository::IsIgnored) {
 
 NAN_METHOD(Repository::IsSubmodule) {
   Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "isSubmodule");
   if (info.Length() < 1)
     return info.GetReturnValue().Set(Nan::New<Boolean>(false));
 
@@ -297,6 +537,7 @@ NAN_METHOD(Repository::IsSubmodule) {
 
 NAN_METHOD(Repository::GetConfigValue) {
   Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "getConfigValue");
   if (info.Length() < 1)
     return info.GetReturnValue().Set(Nan::Null());
 
@@ -320,6 +561,7 @@ NAN_METHOD(Repository::GetConfigValue) {
 
 NAN_METHOD(Repository::SetConfigValue) {
   Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "setConfigValue");
   if (info.Length() != 2)
     return info.GetReturnValue().Set(Nan::New<Boolean>(false));
 
@@ -337,91 +579,451 @@ NAN_METHOD(Repository::SetConfigValue) {
   return info.GetReturnValue().Set(Nan::New<Boolean>(errorCode == GIT_OK));
 }
 
-static int StatusCallback(const char* path, unsigned int status, void* payload) {
-  auto statuses = static_cast<std::map<std::string, unsigned int> *>(payload);
-  statuses->insert(std::make_pair(std::string(path), status));
-  return GIT_OK;
+// Reads a boolean option, treating a missing one as false.
+static bool GetBooleanOption(Local<Object> object, const char* name) {
+  Local<Value> value = Nan::Get(object, Nan::New(name).ToLocalChecked())
+    .ToLocalChecked();
+  return Nan::To<bool>(value).FromJust();
+}
+
+// How much of the repository a status scan visits. Parsed on the main thread
+// from the options object given to scanStatusAsync so the worker never
+// touches V8.
+struct StatusScanOptions {
+  enum Mode { kAll, kTrackedOnly, kUntrackedOnly };
+
+  Mode mode = kAll;
+  bool recurse_untracked_dirs = true;
+  bool include_ignored = false;
+  bool exclude_submodules = false;
+  bool skip_head_to_index = false;
+  bool update_index = false;
+  bool detect_renames = false;
+  unsigned rename_threshold = 50;
+  size_t rename_limit = 1000;
+  bool literal_paths = false;
+  size_t max_entries = 0;
+  bool has_paths = false;
+  std::vector<std::string> paths;
+
+  void SetPaths(Local<Value> path_filter) {
+    if (!path_filter->IsArray())
+      return;
+    Local<Array> js_paths = Local<Array>::Cast(path_filter);
+    has_paths = true;
+    paths.reserve(js_paths->Length());
+    for (unsigned i = 0; i < js_paths->Length(); i++) {
+      Nan::Utf8String js_path(Nan::Get(js_paths, i).ToLocalChecked());
+      OperationTimer::AddBytes(js_path.length());
+      paths.emplace_back(*js_path, js_path.length());
+    }
+  }
+
+  static StatusScanOptions FromObject(Local<Value> value) {
+    StatusScanOptions options;
+    if (!value->IsObject())
+      return options;
+
+    Local<Object> object = Local<Object>::Cast(value);
+    options.SetPaths(Nan::Get(object, Nan::New("paths").ToLocalChecked())
+      .ToLocalChecked());
+    options.recurse_untracked_dirs =
+      !GetBooleanOption(object, "collapseUntrackedDirectories");
+    options.include_ignored = GetBooleanOption(object, "includeIgnored");
+    options.exclude_submodules = GetBooleanOption(object, "excludeSubmodules");
+    options.skip_head_to_index = GetBooleanOption(object, "skipHeadToIndex");
+    options.update_index = GetBooleanOption(object, "updateIndex");
+    options.detect_renames = GetBooleanOption(object, "detectRenames");
+    options.literal_paths = GetBooleanOption(object, "literalPaths");
+
+    Nan::Utf8String mode(Nan::Get(object, Nan::New("mode").ToLocalChecked())
+      .ToLocalChecked());
+    if (strcmp(*mode, "tracked") == 0)
+      options.mode = kTrackedOnly;
+    else if (strcmp(*mode, "untracked") == 0)
+      options.mode = kUntrackedOnly;
+
+    Local<Value> max_entries =
+      Nan::Get(object, Nan::New("maxEntries").ToLocalChecked())
+        .ToLocalChecked();
+    if (max_entries->IsNumber() && Nan::To<double>(max_entries).FromJust() > 0)
+      options.max_entries = Nan::To<double>(max_entries).FromJust();
+
+    Local<Value> rename_threshold =
+      Nan::Get(object, Nan::New("renameThreshold").ToLocalChecked())
+        .ToLocalChecked();
+    if (rename_threshold->IsNumber()) {
+      double threshold = Nan::To<double>(rename_threshold).FromJust();
+      options.rename_threshold = std::min(std::max(threshold, 0.0), 100.0);
+    }
+    Local<Value> rename_limit =
+      Nan::Get(object, Nan::New("renameLimit").ToLocalChecked())
+        .ToLocalChecked();
+    if (rename_limit->IsNumber() && Nan::To<double>(rename_limit).FromJust() >= 0)
+      options.rename_limit = Nan::To<double>(rename_limit).FromJust();
+    return options;
+  }
+
+  // Map the settings onto the cheapest libgit2 configuration that still
+  // reports every status they ask for.
+  void Apply(git_status_options* options) const {
+    options->flags = 0;
+    options->show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
+
+    // Tracked-only scans never enumerate untracked files, so libgit2 only
+    // walks the directories that contain index entries.
+    if (mode != kTrackedOnly) {
+      options->flags |= GIT_STATUS_OPT_INCLUDE_UNTRACKED;
+      if (recurse_untracked_dirs)
+        options->flags |= GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS;
+    }
+
+    // Untracked files only show up in the index-to-workdir diff, so the
+    // HEAD tree doesn't need to be loaded at all.
+    if (skip_head_to_index || mode == kUntrackedOnly)
+      options->show = GIT_STATUS_SHOW_WORKDIR_ONLY;
+
+    if (include_ignored)
+      options->flags |= GIT_STATUS_OPT_INCLUDE_IGNORED;
+    if (exclude_submodules)
+      options->flags |= GIT_STATUS_OPT_EXCLUDE_SUBMODULES;
+
+    // Renames are found by StatusRenames after the scan rather than by
+    // libgit2, whose rename detection can't be bounded per scan.
+
+    // Literal paths are matched as exact file or directory prefixes, which
+    // lets libgit2 seek its index and workdir iterators straight to them
+    // instead of matching every entry against a pattern.
+    if (literal_paths)
+      options->flags |= GIT_STATUS_OPT_DISABLE_PATHSPEC_MATCH;
+  }
+};
+
+// Reads the index checksum and HEAD that status snapshots are keyed by. An
+// unborn HEAD reads as the zero oid.
+static bool ReadStatusState(git_repository* repository, git_oid* index_checksum,
+                            git_oid* head) {
+  git_index* index;
+  if (git_repository_index(&index, repository) != GIT_OK)
+    return false;
+  bool read = git_index_read(index, 0) == GIT_OK;
+  if (read)
+    git_oid_cpy(index_checksum, git_index_checksum(index));
+  git_index_free(index);
+
+  if (git_reference_name_to_id(head, repository, "HEAD") != GIT_OK)
+    memset(head, 0, sizeof(*head));
+  return read;
+}
+
+static Local<Object> ConvertStatusListToV8Object(const StatusList& statuses) {
+  Local<Object> result = Nan::New<Object>();
+  for (const StatusList::Entry& entry : statuses) {
+    OperationTimer::AddBytes(entry.length);
+    Nan::Set(
+      result,
+      Nan::New<String>(entry.path, entry.length).ToLocalChecked(),
+      Nan::New<Number>(entry.status)
+    );
+  }
+  OperationTimer::AddAllocations(statuses.Allocations());
+  return result;
 }
 
 class StatusWorker {
   git_repository *repository;
-  std::map<std::string, unsigned int> statuses;
-  char **paths;
-  unsigned path_count;
+  StatusScanOptions scan_options;
+  StatusCache *cache;
+  HashCache *hash_cache;
+  bool report_truncation;
+  StatusList statuses;
+  std::vector<StatusRename> renames;
+  bool truncated;
   int code;
 
+  static int StatusCallback(const char* path, unsigned int status,
+                            void* payload) {
+    auto worker = static_cast<StatusWorker *>(payload);
+    if (CancellationToken::Current().IsCancelled())
+      return GIT_EUSER;
+    if (worker->scan_options.mode == StatusScanOptions::kUntrackedOnly &&
+        !(status & GIT_STATUS_WT_NEW))
+      return GIT_OK;
+
+    if (worker->scan_options.max_entries > 0 &&
+        worker->statuses.size() >= worker->scan_options.max_entries) {
+      worker->truncated = true;
+      return GIT_EUSER;
+    }
+
+    worker->statuses.Add(path, strlen(path), status);
+    return GIT_OK;
+  }
+
+  void Scan() {
+    git_status_options options = GIT_STATUS_OPTIONS_INIT;
+    scan_options.Apply(&options);
+
+    std::vector<char *> pathspec;
+    if (scan_options.has_paths) {
+      for (size_t i = 0; i < scan_options.paths.size(); i++)
+        pathspec.push_back(&scan_options.paths[i][0]);
+      options.pathspec.count = pathspec.size();
+      options.pathspec.strings = pathspec.data();
+    }
+    statuses.Clear();
+    code = git_status_foreach_ext(repository, &options, StatusCallback, this);
+    if (code == GIT_EUSER && truncated)
+      code = GIT_OK;
+    statuses.Sort();
+  }
+
+  // Rescans only the paths reported by the file system monitor since the
+  // last scan and merges them into the cached snapshot, falling back to a
+  // full scan whenever the index or HEAD moved.
+  void ScanWithCache(const git_oid& index_checksum, const git_oid& head) {
+    std::vector<std::string> changed_paths;
+    uint64_t generation;
+    if (cache->Prepare(index_checksum, head, &changed_paths, &generation)) {
+      StatusList result;
+      if (!changed_paths.empty()) {
+        scan_options.paths = changed_paths;
+        scan_options.has_paths = true;
+        scan_options.literal_paths = true;
+        Scan();
+        scan_options.paths.clear();
+        scan_options.has_paths = false;
+        scan_options.literal_paths = false;
+      }
+      if (code == GIT_OK && cache->Update(changed_paths, statuses, &result)) {
+        statuses = std::move(result);
+        return;
+      }
+    }
+
+    // The changed paths were handed over by Prepare(), so a scan that
+    // failed or was cancelled must not leave the snapshot looking current.
+    Scan();
+    if (code == GIT_OK)
+      cache->Store(generation, index_checksum, head, statuses);
+    else
+      cache->Invalidate();
+  }
+
  public:
   void Execute() {
-    git_status_options options = GIT_STATUS_OPTIONS_INIT;
-    options.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED | GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS;
-    if (paths) {
-      options.pathspec.count = path_count;
-      options.pathspec.strings = paths;
+    // The refresh rewrites the index, so it comes before the index checksum
+    // is read.
+    if (scan_options.update_index && hash_cache) {
+      IndexRefresh refresh(repository, hash_cache);
+      hash_cache->Load(repository);
+      code = refresh.Run(std::min(std::thread::hardware_concurrency(), 8u));
+      hash_cache->Save(repository);
+      if (code != GIT_OK)
+        return;
+    }
+
+    const int64_t scan_time = time(nullptr);
+    git_oid index_checksum, head;
+    bool has_state = cache && (cache->IsEnabled() || cache->IsPersistent()) &&
+      ReadStatusState(repository, &index_checksum, &head);
+    if (has_state && cache->IsEnabled())
+      ScanWithCache(index_checksum, head);
+    else
+      Scan();
+    if (code == GIT_OK && scan_options.detect_renames) {
+      StatusRenames detector(repository, scan_options.rename_threshold,
+                             scan_options.rename_limit);
+      code = detector.Detect(&statuses, &renames);
     }
-    code = git_status_foreach_ext(repository, &options, StatusCallback, &statuses);
-    if (paths) {
-      git_strarray_free(&options.pathspec);
+    OperationTimer::SetPathCount(statuses.size());
+
+    const char* workdir = git_repository_workdir(repository);
+    if (has_state && code == GIT_OK && workdir && cache->IsPersistent()) {
+      StatusCacheFile::Write(StatusCacheFile::PathFor(repository), workdir,
+                             index_checksum, head, scan_time, statuses);
     }
   }
 
   std::pair<Local<Value>, Local<Value>> Finish() {
     if (code == GIT_OK) {
-      Local<Object> result = Nan::New<Object>();
-      for (auto iter = statuses.begin(), end = statuses.end(); iter != end; ++iter) {
-        Nan::Set(
-          result,
-          Nan::New<String>(iter->first.c_str()).ToLocalChecked(),
-          Nan::New<Number>(iter->second)
-        );
+      Local<Object> result = ConvertStatusListToV8Object(statuses);
+      if (!report_truncation)
+        return {Nan::Null(), result};
+
+      Local<Object> scan = Nan::New<Object>();
+      Nan::Set(scan, Nan::New("statuses").ToLocalChecked(), result);
+      Nan::Set(scan, Nan::New("truncated").ToLocalChecked(),
+               Nan::New<Boolean>(truncated));
+      if (scan_options.detect_renames) {
+        Local<Object> js_renames = Nan::New<Object>();
+        for (const StatusRename& rename : renames) {
+          Nan::Set(js_renames,
+                   Nan::New<String>(rename.new_path).ToLocalChecked(),
+                   Nan::New<String>(rename.old_path).ToLocalChecked());
+        }
+        Nan::Set(scan, Nan::New("renames").ToLocalChecked(), js_renames);
       }
-      return {Nan::Null(), result};
+      return {Nan::Null(), scan};
     } else {
       return {Nan::Error("Git status failed"), Nan::Null()};
     }
   }
 
-  StatusWorker(git_repository *repository, Local<Value> path_filter) : repository{repository} {
-    if (path_filter->IsArray()) {
-      Local<Array> js_paths = Local<Array>::Cast(path_filter);
-      path_count = js_paths->Length();
-      paths = reinterpret_cast<char **>(malloc(path_count * sizeof(char *)));
-      for (unsigned i = 0; i < path_count; i++) {
-        Nan::Utf8String js_path(Nan::Get(js_paths, i).ToLocalChecked());
-        paths[i] = reinterpret_cast<char *>(malloc(js_path.length() + 1));
-        strcpy(paths[i], *js_path);
-      }
-    } else {
-      paths = NULL;
-      path_count = 0;
-    }
+  StatusWorker(git_repository *repository, Local<Value> path_filter,
+               bool literal_paths = false, StatusCache *cache = nullptr)
+    : repository{repository}, cache{cache}, hash_cache{nullptr},
+      report_truncation{false}, truncated{false}, code{GIT_OK} {
+    scan_options.SetPaths(path_filter);
+    scan_options.literal_paths = literal_paths;
+    if (scan_options.has_paths)
+      this->cache = nullptr;
   }
+
+  StatusWorker(git_repository *repository, const StatusScanOptions& scan_options,
+               HashCache *hash_cache)
+    : repository{repository}, scan_options(scan_options), cache{nullptr},
+      hash_cache{hash_cache}, report_truncation{true}, truncated{false},
+      code{GIT_OK} {}
 };
 
 NAN_METHOD(Repository::GetStatusAsync) {
-  class StatusAsyncWorker : public Nan::AsyncWorker {
-    StatusWorker worker;
+  auto callback = new Nan::Callback(Local<Function>::Cast(info[0]));
+  Local<Value> path_filter = info.Length() > 1 ? info[1] : Local<Value>::Cast(Nan::Null());
+  bool literal_paths = info.Length() > 2 && Nan::To<bool>(info[2]).FromJust();
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
+  QueueAsyncWorker(info, new RepositoryAsyncWorker<StatusWorker>(
+    callback, GetStats(info), GetCancellationToken(info),
+    "getStatusAsync", GetAsyncRepository(info),
+    path_filter, literal_paths, &repo->status_cache));
+}
+
+NAN_METHOD(Repository::ScanStatusAsync) {
+  auto callback = new Nan::Callback(Local<Function>::Cast(info[0]));
+  StatusScanOptions options = StatusScanOptions::FromObject(info[1]);
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
+  QueueAsyncWorker(info, new RepositoryAsyncWorker<StatusWorker>(
+    callback, GetStats(info), GetCancellationToken(info),
+    "scanStatusAsync", GetAsyncRepository(info), options, &repo->hash_cache));
+}
+
+class CachedStatusWorker {
+  git_repository *repository;
+  StatusList statuses;
+  bool found;
 
-   public:
-    void Execute() {
-      worker.Execute();
+ public:
+  void Execute() {
+    const char* workdir = git_repository_workdir(repository);
+    git_oid index_checksum, head;
+    if (!workdir || !ReadStatusState(repository, &index_checksum, &head))
+      return;
+
+    std::vector<std::string> stale_paths;
+    found = StatusCacheFile::Read(StatusCacheFile::PathFor(repository),
+                                  workdir, index_checksum, head, &statuses,
+                                  &stale_paths);
+    if (!found) {
+      statuses.Clear();
+      return;
     }
 
-    void HandleOKCallback() {
-      auto result = worker.Finish();
-      Local<Value> argv[] = {result.first, result.second};
-      callback->Call(2, argv);
+    git_index* index;
+    if (git_repository_index(&index, repository) == GIT_OK) {
+      StatusCacheFile::FindChangedEntries(index, workdir, statuses,
+                                          &stale_paths);
+      git_index_free(index);
     }
 
-    StatusAsyncWorker(Nan::Callback *callback, git_repository *repository, Local<Value> path_filter)
-      : Nan::AsyncWorker(callback), worker(repository, path_filter) {}
-  };
+    // Only the paths whose working directory file changed since the
+    // snapshot was saved need their status computed again.
+    if (!stale_paths.empty()) {
+      std::map<std::string, unsigned int> stale_statuses;
+      for (const std::string& path : stale_paths) {
+        if (CancellationToken::Current().IsCancelled())
+          return;
+        unsigned int status = 0;
+        if (git_status_file(&status, repository, path.c_str()) != GIT_OK)
+          status = 0;
+        stale_statuses[path] = status;
+      }
+
+      StatusList updated;
+      for (const StatusList::Entry& entry : statuses) {
+        auto stale = stale_statuses.find(std::string(entry.path, entry.length));
+        if (stale == stale_statuses.end())
+          updated.Add(entry);
+      }
+      for (const auto& stale : stale_statuses) {
+        if (stale.second != 0)
+          updated.Add(stale.first.data(), stale.first.size(), stale.second);
+      }
+      updated.Sort();
+      statuses = std::move(updated);
+    }
+    OperationTimer::SetPathCount(statuses.size());
+  }
 
+  std::pair<Local<Value>, Local<Value>> Finish() {
+    if (!found)
+      return {Nan::Null(), Nan::Null()};
+    return {Nan::Null(), ConvertStatusListToV8Object(statuses)};
+  }
+
+  explicit CachedStatusWorker(git_repository *repository)
+    : repository{repository}, found{false} {}
+};
+
+NAN_METHOD(Repository::GetCachedStatusAsync) {
   auto callback = new Nan::Callback(Local<Function>::Cast(info[0]));
-  Local<Value> path_filter = info.Length() > 1 ? info[1] : Local<Value>::Cast(Nan::Null());
-  Nan::AsyncQueueWorker(new StatusAsyncWorker(callback, GetAsyncRepository(info), path_filter));
+  QueueAsyncWorker(info, new RepositoryAsyncWorker<CachedStatusWorker>(
+    callback, GetStats(info), GetCancellationToken(info),
+    "getCachedStatusAsync", GetAsyncRepository(info)));
+}
+
+NAN_METHOD(Repository::SetStatusCachePersistent) {
+  OperationTimer timer(GetStats(info), "setStatusCachePersistent");
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
+  repo->status_cache.SetPersistent(Nan::To<bool>(info[0]).FromJust());
+}
+
+NAN_METHOD(Repository::SetHashCachePersistent) {
+  OperationTimer timer(GetStats(info), "setHashCachePersistent");
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
+  repo->hash_cache.SetPersistent(Nan::To<bool>(info[0]).FromJust());
+}
+
+NAN_METHOD(Repository::SetStatusCacheEnabled) {
+  OperationTimer timer(GetStats(info), "setStatusCacheEnabled");
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
+  repo->status_cache.SetEnabled(Nan::To<bool>(info[0]).FromJust());
+}
+
+NAN_METHOD(Repository::MarkPathsChanged) {
+  OperationTimer timer(GetStats(info), "markPathsChanged");
+  if (!info[0]->IsArray())
+    return;
+
+  Local<Array> js_paths = Local<Array>::Cast(info[0]);
+  std::vector<std::string> paths;
+  paths.reserve(js_paths->Length());
+  for (unsigned i = 0; i < js_paths->Length(); i++) {
+    Nan::Utf8String js_path(Nan::Get(js_paths, i).ToLocalChecked());
+    paths.emplace_back(*js_path, js_path.length());
+  }
+  OperationTimer::SetPathCount(paths.size());
+
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
+  repo->status_cache.MarkChanged(paths);
+}
+
+NAN_METHOD(Repository::InvalidateStatusCache) {
+  OperationTimer timer(GetStats(info), "invalidateStatusCache");
+  Nan::ObjectWrap::Unwrap<Repository>(info.This())->status_cache.Invalidate();
 }
 
 NAN_METHOD(Repository::GetStatus) {
+  OperationTimer timer(GetStats(info), "getStatus");
   Local<Value> path_filter = info.Length() > 0 ? info[0] : Local<Value>::Cast(Nan::Null());
   StatusWorker worker(GetRepository(info), path_filter);
   worker.Execute();
@@ -434,6 +1036,7 @@ NAN_METHOD(Repository::GetStatus) {
 }
 
 NAN_METHOD(Repository::GetStatusForPath) {
+  OperationTimer timer(GetStats(info), "getStatusForPath");
   git_repository* repository = GetRepository(info);
   Nan::Utf8String path(info[0]);
   unsigned int status = 0;
@@ -445,6 +1048,7 @@ NAN_METHOD(Repository::GetStatusForPath) {
 
 NAN_METHOD(Repository::CheckoutHead) {
   Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "checkoutHead");
   if (info.Length() < 1)
     return info.GetReturnValue().Set(Nan::New<Boolean>(false));
 
@@ -465,6 +1069,7 @@ NAN_METHOD(Repository::CheckoutHead) {
 
 NAN_METHOD(Repository::GetReferenceTarget) {
   Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "getReferenceTarget");
   if (info.Length() < 1)
     return info.GetReturnValue().Set(Nan::Null());
 
@@ -483,6 +1088,7 @@ NAN_METHOD(Repository::GetReferenceTarget) {
 
 NAN_METHOD(Repository::GetDiffStats) {
   Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "getDiffStats");
 
   int added = 0;
   int deleted = 0;
@@ -575,6 +1181,7 @@ NAN_METHOD(Repository::GetDiffStats) {
 
 NAN_METHOD(Repository::GetHeadBlob) {
   Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "getHeadBlob");
   if (info.Length() < 1)
     return info.GetReturnValue().Set(Nan::Null());
 
@@ -614,6 +1221,7 @@ NAN_METHOD(Repository::GetHeadBlob) {
     return info.GetReturnValue().Set(Nan::Null());
 
   const char* content = static_cast<const char*>(git_blob_rawcontent(blob));
+  OperationTimer::AddBytes(git_blob_rawsize(blob));
   Local<Value> value = Nan::New<String>(content).ToLocalChecked();
   git_blob_free(blob);
   return info.GetReturnValue().Set(value);
@@ -621,6 +1229,7 @@ NAN_METHOD(Repository::GetHeadBlob) {
 
 NAN_METHOD(Repository::GetIndexBlob) {
   Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "getIndexBlob");
   if (info.Length() < 1)
     return info.GetReturnValue().Set(Nan::Null());
 
@@ -647,6 +1256,7 @@ NAN_METHOD(Repository::GetIndexBlob) {
     return info.GetReturnValue().Set(Nan::Null());
 
   const char* content = static_cast<const char*>(git_blob_rawcontent(blob));
+  OperationTimer::AddBytes(git_blob_rawsize(blob));
   Local<Value> value = Nan::New<String>(content).ToLocalChecked();
   git_blob_free(blob);
   return info.GetReturnValue().Set(value);
@@ -664,14 +1274,25 @@ int Repository::SubmoduleCallback(
 
 NAN_METHOD(Repository::Release) {
   Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "_release");
   Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
   if (repo->repository != NULL) {
     git_repository_free(repo->repository);
     repo->repository = NULL;
   }
+  // The async handle, which pending async work may still be using, has an
+  // object database of its own.
+  repo->shared.reset();
   info.GetReturnValue().SetUndefined();
 }
 
+NAN_METHOD(Repository::GetSharedReferenceCount) {
+  Nan::HandleScope scope;
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
+  long count = repo->shared ? repo->shared.use_count() : 0;  // NOLINT
+  info.GetReturnValue().Set(Nan::New<Number>(count));
+}
+
 unsigned GetCommitCount(git_repository *repository, git_oid *left_oid, git_oid *right_oid) {
   git_revwalk *revwalk;
   if (git_revwalk_new(&revwalk, repository) != GIT_OK) return 0;
@@ -681,7 +1302,12 @@ unsigned GetCommitCount(git_repository *repository, git_oid *left_oid, git_oid *
 
   unsigned result = 0;
   git_oid current_commit;
-  while (git_revwalk_next(&current_commit, revwalk) == GIT_OK) result++;
+  const CancellationToken& token = CancellationToken::Current();
+  while (git_revwalk_next(&current_commit, revwalk) == GIT_OK) {
+    result++;
+    if (result % 256 == 0 && token.IsCancelled())
+      break;
+  }
   git_revwalk_free(revwalk);
 
   return result;
@@ -689,6 +1315,7 @@ unsigned GetCommitCount(git_repository *repository, git_oid *left_oid, git_oid *
 
 class CompareCommitsWorker {
   git_repository *repository;
+  CommitCache *cache;
   std::string left_id;
   std::string right_id;
   unsigned ahead_count;
@@ -702,11 +1329,16 @@ class CompareCommitsWorker {
     git_oid right_oid;
     if (git_oid_fromstr(&right_oid, right_id.c_str()) != GIT_OK) return;
 
+    if (cache->LookupCounts(left_oid, right_oid, &ahead_count, &behind_count))
+      return;
+
     git_oid merge_base;
     if (git_merge_base(&merge_base, repository, &left_oid, &right_oid) != GIT_OK) return;
 
     ahead_count = GetCommitCount(repository, &left_oid, &merge_base);
     behind_count = GetCommitCount(repository, &right_oid, &merge_base);
+    if (!CancellationToken::Current().IsCancelled())
+      cache->StoreCounts(left_oid, right_oid, ahead_count, behind_count);
   }
 
   std::pair<Local<Value>, Local<Value>> Finish() {
@@ -716,151 +1348,991 @@ class CompareCommitsWorker {
     return {Nan::Null(), result};
   }
 
-  CompareCommitsWorker(git_repository *repository, Local<Value> js_left_id,
-                       Local<Value> js_right_id) : repository(repository) {
+  CompareCommitsWorker(git_repository *repository, CommitCache *cache,
+                       Local<Value> js_left_id, Local<Value> js_right_id)
+    : repository(repository), cache(cache), ahead_count(0), behind_count(0) {
     left_id = *Nan::Utf8String(js_left_id);
     right_id = *Nan::Utf8String(js_right_id);
   }
 };
 
 NAN_METHOD(Repository::CompareCommits) {
+  OperationTimer timer(GetStats(info), "compareCommits");
   if (info.Length() < 2) {
     info.GetReturnValue().Set(Nan::Null());
     return;
   }
 
-  CompareCommitsWorker worker(GetRepository(info), info[0], info[1]);
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
+  CompareCommitsWorker worker(GetRepository(info), &repo->commit_cache, info[0],
+                              info[1]);
   worker.Execute();
   info.GetReturnValue().Set(worker.Finish().second);
 }
 
 NAN_METHOD(Repository::CompareCommitsAsync) {
-  class CompareCommitsAsyncWorker : public Nan::AsyncWorker {
-    CompareCommitsWorker worker;
-
-   public:
-    void Execute() {
-      worker.Execute();
-    }
-
-    void HandleOKCallback() {
-      auto result = worker.Finish();
-      Local<Value> argv[] = {result.first, result.second};
-      callback->Call(2, argv);
-    }
-
-    CompareCommitsAsyncWorker(Nan::Callback *callback, git_repository *repository,
-                         Local<Value> js_left_id, Local<Value> js_right_id)
-      : Nan::AsyncWorker(callback), worker(repository, js_left_id, js_right_id) {}
-  };
-
   if (info.Length() < 2) {
     info.GetReturnValue().Set(Nan::Null());
     return;
   }
 
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
   auto callback = new Nan::Callback(Local<Function>::Cast(info[0]));
-  Nan::AsyncQueueWorker(new CompareCommitsAsyncWorker(callback, GetAsyncRepository(info), info[1], info[2]));
+  QueueAsyncWorker(info, new RepositoryAsyncWorker<CompareCommitsWorker>(
+    callback, GetStats(info), GetCancellationToken(info),
+    "compareCommitsAsync", GetAsyncRepository(info), &repo->commit_cache,
+    info[1], info[2]));
 }
 
-int Repository::DiffHunkCallback(const git_diff_delta* delta,
-                                 const git_diff_hunk* range,
-                                 void* payload) {
-  std::vector<git_diff_hunk>* ranges =
-      static_cast<std::vector<git_diff_hunk>*>(payload);
-  ranges->push_back(*range);
-  return GIT_OK;
+// Copies |count| values into a typed array backed by a new buffer.
+template <typename ArrayType, typename T>
+static Local<ArrayType> ConvertArrayToTypedArray(const T* values,
+                                                 size_t count) {
+  Local<Object> buffer = Nan::CopyBuffer(
+    reinterpret_cast<const char*>(values), count * sizeof(T)).ToLocalChecked();
+  Local<Uint8Array> bytes = Local<Uint8Array>::Cast(buffer);
+  return ArrayType::New(bytes->Buffer(), bytes->ByteOffset(), count);
 }
 
-NAN_METHOD(Repository::GetLineDiffs) {
-  Nan::HandleScope scope;
-  if (info.Length() < 2)
-    return info.GetReturnValue().Set(Nan::Null());
-
-  std::string text(*Nan::Utf8String(info[1]));
-
-  git_repository* repo = GetRepository(info);
-
-  git_blob* blob = NULL;
+template <typename ArrayType, typename T>
+static Local<ArrayType> ConvertVectorToTypedArray(const std::vector<T>& values) {
+  return ConvertArrayToTypedArray<ArrayType>(values.data(), values.size());
+}
 
-  int getBlobResult = GetBlob(info, repo, blob);
+static int LookupTree(git_repository* repository, const std::string& revision,
+                      git_tree** tree) {
+  git_object* object;
+  int error = git_revparse_single(&object, repository, revision.c_str());
+  if (error != GIT_OK)
+    return error;
+  git_object* peeled;
+  error = git_object_peel(&peeled, object, GIT_OBJ_TREE);
+  git_object_free(object);
+  if (error == GIT_OK)
+    *tree = reinterpret_cast<git_tree*>(peeled);
+  return error;
+}
 
-  if (getBlobResult != 0)
-    return info.GetReturnValue().Set(Nan::Null());
+class ChangedPathsWorker {
+  git_repository *repository;
+  std::string from_revision;
+  std::string to_revision;
+  bool detect_renames;
+  bool line_stats;
+  ChangedPaths changes;
+  std::string error_message;
 
-  std::vector<git_diff_hunk> ranges;
-  git_diff_options options = CreateDefaultGitDiffOptions();
+ public:
+  void Execute() {
+    git_tree* from_tree = NULL;
+    git_tree* to_tree = NULL;
+    if (LookupTree(repository, from_revision, &from_tree) != GIT_OK) {
+      error_message = "Cannot resolve revision " + from_revision;
+      return;
+    }
+    if (LookupTree(repository, to_revision, &to_tree) != GIT_OK) {
+      error_message = "Cannot resolve revision " + to_revision;
+      git_tree_free(from_tree);
+      return;
+    }
 
-  if (info.Length() >= 3) {
-    Local<Object> optionsArg(Local<Object>::Cast(info[2]));
-    // Set GIT_DIFF_IGNORE_WHITESPACE when ignoreWhitespace: true
-    if (Nan::To<bool>(Nan::Get(optionsArg, Nan::New<String>("ignoreAllSpace").ToLocalChecked()).ToLocalChecked()).FromJust())
-      options.flags = GIT_DIFF_IGNORE_WHITESPACE;
-    // Set GIT_DIFF_IGNORE_WHITESPACE_CHANGE when ignoreWhitespaceChange: true
-    else if (Nan::To<bool>(Nan::Get(optionsArg, Nan::New<String>("ignoreSpaceChange").ToLocalChecked()).ToLocalChecked()).FromJust())
-      options.flags = GIT_DIFF_IGNORE_WHITESPACE_CHANGE;
-    // Set GIT_DIFF_IGNORE_WHITESPACE_EOL when ignoreEolWhitespace: true
-    else if (Nan::To<bool>(Nan::Get(optionsArg, Nan::New<String>("ignoreSpaceAtEOL").ToLocalChecked()).ToLocalChecked()).FromJust()
-      || Nan::To<bool>(Nan::Get(optionsArg, Nan::New<String>("ignoreEolWhitespace").ToLocalChecked()).ToLocalChecked()).FromJust())
-      options.flags = GIT_DIFF_IGNORE_WHITESPACE_EOL;
-    // Set GIT_DIFF_NORMAL when none of the above are defined
-    else
-      options.flags = GIT_DIFF_NORMAL;
+    TreeDiff diff(repository, line_stats);
+    int error = detect_renames ?
+      diff.CompareWithRenames(from_tree, to_tree, &changes) :
+      diff.Compare(from_tree, to_tree, &changes);
+    if (error != GIT_OK) {
+      const git_error* git_error = giterr_last();
+      error_message = git_error ? git_error->message : "Diffing trees failed";
+    }
+    git_tree_free(from_tree);
+    git_tree_free(to_tree);
+    OperationTimer::SetPathCount(changes.paths.size());
   }
 
-  options.context_lines = 0;
-  if (git_diff_blob_to_buffer(blob, NULL, text.data(), text.length(), NULL,
-                              &options, NULL, NULL, DiffHunkCallback, NULL,
-                              &ranges) == GIT_OK) {
-    Local<Object> v8Ranges = Nan::New<Array>(ranges.size());
-    for (size_t i = 0; i < ranges.size(); i++) {
-      Local<Object> v8Range = Nan::New<Object>();
-      Nan::Set(v8Range,
-                Nan::New<String>("oldStart").ToLocalChecked(),
-                Nan::New<Number>(ranges[i].old_start));
-      Nan::Set(v8Range,
-                Nan::New<String>("oldLines").ToLocalChecked(),
-                Nan::New<Number>(ranges[i].old_lines));
-      Nan::Set(v8Range,
-                Nan::New<String>("newStart").ToLocalChecked(),
-                Nan::New<Number>(ranges[i].new_start));
-      Nan::Set(v8Range,
-                Nan::New<String>("newLines").ToLocalChecked(),
-                Nan::New<Number>(ranges[i].new_lines));
-      Nan::Set(v8Ranges, i, v8Range);
+  std::pair<Local<Value>, Local<Value>> Finish() {
+    if (!error_message.empty())
+      return {Nan::Error(error_message.c_str()), Nan::Null()};
+
+    Local<Object> result = Nan::New<Object>();
+    Nan::Set(result, Nan::New("paths").ToLocalChecked(),
+             Repository::ConvertStringVectorToV8Array(changes.paths));
+    Nan::Set(result, Nan::New("statuses").ToLocalChecked(),
+             ConvertVectorToTypedArray<Uint8Array>(changes.statuses));
+    if (detect_renames) {
+      Nan::Set(result, Nan::New("oldPaths").ToLocalChecked(),
+               Repository::ConvertStringVectorToV8Array(changes.old_paths));
     }
-    git_blob_free(blob);
-    return info.GetReturnValue().Set(v8Ranges);
-  } else {
-    git_blob_free(blob);
-    return info.GetReturnValue().Set(Nan::Null());
+    if (line_stats) {
+      Nan::Set(result, Nan::New("additions").ToLocalChecked(),
+               ConvertVectorToTypedArray<Uint32Array>(changes.additions));
+      Nan::Set(result, Nan::New("deletions").ToLocalChecked(),
+               ConvertVectorToTypedArray<Uint32Array>(changes.deletions));
+    }
+    for (const std::string& path : changes.paths)
+      OperationTimer::AddBytes(path.size());
+    return {Nan::Null(), result};
   }
-}
 
-struct LineDiff {
-  git_diff_hunk hunk;
-  git_diff_line line;
+  ChangedPathsWorker(git_repository *repository, Local<Value> from_revision,
+                     Local<Value> to_revision, bool detect_renames,
+                     bool line_stats)
+    : repository(repository), detect_renames(detect_renames),
+      line_stats(line_stats) {
+    this->from_revision = *Nan::Utf8String(from_revision);
+    this->to_revision = *Nan::Utf8String(to_revision);
+  }
 };
 
-int Repository::DiffLineCallback(const git_diff_delta* delta,
-                                 const git_diff_hunk* range,
-                                 const git_diff_line* line,
-                                 void* payload) {
-  LineDiff lineDiff;
-  lineDiff.hunk = *range;
-  lineDiff.line = *line;
-  std::vector<LineDiff> * lineDiffs =
-      static_cast<std::vector<LineDiff>*>(payload);
-  lineDiffs->push_back(lineDiff);
-  return GIT_OK;
+NAN_METHOD(Repository::GetChangedPathsAsync) {
+  auto callback = new Nan::Callback(Local<Function>::Cast(info[0]));
+  bool detect_renames = Nan::To<bool>(info[3]).FromJust();
+  bool line_stats = Nan::To<bool>(info[4]).FromJust();
+  QueueAsyncWorker(info, new RepositoryAsyncWorker<ChangedPathsWorker>(
+    callback, GetStats(info), GetCancellationToken(info),
+    "getChangedPathsAsync", GetAsyncRepository(info),
+    info[1], info[2], detect_renames, line_stats));
 }
 
-NAN_METHOD(Repository::GetLineDiffDetails) {
-  Nan::HandleScope scope;
-  if (info.Length() < 2)
-    return info.GetReturnValue().Set(Nan::Null());
-
-  std::string text(*Nan::Utf8String(info[1]));
+// Field names accepted by getCommitsAsync, in the order their columns are
+// added to the result.
+static const struct {
+  const char* name;
+  uint32_t field;
+} kCommitFields[] = {
+  {"authorName", CommitInfo::kAuthorName},
+  {"authorEmail", CommitInfo::kAuthorEmail},
+  {"authorTime", CommitInfo::kAuthorTime},
+  {"committerName", CommitInfo::kCommitterName},
+  {"committerEmail", CommitInfo::kCommitterEmail},
+  {"committerTime", CommitInfo::kCommitterTime},
+  {"summary", CommitInfo::kSummary},
+  {"message", CommitInfo::kMessage},
+  {"parents", CommitInfo::kParents},
+};
+
+class CommitsWorker {
+  git_repository *repository;
+  CommitCache *cache;
+  std::vector<git_oid> oids;
+  std::vector<uint8_t> found;
+  uint32_t fields;
+  std::vector<CommitInfo> commits;
+
+  template <typename Getter>
+  Local<Array> ConvertStrings(Getter get) {
+    Local<Array> result = Nan::New<Array>(commits.size());
+    for (size_t i = 0; i < commits.size(); i++) {
+      if (found[i])
+        Nan::Set(result, i, Nan::New(get(commits[i])).ToLocalChecked());
+      else
+        Nan::Set(result, i, Nan::Null());
+    }
+    OperationTimer::AddAllocations(commits.size());
+    return result;
+  }
+
+  template <typename Getter>
+  Local<Float64Array> ConvertTimes(Getter get) {
+    std::vector<double> times(commits.size());
+    for (size_t i = 0; i < commits.size(); i++)
+      times[i] = get(commits[i]);
+    return ConvertVectorToTypedArray<Float64Array>(times);
+  }
+
+ public:
+  void Execute() {
+    // Commits that weren't read, whether the object database couldn't be
+    // opened or the work was cancelled, are reported as not found.
+    commits.resize(oids.size());
+    git_odb* odb;
+    if (git_repository_odb(&odb, repository) != GIT_OK) {
+      std::fill(found.begin(), found.end(), 0);
+      return;
+    }
+
+    const CancellationToken& token = CancellationToken::Current();
+    for (size_t i = 0; i < oids.size(); i++) {
+      if (i % 256 == 0 && token.IsCancelled()) {
+        std::fill(found.begin() + i, found.end(), 0);
+        break;
+      }
+      if (found[i])
+        found[i] = cache->Get(odb, oids[i], fields, &commits[i]) == GIT_OK;
+    }
+    git_odb_free(odb);
+  }
+
+  std::pair<Local<Value>, Local<Value>> Finish() {
+    Local<Object> result = Nan::New<Object>();
+    Nan::Set(result, Nan::New("found").ToLocalChecked(),
+             ConvertVectorToTypedArray<Uint8Array>(found));
+
+    if (fields & CommitInfo::kAuthorName)
+      Nan::Set(result, Nan::New("authorNames").ToLocalChecked(),
+               ConvertStrings([](const CommitInfo& c) { return c.author_name; }));
+    if (fields & CommitInfo::kAuthorEmail)
+      Nan::Set(result, Nan::New("authorEmails").ToLocalChecked(),
+               ConvertStrings([](const CommitInfo& c) { return c.author_email; }));
+    if (fields & CommitInfo::kAuthorTime)
+      Nan::Set(result, Nan::New("authorTimes").ToLocalChecked(),
+               ConvertTimes([](const CommitInfo& c) { return c.author_time; }));
+    if (fields & CommitInfo::kCommitterName)
+      Nan::Set(result, Nan::New("committerNames").ToLocalChecked(),
+               ConvertStrings([](const CommitInfo& c) { return c.committer_name; }));
+    if (fields & CommitInfo::kCommitterEmail)
+      Nan::Set(result, Nan::New("committerEmails").ToLocalChecked(),
+               ConvertStrings([](const CommitInfo& c) { return c.committer_email; }));
+    if (fields & CommitInfo::kCommitterTime)
+      Nan::Set(result, Nan::New("committerTimes").ToLocalChecked(),
+               ConvertTimes([](const CommitInfo& c) { return c.committer_time; }));
+    if (fields & CommitInfo::kSummary)
+      Nan::Set(result, Nan::New("summaries").ToLocalChecked(),
+               ConvertStrings([](const CommitInfo& c) { return c.summary; }));
+    if (fields & CommitInfo::kMessage)
+      Nan::Set(result, Nan::New("messages").ToLocalChecked(),
+               ConvertStrings([](const CommitInfo& c) { return c.message; }));
+
+    if (fields & CommitInfo::kParents) {
+      // The parents of all commits, one after the other, with a count per
+      // commit to tell where each commit's parents start.
+      std::vector<uint32_t> parent_counts(commits.size());
+      size_t total = 0;
+      for (size_t i = 0; i < commits.size(); i++) {
+        parent_counts[i] = commits[i].parents.size();
+        total += parent_counts[i];
+      }
+      Local<Array> parents = Nan::New<Array>(total);
+      uint32_t index = 0;
+      char sha[GIT_OID_HEXSZ + 1];
+      for (const CommitInfo& commit : commits) {
+        for (const git_oid& parent : commit.parents) {
+          git_oid_tostr(sha, sizeof(sha), &parent);
+          Nan::Set(parents, index++, Nan::New(sha).ToLocalChecked());
+        }
+      }
+      OperationTimer::AddAllocations(total);
+      Nan::Set(result, Nan::New("parentCounts").ToLocalChecked(),
+               ConvertVectorToTypedArray<Uint32Array>(parent_counts));
+      Nan::Set(result, Nan::New("parents").ToLocalChecked(), parents);
+    }
+    return {Nan::Null(), result};
+  }
+
+  CommitsWorker(git_repository *repository, CommitCache *cache,
+                Local<Value> js_oids, Local<Value> js_fields)
+    : repository(repository), cache(cache), fields(0) {
+    Local<Array> array = Local<Array>::Cast(js_oids);
+    oids.resize(array->Length());
+    found.resize(array->Length());
+    for (uint32_t i = 0; i < array->Length(); i++) {
+      Nan::Utf8String oid(Nan::Get(array, i).ToLocalChecked());
+      found[i] = oid.length() == GIT_OID_HEXSZ &&
+          git_oid_fromstr(&oids[i], *oid) == GIT_OK;
+    }
+
+    Local<Array> names = Local<Array>::Cast(js_fields);
+    for (uint32_t i = 0; i < names->Length(); i++) {
+      Nan::Utf8String name(Nan::Get(names, i).ToLocalChecked());
+      for (const auto& field : kCommitFields) {
+        if (strcmp(*name, field.name) == 0)
+          fields |= field.field;
+      }
+    }
+  }
+};
+
+NAN_METHOD(Repository::GetCommitsAsync) {
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
+  auto callback = new Nan::Callback(Local<Function>::Cast(info[0]));
+  QueueAsyncWorker(info, new RepositoryAsyncWorker<CommitsWorker>(
+    callback, GetStats(info), GetCancellationToken(info),
+    "getCommitsAsync", GetAsyncRepository(info), &repo->commit_cache, info[1],
+    info[2]));
+}
+
+class TrackedPathsWorker {
+  git_repository *repository;
+  TrackedPathsCache *cache;
+  std::string prefix;
+  bool include_modes;
+  bool include_oids;
+  bool include_sizes;
+  std::shared_ptr<const TrackedPaths> listing;
+  size_t begin;
+  size_t end;
+  int code;
+
+ public:
+  void Execute() {
+    git_index* index;
+    code = git_repository_index(&index, repository);
+    if (code != GIT_OK)
+      return;
+    code = git_index_read(index, 0);
+    if (code == GIT_OK) {
+      listing = cache->Get(index);
+      listing->FindPrefix(prefix, &begin, &end);
+      OperationTimer::SetPathCount(end - begin);
+    }
+    git_index_free(index);
+  }
+
+  std::pair<Local<Value>, Local<Value>> Finish() {
+    if (code != GIT_OK) {
+      const git_error* error = giterr_last();
+      return {Nan::Error(error ? error->message : "Reading the index failed"),
+              Nan::Null()};
+    }
+
+    size_t count = end - begin;
+    uint32_t first_offset = listing->offsets[begin];
+    uint32_t byte_count = listing->offsets[end] - first_offset;
+    std::vector<uint32_t> offsets(listing->offsets.begin() + begin,
+                                  listing->offsets.begin() + end + 1);
+    for (uint32_t& offset : offsets)
+      offset -= first_offset;
+
+    Local<Object> result = Nan::New<Object>();
+    Nan::Set(result, Nan::New("paths").ToLocalChecked(),
+             Nan::CopyBuffer(listing->paths.data() + first_offset, byte_count)
+               .ToLocalChecked());
+    Nan::Set(result, Nan::New("offsets").ToLocalChecked(),
+             ConvertVectorToTypedArray<Uint32Array>(offsets));
+    if (include_modes) {
+      Nan::Set(result, Nan::New("modes").ToLocalChecked(),
+               ConvertArrayToTypedArray<Uint32Array>(
+                 listing->modes.data() + begin, count));
+    }
+    if (include_oids) {
+      Nan::Set(result, Nan::New("oids").ToLocalChecked(),
+               Nan::CopyBuffer(reinterpret_cast<const char*>(
+                 listing->oids.data() + begin * GIT_OID_RAWSZ),
+                 count * GIT_OID_RAWSZ).ToLocalChecked());
+    }
+    if (include_sizes) {
+      Nan::Set(result, Nan::New("sizes").ToLocalChecked(),
+               ConvertArrayToTypedArray<Uint32Array>(
+                 listing->sizes.data() + begin, count));
+    }
+    OperationTimer::AddBytes(byte_count);
+    return {Nan::Null(), result};
+  }
+
+  TrackedPathsWorker(git_repository *repository, TrackedPathsCache *cache,
+                     Local<Value> options)
+    : repository(repository), cache(cache), include_modes(false),
+      include_oids(false), include_sizes(false), begin(0), end(0),
+      code(GIT_OK) {
+    if (!options->IsObject())
+      return;
+    Local<Object> object = Local<Object>::Cast(options);
+    Local<Value> js_prefix =
+      Nan::Get(object, Nan::New("prefix").ToLocalChecked()).ToLocalChecked();
+    if (js_prefix->IsString())
+      prefix = *Nan::Utf8String(js_prefix);
+    include_modes = GetBooleanOption(object, "includeModes");
+    include_oids = GetBooleanOption(object, "includeOids");
+    include_sizes = GetBooleanOption(object, "includeSizes");
+  }
+};
+
+NAN_METHOD(Repository::GetTrackedPathsAsync) {
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
+  auto callback = new Nan::Callback(Local<Function>::Cast(info[0]));
+  QueueAsyncWorker(info, new RepositoryAsyncWorker<TrackedPathsWorker>(
+    callback, GetStats(info), GetCancellationToken(info),
+    "getTrackedPathsAsync", GetAsyncRepository(info),
+    &repo->tracked_paths_cache, info[1]));
+}
+
+class BlameWorker {
+  git_repository *repository;
+  BlameCache *cache;
+  std::string path;
+  std::string text;
+  bool has_text;
+  std::vector<uint32_t> start_rows;
+  std::vector<uint32_t> line_counts;
+  std::vector<uint32_t> commit_indices;
+  std::vector<uint32_t> original_start_rows;
+  std::vector<std::string> commits;
+  std::string error_message;
+
+  void ReadWorkingDirectoryFile() {
+    const char* workdir = git_repository_workdir(repository);
+    if (workdir == NULL)
+      return;
+    FILE* file = fopen((std::string(workdir) + path).c_str(), "rb");
+    if (file == NULL)
+      return;
+    char buffer[16384];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+      text.append(buffer, count);
+    has_text = ferror(file) == 0;
+    fclose(file);
+  }
+
+  void AddHunks(git_blame* blame) {
+    std::map<std::string, uint32_t> commit_ids;
+    uint32_t count = git_blame_get_hunk_count(blame);
+    for (uint32_t i = 0; i < count; i++) {
+      const git_blame_hunk* hunk = git_blame_get_hunk_byindex(blame, i);
+      char sha[GIT_OID_HEXSZ + 1];
+      git_oid_tostr(sha, sizeof(sha), &hunk->final_commit_id);
+      auto inserted = commit_ids.emplace(sha, commits.size());
+      if (inserted.second)
+        commits.push_back(sha);
+
+      start_rows.push_back(hunk->final_start_line_number - 1);
+      line_counts.push_back(hunk->lines_in_hunk);
+      commit_indices.push_back(inserted.first->second);
+      original_start_rows.push_back(hunk->orig_start_line_number - 1);
+    }
+  }
+
+ public:
+  void Execute() {
+    git_oid head;
+    if (git_reference_name_to_id(&head, repository, "HEAD") != GIT_OK) {
+      error_message = "Cannot resolve HEAD";
+      return;
+    }
+
+    std::shared_ptr<git_blame> blame = cache->Lookup(path, head);
+    if (!blame) {
+      git_blame_options options = GIT_BLAME_OPTIONS_INIT;
+      git_oid_cpy(&options.newest_commit, &head);
+      git_blame* file_blame;
+      if (git_blame_file(&file_blame, repository, path.c_str(),
+                         &options) != GIT_OK) {
+        const git_error* error = giterr_last();
+        error_message = error ? error->message : "Blaming failed";
+        return;
+      }
+      blame = BlameCache::Wrap(file_blame);
+      cache->Store(path, head, blame);
+    }
+
+    // The HEAD blame stays cached; the edits are diffed against the blamed
+    // blob and their lines attributed to the zero oid.
+    if (!has_text)
+      ReadWorkingDirectoryFile();
+    if (has_text) {
+      git_blame* buffer_blame;
+      if (git_blame_buffer(&buffer_blame, blame.get(), text.data(),
+                           text.size()) == GIT_OK) {
+        AddHunks(buffer_blame);
+        git_blame_free(buffer_blame);
+        return;
+      }
+    }
+    AddHunks(blame.get());
+  }
+
+  std::pair<Local<Value>, Local<Value>> Finish() {
+    if (!error_message.empty())
+      return {Nan::Error(error_message.c_str()), Nan::Null()};
+
+    Local<Object> result = Nan::New<Object>();
+    Nan::Set(result, Nan::New("startRows").ToLocalChecked(),
+             ConvertVectorToTypedArray<Uint32Array>(start_rows));
+    Nan::Set(result, Nan::New("lineCounts").ToLocalChecked(),
+             ConvertVectorToTypedArray<Uint32Array>(line_counts));
+    Nan::Set(result, Nan::New("commitIndices").ToLocalChecked(),
+             ConvertVectorToTypedArray<Uint32Array>(commit_indices));
+    Nan::Set(result, Nan::New("originalStartRows").ToLocalChecked(),
+             ConvertVectorToTypedArray<Uint32Array>(original_start_rows));
+    Nan::Set(result, Nan::New("commits").ToLocalChecked(),
+             Repository::ConvertStringVectorToV8Array(commits));
+    return {Nan::Null(), result};
+  }
+
+  BlameWorker(git_repository *repository, BlameCache *cache,
+              Local<Value> path, Local<Value> text)
+    : repository(repository), cache(cache), has_text(false) {
+    this->path = *Nan::Utf8String(path);
+    if (text->IsString()) {
+      Nan::Utf8String utf8_text(text);
+      this->text.assign(*utf8_text, utf8_text.length());
+      has_text = true;
+    }
+  }
+};
+
+NAN_METHOD(Repository::GetBlameAsync) {
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
+  auto callback = new Nan::Callback(Local<Function>::Cast(info[0]));
+  QueueAsyncWorker(info, new RepositoryAsyncWorker<BlameWorker>(
+    callback, GetStats(info), GetCancellationToken(info), "getBlameAsync",
+    GetAsyncRepository(info), &repo->blame_cache, info[1], info[2]));
+}
+
+// Searches files on a pool of threads and delivers each file's matches to
+// an optional JS callback as they are found, before resolving with the rest.
+class GrepWorker {
+  git_repository *repository;
+  GrepCache *cache;
+  GrepPattern pattern;
+  Grep::Source source;
+  std::vector<std::string> paths;
+  size_t max_matches;
+  size_t thread_count;
+  Nan::Callback *on_matches;
+
+  std::mutex mutex;
+  std::vector<GrepFileMatches> pending;
+  std::vector<GrepFileMatches> results;
+  bool truncated;
+  int code;
+  size_t bytes_scanned;
+
+  static Local<Array> ConvertMatchesToV8Array(
+      const std::vector<GrepFileMatches>& files) {
+    size_t count = 0;
+    for (const GrepFileMatches& file : files)
+      count += file.matches.size();
+
+    Local<Array> result = Nan::New<Array>(count);
+    uint32_t index = 0;
+    for (const GrepFileMatches& file : files) {
+      Local<String> path = Nan::New(file.path).ToLocalChecked();
+      for (const GrepMatch& match : file.matches) {
+        Local<Object> object = Nan::New<Object>();
+        Nan::Set(object, Nan::New("path").ToLocalChecked(), path);
+        Nan::Set(object, Nan::New("row").ToLocalChecked(),
+                 Nan::New<Number>(match.row));
+        Nan::Set(object, Nan::New("column").ToLocalChecked(),
+                 Nan::New<Number>(match.column));
+        Nan::Set(object, Nan::New("length").ToLocalChecked(),
+                 Nan::New<Number>(match.length));
+        Nan::Set(object, Nan::New("lineText").ToLocalChecked(),
+                 Nan::New(match.text).ToLocalChecked());
+        Nan::Set(result, index++, object);
+        OperationTimer::AddBytes(match.text.size());
+      }
+    }
+    OperationTimer::AddAllocations(count);
+    return result;
+  }
+
+  void DeliverPending() {
+    std::vector<GrepFileMatches> files;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      files.swap(pending);
+    }
+    if (files.empty())
+      return;
+    Local<Value> argv[] = {ConvertMatchesToV8Array(files)};
+    on_matches->Call(1, argv);
+  }
+
+ public:
+  void Execute(const Nan::AsyncProgressWorker::ExecutionProgress& progress) {
+    Grep grep(repository, pattern, cache);
+    code = grep.Collect(source, paths);
+    if (code == GIT_OK) {
+      truncated = grep.Run(thread_count, max_matches,
+                           [&](GrepFileMatches* file) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (on_matches) {
+          pending.push_back(std::move(*file));
+          progress.Signal();
+        } else {
+          results.push_back(std::move(*file));
+        }
+      });
+    }
+    truncated = truncated || grep.PartiallySearched();
+    bytes_scanned = grep.BytesScanned();
+    OperationTimer::SetPathCount(grep.FileCount());
+    OperationTimer::AddBytes(bytes_scanned);
+  }
+
+  void Progress() {
+    DeliverPending();
+  }
+
+  std::pair<Local<Value>, Local<Value>> Finish() {
+    OperationTimer::AddBytes(bytes_scanned);
+    if (code != GIT_OK) {
+      const git_error* error = giterr_last();
+      return {Nan::Error(error ? error->message : "Searching failed"),
+              Nan::Null()};
+    }
+
+    // Progress signals still in flight when the work finished are
+    // coalesced into this last delivery.
+    if (on_matches)
+      DeliverPending();
+
+    std::sort(results.begin(), results.end(),
+              [](const GrepFileMatches& a, const GrepFileMatches& b) {
+      return a.path < b.path;
+    });
+    Local<Object> result = Nan::New<Object>();
+    Nan::Set(result, Nan::New("matches").ToLocalChecked(),
+             ConvertMatchesToV8Array(results));
+    Nan::Set(result, Nan::New("truncated").ToLocalChecked(),
+             Nan::New<Boolean>(truncated));
+    return {Nan::Null(), result};
+  }
+
+  GrepWorker(Nan::Callback *on_matches, git_repository *repository,
+             GrepCache *cache, GrepPattern&& pattern, Grep::Source source,
+             const std::vector<std::string>& paths, size_t max_matches,
+             size_t thread_count)
+    : repository(repository), cache(cache), pattern(std::move(pattern)),
+      source(source), paths(paths), max_matches(max_matches),
+      thread_count(thread_count), on_matches(on_matches), truncated(false),
+      code(GIT_OK), bytes_scanned(0) {}
+
+  ~GrepWorker() {
+    delete on_matches;
+  }
+};
+
+NAN_METHOD(Repository::GrepAsync) {
+  Nan::HandleScope scope;
+  Local<Object> options = Local<Object>::Cast(info[2]);
+  auto get = [&](const char* name) {
+    return Nan::Get(options, Nan::New(name).ToLocalChecked()).ToLocalChecked();
+  };
+
+  GrepPattern pattern(*Nan::Utf8String(info[1]),
+                      Nan::To<bool>(get("regex")).FromJust(),
+                      Nan::To<bool>(get("ignoreCase")).FromJust());
+  if (!pattern.IsValid())
+    return Nan::ThrowError(pattern.Error().c_str());
+
+  Grep::Source source = Grep::kWorkdir;
+  Nan::Utf8String source_name(get("source"));
+  if (strcmp(*source_name, "head") == 0)
+    source = Grep::kHead;
+  else if (strcmp(*source_name, "index") == 0)
+    source = Grep::kIndex;
+
+  std::vector<std::string> paths;
+  Local<Value> js_paths = get("paths");
+  if (js_paths->IsArray()) {
+    Local<Array> array = Local<Array>::Cast(js_paths);
+    for (uint32_t i = 0; i < array->Length(); i++)
+      paths.emplace_back(*Nan::Utf8String(Nan::Get(array, i).ToLocalChecked()));
+  }
+
+  size_t max_matches = 0;
+  Local<Value> js_max_matches = get("maxMatches");
+  if (js_max_matches->IsNumber() &&
+      Nan::To<double>(js_max_matches).FromJust() > 0)
+    max_matches = Nan::To<double>(js_max_matches).FromJust();
+
+  size_t thread_count = std::min(std::thread::hardware_concurrency(), 8u);
+  Local<Value> js_threads = get("threads");
+  if (js_threads->IsNumber() && Nan::To<double>(js_threads).FromJust() >= 1)
+    thread_count = std::min(Nan::To<double>(js_threads).FromJust(), 64.0);
+
+  Nan::Callback *on_matches = NULL;
+  if (info[3]->IsFunction())
+    on_matches = new Nan::Callback(Local<Function>::Cast(info[3]));
+
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
+  auto callback = new Nan::Callback(Local<Function>::Cast(info[0]));
+  QueueAsyncWorker(info, new RepositoryProgressWorker<GrepWorker>(
+    callback, GetStats(info), GetCancellationToken(info), "grepAsync",
+    on_matches, GetAsyncRepository(info), &repo->grep_cache,
+    std::move(pattern), source, paths, max_matches, thread_count));
+}
+
+// Streams the commits that changed a path in batches, so that the first
+// commits of a long history show up before the walk reaches the root.
+class PathHistoryWorker {
+  static const size_t kBatchSize = 64;
+  static const uint64_t kBatchInterval = 50 * 1000 * 1000;  // Nanoseconds.
+
+  git_repository *repository;
+  std::string path;
+  std::shared_ptr<const CommitGraph> graph;
+  size_t limit;
+  Nan::Callback *on_chunk;
+
+  std::mutex mutex;
+  std::vector<PathHistoryCommit> pending;
+  std::vector<PathHistoryCommit> results;
+  size_t count;
+  bool used_filters;
+  int code;
+
+  static Local<Array> ConvertCommitsToV8Array(
+      const std::vector<PathHistoryCommit>& commits) {
+    Local<Array> result = Nan::New<Array>(commits.size());
+    for (size_t i = 0; i < commits.size(); i++) {
+      const PathHistoryCommit& commit = commits[i];
+      Local<Object> object = Nan::New<Object>();
+      Nan::Set(object, Nan::New("oid").ToLocalChecked(),
+               Nan::New(commit.oid).ToLocalChecked());
+      Nan::Set(object, Nan::New("author").ToLocalChecked(),
+               Nan::New(commit.author).ToLocalChecked());
+      Nan::Set(object, Nan::New("time").ToLocalChecked(),
+               Nan::New<Number>(commit.time));
+      Nan::Set(object, Nan::New("summary").ToLocalChecked(),
+               Nan::New(commit.summary).ToLocalChecked());
+      Nan::Set(result, i, object);
+    }
+    OperationTimer::AddAllocations(commits.size());
+    return result;
+  }
+
+  void DeliverPending() {
+    std::vector<PathHistoryCommit> commits;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      commits.swap(pending);
+    }
+    if (commits.empty())
+      return;
+    Local<Value> argv[] = {ConvertCommitsToV8Array(commits)};
+    on_chunk->Call(1, argv);
+  }
+
+ public:
+  void Execute(const Nan::AsyncProgressWorker::ExecutionProgress& progress) {
+    std::vector<PathHistoryCommit> batch;
+    uint64_t flushed_at = PerformanceStats::Now();
+    auto flush = [&]() {
+      std::lock_guard<std::mutex> lock(mutex);
+      std::move(batch.begin(), batch.end(), std::back_inserter(pending));
+      batch.clear();
+      progress.Signal();
+    };
+
+    PathHistory history(repository, path, graph);
+    used_filters = history.UsesChangedPathFilters();
+    git_oid head;
+    code = git_reference_name_to_id(&head, repository, "HEAD");
+    if (code == GIT_OK) {
+      code = history.Walk(head, limit, [&](PathHistoryCommit* commit) {
+        count++;
+        if (!on_chunk) {
+          results.push_back(std::move(*commit));
+          return;
+        }
+
+        batch.push_back(std::move(*commit));
+        uint64_t now = PerformanceStats::Now();
+        if (batch.size() >= kBatchSize || now - flushed_at >= kBatchInterval) {
+          flush();
+          flushed_at = now;
+        }
+      });
+    } else if (code == GIT_ENOTFOUND) {
+      code = GIT_OK;
+    }
+    if (!batch.empty())
+      flush();
+    OperationTimer::SetPathCount(history.CommitsWalked());
+  }
+
+  void Progress() {
+    DeliverPending();
+  }
+
+  std::pair<Local<Value>, Local<Value>> Finish() {
+    if (code != GIT_OK) {
+      const git_error* error = giterr_last();
+      return {Nan::Error(error ? error->message : "Reading history failed"),
+              Nan::Null()};
+    }
+
+    if (on_chunk)
+      DeliverPending();
+
+    Local<Object> result = Nan::New<Object>();
+    Nan::Set(result, Nan::New("commits").ToLocalChecked(),
+             ConvertCommitsToV8Array(results));
+    Nan::Set(result, Nan::New("count").ToLocalChecked(),
+             Nan::New<Number>(count));
+    Nan::Set(result, Nan::New("usedChangedPathFilters").ToLocalChecked(),
+             Nan::New<Boolean>(used_filters));
+    return {Nan::Null(), result};
+  }
+
+  PathHistoryWorker(Nan::Callback *on_chunk, git_repository *repository,
+                    const std::string& path,
+                    std::shared_ptr<const CommitGraph> graph, size_t limit)
+    : repository(repository), path(path), graph(graph), limit(limit),
+      on_chunk(on_chunk), count(0), used_filters(false), code(GIT_OK) {}
+
+  ~PathHistoryWorker() {
+    delete on_chunk;
+  }
+};
+
+NAN_METHOD(Repository::GetPathHistoryStream) {
+  Nan::HandleScope scope;
+  std::string path(*Nan::Utf8String(info[1]));
+
+  size_t limit = 0;
+  if (info[2]->IsNumber() && Nan::To<double>(info[2]).FromJust() > 0)
+    limit = Nan::To<double>(info[2]).FromJust();
+
+  Nan::Callback *on_chunk = NULL;
+  if (info[3]->IsFunction())
+    on_chunk = new Nan::Callback(Local<Function>::Cast(info[3]));
+
+  // The commit-graph is opened on the JS thread, where the cache lives, and
+  // only read from the worker.
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
+  std::shared_ptr<const CommitGraph> graph =
+      repo->commit_graph_cache.Get(GetRepository(info));
+  auto callback = new Nan::Callback(Local<Function>::Cast(info[0]));
+  QueueAsyncWorker(info, new RepositoryProgressWorker<PathHistoryWorker>(
+    callback, GetStats(info), GetCancellationToken(info),
+    "getPathHistoryStream", on_chunk, GetAsyncRepository(info), path, graph,
+    limit));
+}
+
+// The hunks of a line diff, which stops once there are more than
+// |max_hunks| of them when it is set.
+struct LineDiffHunks {
+  std::vector<git_diff_hunk> hunks;
+  size_t max_hunks;
+};
+
+int Repository::DiffHunkCallback(const git_diff_delta* delta,
+                                 const git_diff_hunk* range,
+                                 void* payload) {
+  LineDiffHunks* ranges = static_cast<LineDiffHunks*>(payload);
+  ranges->hunks.push_back(*range);
+  if (ranges->max_hunks > 0 && ranges->hunks.size() > ranges->max_hunks)
+    return GIT_EUSER;
+  return GIT_OK;
+}
+
+// Adds the diff algorithm chosen with the `algorithm` option to the flags
+// set for the whitespace options.
+static void SetDiffAlgorithm(Local<Object> options_arg,
+                             git_diff_options* options) {
+  Local<Value> algorithm =
+    Nan::Get(options_arg, Nan::New("algorithm").ToLocalChecked())
+      .ToLocalChecked();
+  if (!algorithm->IsString())
+    return;
+
+  // libgit2 doesn't expose xdiff's histogram diff, so it falls back to
+  // patience, which histogram refines.
+  Nan::Utf8String name(algorithm);
+  if (strcmp(*name, "patience") == 0 || strcmp(*name, "histogram") == 0)
+    options->flags |= GIT_DIFF_PATIENCE;
+  else if (strcmp(*name, "minimal") == 0)
+    options->flags |= GIT_DIFF_MINIMAL;
+}
+
+NAN_METHOD(Repository::GetLineDiffs) {
+  Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "getLineDiffs");
+  if (info.Length() < 2)
+    return info.GetReturnValue().Set(Nan::Null());
+
+  std::string text(*Nan::Utf8String(info[1]));
+  OperationTimer::AddBytes(text.length());
+
+  git_repository* repo = GetRepository(info);
+
+  git_blob* blob = NULL;
+
+  int getBlobResult = GetBlob(info, repo, blob);
+
+  if (getBlobResult != 0)
+    return info.GetReturnValue().Set(Nan::Null());
+
+  LineDiffHunks ranges;
+  ranges.max_hunks = 0;
+  git_diff_options options = CreateDefaultGitDiffOptions();
+
+  if (info.Length() >= 3) {
+    Local<Object> optionsArg(Local<Object>::Cast(info[2]));
+    // Set GIT_DIFF_IGNORE_WHITESPACE when ignoreWhitespace: true
+    if (Nan::To<bool>(Nan::Get(optionsArg, Nan::New<String>("ignoreAllSpace").ToLocalChecked()).ToLocalChecked()).FromJust())
+      options.flags = GIT_DIFF_IGNORE_WHITESPACE;
+    // Set GIT_DIFF_IGNORE_WHITESPACE_CHANGE when ignoreWhitespaceChange: true
+    else if (Nan::To<bool>(Nan::Get(optionsArg, Nan::New<String>("ignoreSpaceChange").ToLocalChecked()).ToLocalChecked()).FromJust())
+      options.flags = GIT_DIFF_IGNORE_WHITESPACE_CHANGE;
+    // Set GIT_DIFF_IGNORE_WHITESPACE_EOL when ignoreEolWhitespace: true
+    else if (Nan::To<bool>(Nan::Get(optionsArg, Nan::New<String>("ignoreSpaceAtEOL").ToLocalChecked()).ToLocalChecked()).FromJust()
+      || Nan::To<bool>(Nan::Get(optionsArg, Nan::New<String>("ignoreEolWhitespace").ToLocalChecked()).ToLocalChecked()).FromJust())
+      options.flags = GIT_DIFF_IGNORE_WHITESPACE_EOL;
+    // Set GIT_DIFF_NORMAL when none of the above are defined
+    else
+      options.flags = GIT_DIFF_NORMAL;
+    SetDiffAlgorithm(optionsArg, &options);
+
+    Local<Value> maxHunks = Nan::Get(optionsArg, Nan::New<String>("maxHunks").ToLocalChecked()).ToLocalChecked();
+    if (maxHunks->IsNumber() && Nan::To<double>(maxHunks).FromJust() > 0)
+      ranges.max_hunks = Nan::To<double>(maxHunks).FromJust();
+  }
+
+  options.context_lines = 0;
+  BufferDiff diff(blob, text.data(), text.length());
+  int error = diff.Diff(&options, DiffHunkCallback, NULL, &ranges);
+  // Past the hunk cap the whole changed region is reported as one hunk.
+  if (error == GIT_EUSER && ranges.max_hunks > 0) {
+    ranges.hunks.assign(1, diff.ChangedRegion());
+    error = GIT_OK;
+  }
+  if (error == GIT_OK) {
+    const std::vector<git_diff_hunk>& hunks = ranges.hunks;
+    Local<Object> v8Ranges = Nan::New<Array>(hunks.size());
+    for (size_t i = 0; i < hunks.size(); i++) {
+      Local<Object> v8Range = Nan::New<Object>();
+      Nan::Set(v8Range,
+                Nan::New<String>("oldStart").ToLocalChecked(),
+                Nan::New<Number>(hunks[i].old_start));
+      Nan::Set(v8Range,
+                Nan::New<String>("oldLines").ToLocalChecked(),
+                Nan::New<Number>(hunks[i].old_lines));
+      Nan::Set(v8Range,
+                Nan::New<String>("newStart").ToLocalChecked(),
+                Nan::New<Number>(hunks[i].new_start));
+      Nan::Set(v8Range,
+                Nan::New<String>("newLines").ToLocalChecked(),
+                Nan::New<Number>(hunks[i].new_lines));
+      Nan::Set(v8Ranges, i, v8Range);
+    }
+    git_blob_free(blob);
+    return info.GetReturnValue().Set(v8Ranges);
+  } else {
+    git_blob_free(blob);
+    return info.GetReturnValue().Set(Nan::Null());
+  }
+}
+
+struct LineDiff {
+  git_diff_hunk hunk;
+  git_diff_line line;
+};
+
+int Repository::DiffLineCallback(const git_diff_delta* delta,
+                                 const git_diff_hunk* range,
+                                 const git_diff_line* line,
+                                 void* payload) {
+  LineDiff lineDiff;
+  lineDiff.hunk = *range;
+  lineDiff.line = *line;
+  std::vector<LineDiff> * lineDiffs =
+      static_cast<std::vector<LineDiff>*>(payload);
+  lineDiffs->push_back(lineDiff);
+  return GIT_OK;
+}
+
+NAN_METHOD(Repository::GetLineDiffDetails) {
+  Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "getLineDiffDetails");
+  if (info.Length() < 2)
+    return info.GetReturnValue().Set(Nan::Null());
+
+  std::string text(*Nan::Utf8String(info[1]));
+  OperationTimer::AddBytes(text.length());
 
   git_repository* repo = GetRepository(info);
 
@@ -889,12 +2361,12 @@ NAN_METHOD(Repository::GetLineDiffDetails) {
     // Set GIT_DIFF_NORMAL when none of the above are defined
     else
       options.flags = GIT_DIFF_NORMAL;
+    SetDiffAlgorithm(optionsArg, &options);
   }
 
   options.context_lines = 0;
-  if (git_diff_blob_to_buffer(blob, NULL, text.data(), text.length(), NULL,
-                              &options, NULL, NULL, NULL, DiffLineCallback,
-                              &lineDiffs) == GIT_OK) {
+  BufferDiff diff(blob, text.data(), text.length());
+  if (diff.Diff(&options, NULL, DiffLineCallback, &lineDiffs) == GIT_OK) {
     Local<Object> v8Ranges = Nan::New<Array>(lineDiffs.size());
     for (size_t i = 0; i < lineDiffs.size(); i++) {
       Local<Object> v8Range = Nan::New<Object>();
@@ -917,6 +2389,7 @@ NAN_METHOD(Repository::GetLineDiffDetails) {
       Nan::Set(v8Range,
                 Nan::New<String>("newLines").ToLocalChecked(),
                 Nan::New<Number>(lineDiffs[i].hunk.new_lines));
+      OperationTimer::AddBytes(lineDiffs[i].line.content_len);
       Nan::Set(v8Range,
                 Nan::New<String>("line").ToLocalChecked(),
                 Nan::New<String>(lineDiffs[i].line.content,
@@ -945,6 +2418,7 @@ Local<Value> Repository::ConvertStringVectorToV8Array(
 
 NAN_METHOD(Repository::GetReferences) {
   Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "getReferences");
 
   Local<Object> references = Nan::New<Object>();
   std::vector<std::string> heads, remotes, tags;
@@ -997,6 +2471,7 @@ int branch_checkout(git_repository* repo, const char* refName) {
 
 NAN_METHOD(Repository::CheckoutReference) {
   Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "checkoutRef");
 
   if (info.Length() < 1)
     return info.GetReturnValue().Set(Nan::New<Boolean>(false));
@@ -1050,6 +2525,7 @@ NAN_METHOD(Repository::CheckoutReference) {
 
 NAN_METHOD(Repository::Add) {
   Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "add");
 
   git_repository* repository = GetRepository(info);
   std::string path(*Nan::Utf8String(info[0]));
@@ -1084,8 +2560,514 @@ NAN_METHOD(Repository::Add) {
   info.GetReturnValue().Set(Nan::New<Boolean>(true));
 }
 
-Repository::Repository(Local<String> path, Local<Boolean> search) {
+NAN_METHOD(Repository::GetPerformanceStats) {
   Nan::HandleScope scope;
+  PerformanceStats* stats = GetStats(info);
+
+  Local<Object> operations = Nan::New<Object>();
+  auto snapshot = stats->Snapshot();
+  for (auto iter = snapshot.begin(), end = snapshot.end(); iter != end; ++iter) {
+    const OperationStats& operation = iter->second;
+    Local<Object> v8Operation = Nan::New<Object>();
+    Nan::Set(v8Operation,
+              Nan::New<String>("calls").ToLocalChecked(),
+              Nan::New<Number>(operation.calls));
+    Nan::Set(v8Operation,
+              Nan::New<String>("totalTime").ToLocalChecked(),
+              Nan::New<Number>(operation.total_time / 1e6));
+    Nan::Set(v8Operation,
+              Nan::New<String>("maxTime").ToLocalChecked(),
+              Nan::New<Number>(operation.max_time / 1e6));
+    Nan::Set(v8Operation,
+              Nan::New<String>("queueWaitTime").ToLocalChecked(),
+              Nan::New<Number>(operation.queue_wait_time / 1e6));
+    Nan::Set(v8Operation,
+              Nan::New<String>("bytes").ToLocalChecked(),
+              Nan::New<Number>(operation.bytes));
+    Nan::Set(v8Operation,
+              Nan::New<String>("allocations").ToLocalChecked(),
+              Nan::New<Number>(operation.allocations));
+    Nan::Set(operations,
+              Nan::New<String>(iter->first).ToLocalChecked(),
+              v8Operation);
+  }
+
+  // libgit2 does not count object cache hits, only the memory it holds.
+  ssize_t cachedMemory = 0;
+  ssize_t cacheLimit = 0;
+  git_libgit2_opts(GIT_OPT_GET_CACHED_MEMORY, &cachedMemory, &cacheLimit);
+  Local<Object> objectCache = Nan::New<Object>();
+  Nan::Set(objectCache,
+            Nan::New<String>("cachedBytes").ToLocalChecked(),
+            Nan::New<Number>(cachedMemory));
+  Nan::Set(objectCache,
+            Nan::New<String>("maxBytes").ToLocalChecked(),
+            Nan::New<Number>(cacheLimit));
+  Nan::Set(objectCache,
+            Nan::New<String>("utilization").ToLocalChecked(),
+            Nan::New<Number>(cacheLimit > 0 ?
+                             static_cast<double>(cachedMemory) / cacheLimit : 0));
+
+  Local<Object> result = Nan::New<Object>();
+  Nan::Set(result,
+            Nan::New<String>("enabled").ToLocalChecked(),
+            Nan::New<Boolean>(stats->IsEnabled()));
+  Nan::Set(result,
+            Nan::New<String>("operations").ToLocalChecked(),
+            operations);
+  Nan::Set(result,
+            Nan::New<String>("objectCache").ToLocalChecked(),
+            objectCache);
+  info.GetReturnValue().Set(result);
+}
+
+NAN_METHOD(Repository::ResetPerformanceStats) {
+  Nan::HandleScope scope;
+  GetStats(info)->Reset();
+  info.GetReturnValue().SetUndefined();
+}
+
+NAN_METHOD(Repository::SetPerformanceStatsEnabled) {
+  Nan::HandleScope scope;
+  bool enabled = info.Length() > 0 && Nan::To<bool>(info[0]).FromJust();
+  GetStats(info)->SetEnabled(enabled);
+  info.GetReturnValue().SetUndefined();
+}
+
+std::string Repository::NormalizePathArgument(Local<Value> path) {
+  std::string result(*Nan::Utf8String(path));
+#ifdef _WIN32
+  std::replace(result.begin(), result.end(), '\\', '/');
+#endif
+  return result;
+}
+
+static bool IsAbsolutePath(const std::string& path) {
+#ifdef _WIN32
+  if (path.size() >= 2 && path[1] == ':')
+    return true;
+#endif
+  return !path.empty() && path[0] == '/';
+}
+
+NAN_METHOD(Repository::SetPathTable) {
+  Nan::HandleScope scope;
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
+  Local<Array> prefixes = Local<Array>::Cast(info[0]);
+  Local<Array> owners = Local<Array>::Cast(info[1]);
+
+  repo->path_table.Clear();
+  for (uint32_t i = 0; i < prefixes->Length(); i++) {
+    std::string prefix = NormalizePathArgument(
+        Nan::Get(prefixes, i).ToLocalChecked());
+    int owner = Nan::To<int32_t>(Nan::Get(owners, i).ToLocalChecked())
+        .FromJust();
+    repo->path_table.Add(prefix, owner);
+  }
+  info.GetReturnValue().SetUndefined();
+}
+
+NAN_METHOD(Repository::Relativize) {
+  Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "relativize");
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
+  std::string path = NormalizePathArgument(info[0]);
+  bool caseInsensitive = Nan::To<bool>(info[1]).FromJust();
+
+  PathTable::Match root, deepest;
+  repo->path_table.Route(path, caseInsensitive, &root, &deepest);
+  if (root.owner == -1)
+    return info.GetReturnValue().Set(Nan::New<String>(path).ToLocalChecked());
+
+  size_t offset = root.length < path.size() ? root.length + 1 : path.size();
+  info.GetReturnValue().Set(Nan::New<String>(
+      path.data() + offset, path.size() - offset).ToLocalChecked());
+}
+
+NAN_METHOD(Repository::IsWorkingDirectory) {
+  Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "isWorkingDirectory");
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
+  std::string path = NormalizePathArgument(info[0]);
+  bool caseInsensitive = Nan::To<bool>(info[1]).FromJust();
+
+  PathTable::Match root, deepest;
+  repo->path_table.Route(path, caseInsensitive, &root, &deepest);
+  info.GetReturnValue().Set(Nan::New<Boolean>(
+      deepest.owner == 0 && deepest.length == path.size()));
+}
+
+NAN_METHOD(Repository::SubmoduleIndexForPath) {
+  Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "submoduleForPath");
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
+  std::string path = NormalizePathArgument(info[0]);
+  bool caseInsensitive = Nan::To<bool>(info[1]).FromJust();
+
+  PathTable::Match root, deepest;
+  repo->path_table.Route(path, caseInsensitive, &root, &deepest);
+  if (root.owner == -1 && !IsAbsolutePath(path)) {
+    path = repo->path_table.RootPrefix() + "/" + path;
+    repo->path_table.Route(path, caseInsensitive, &root, &deepest);
+  }
+
+  int owner = deepest.owner > 0 ? deepest.owner : 0;
+  info.GetReturnValue().Set(Nan::New<Integer>(owner));
+}
+
+NAN_METHOD(Repository::StartTracing) {
+  Nan::HandleScope scope;
+  Tracing::Start();
+  info.GetReturnValue().SetUndefined();
+}
+
+NAN_METHOD(Repository::StopTracing) {
+  Nan::HandleScope scope;
+  Tracing::Stop();
+  info.GetReturnValue().SetUndefined();
+}
+
+NAN_METHOD(Repository::DumpTrace) {
+  Nan::HandleScope scope;
+  info.GetReturnValue().Set(
+      Nan::New<String>(Tracing::Dump()).ToLocalChecked());
+}
+
+// libgit2 has no getter for the per-type object cache limits, so the values
+// last set through setCacheOptions are kept here. They start out at
+// libgit2's defaults.
+namespace {
+
+struct ObjectCacheLimit {
+  const char* name;
+  git_otype type;
+  size_t limit;
+};
+
+std::mutex object_cache_mutex;
+bool object_cache_enabled = true;
+ObjectCacheLimit object_cache_limits[] = {
+  {"commit", GIT_OBJ_COMMIT, 4096},
+  {"tree", GIT_OBJ_TREE, 4096},
+  {"blob", GIT_OBJ_BLOB, 0},
+  {"tag", GIT_OBJ_TAG, 4096},
+};
+
+bool GetSizeOption(Local<Object> options, const char* name, size_t* value) {
+  Local<Value> js_value =
+    Nan::Get(options, Nan::New(name).ToLocalChecked()).ToLocalChecked();
+  if (!js_value->IsNumber())
+    return false;
+  double number = Nan::To<double>(js_value).FromJust();
+  if (number < 0)
+    return false;
+  *value = static_cast<size_t>(number);
+  return true;
+}
+
+}  // namespace
+
+NAN_METHOD(Repository::SetCacheOptions) {
+  Nan::HandleScope scope;
+  if (!info[0]->IsObject())
+    return Nan::ThrowTypeError("Cache options must be an object");
+  Local<Object> options = Local<Object>::Cast(info[0]);
+
+  std::lock_guard<std::mutex> lock(object_cache_mutex);
+  Local<Value> enabled =
+    Nan::Get(options, Nan::New("enabled").ToLocalChecked()).ToLocalChecked();
+  if (enabled->IsBoolean()) {
+    object_cache_enabled = Nan::To<bool>(enabled).FromJust();
+    git_libgit2_opts(GIT_OPT_ENABLE_CACHING, object_cache_enabled ? 1 : 0);
+  }
+
+  size_t max_size;
+  if (GetSizeOption(options, "maxSize", &max_size))
+    git_libgit2_opts(GIT_OPT_SET_CACHE_MAX_SIZE,
+                     static_cast<ssize_t>(max_size));
+
+  Local<Value> limits =
+    Nan::Get(options, Nan::New("objectLimits").ToLocalChecked())
+      .ToLocalChecked();
+  if (limits->IsObject()) {
+    for (ObjectCacheLimit& limit : object_cache_limits) {
+      size_t value;
+      if (GetSizeOption(Local<Object>::Cast(limits), limit.name, &value)) {
+        git_libgit2_opts(GIT_OPT_SET_CACHE_OBJECT_LIMIT, limit.type, value);
+        limit.limit = value;
+      }
+    }
+  }
+
+  size_t window_size;
+  if (GetSizeOption(options, "packWindowSize", &window_size))
+    git_libgit2_opts(GIT_OPT_SET_MWINDOW_SIZE, window_size);
+  size_t mapped_limit;
+  if (GetSizeOption(options, "packMappedLimit", &mapped_limit))
+    git_libgit2_opts(GIT_OPT_SET_MWINDOW_MAPPED_LIMIT, mapped_limit);
+
+  info.GetReturnValue().SetUndefined();
+}
+
+NAN_METHOD(Repository::GetCacheOptions) {
+  Nan::HandleScope scope;
+  Local<Object> result = Nan::New<Object>();
+  Local<Object> limits = Nan::New<Object>();
+  {
+    std::lock_guard<std::mutex> lock(object_cache_mutex);
+    Nan::Set(result, Nan::New("enabled").ToLocalChecked(),
+             Nan::New<Boolean>(object_cache_enabled));
+    for (const ObjectCacheLimit& limit : object_cache_limits)
+      Nan::Set(limits, Nan::New(limit.name).ToLocalChecked(),
+               Nan::New<Number>(limit.limit));
+  }
+
+  ssize_t cached_memory = 0;
+  ssize_t max_size = 0;
+  git_libgit2_opts(GIT_OPT_GET_CACHED_MEMORY, &cached_memory, &max_size);
+  size_t window_size = 0;
+  git_libgit2_opts(GIT_OPT_GET_MWINDOW_SIZE, &window_size);
+  size_t mapped_limit = 0;
+  git_libgit2_opts(GIT_OPT_GET_MWINDOW_MAPPED_LIMIT, &mapped_limit);
+
+  Nan::Set(result, Nan::New("maxSize").ToLocalChecked(),
+           Nan::New<Number>(max_size));
+  Nan::Set(result, Nan::New("objectLimits").ToLocalChecked(), limits);
+  Nan::Set(result, Nan::New("packWindowSize").ToLocalChecked(),
+           Nan::New<Number>(window_size));
+  Nan::Set(result, Nan::New("packMappedLimit").ToLocalChecked(),
+           Nan::New<Number>(mapped_limit));
+  info.GetReturnValue().Set(result);
+}
+
+NAN_METHOD(Repository::SetThreadPoolSize) {
+  Nan::HandleScope scope;
+  double size = Nan::To<double>(info[0]).FromJust();
+  AsyncWorkerPool::SetSize(size > 0 ? std::min(size, 64.0) : 0);
+}
+
+NAN_METHOD(Repository::GetThreadPoolSize) {
+  Nan::HandleScope scope;
+  info.GetReturnValue().Set(
+    Nan::New<Number>(static_cast<double>(AsyncWorkerPool::Size())));
+}
+
+class WarmPacksWorker {
+  git_repository *repository;
+  int code;
+
+ public:
+  void Execute() {
+    git_odb* odb;
+    code = git_repository_odb(&odb, repository);
+    if (code != GIT_OK)
+      return;
+
+    // This is the async handle's own object database, which only one piece
+    // of this repository's async work uses at a time, so rescanning its
+    // packs can't race with a reader. Looking up an object that can't exist
+    // picks up packs added since it was opened and makes every pack backend
+    // open and map its index. Reading HEAD's header maps the pack window
+    // that recent history lives in.
+    git_oid missing;
+    memset(&missing, 0, sizeof(missing));
+    git_odb_exists(odb, &missing);
+
+    git_oid head;
+    if (git_reference_name_to_id(&head, repository, "HEAD") == GIT_OK) {
+      size_t size;
+      git_otype type;
+      git_odb_read_header(&size, &type, odb, &head);
+    }
+    git_odb_free(odb);
+  }
+
+  std::pair<Local<Value>, Local<Value>> Finish() {
+    if (code != GIT_OK) {
+      const git_error* error = giterr_last();
+      return {Nan::Error(error ? error->message : "Warming packs failed"),
+              Nan::Null()};
+    }
+    return {Nan::Null(), Nan::Undefined()};
+  }
+
+  explicit WarmPacksWorker(git_repository *repository)
+    : repository{repository}, code{GIT_OK} {}
+};
+
+NAN_METHOD(Repository::CancelPendingWork) {
+  Nan::HandleScope scope;
+  Nan::ObjectWrap::Unwrap<Repository>(info.This())->cancellation.Cancel();
+}
+
+NAN_METHOD(Repository::WarmPacks) {
+  auto callback = new Nan::Callback(Local<Function>::Cast(info[0]));
+  QueueAsyncWorker(info, new RepositoryAsyncWorker<WarmPacksWorker>(
+    callback, GetStats(info), GetCancellationToken(info),
+    "warmPacks", GetAsyncRepository(info)));
+}
+
+static size_t ObjectCacheMemory() {
+  ssize_t current = 0, allowed = 0;
+  git_libgit2_opts(GIT_OPT_GET_CACHED_MEMORY, &current, &allowed);
+  return current > 0 ? current : 0;
+}
+
+Repository::MemoryUsage Repository::MeasureMemory() {
+  MemoryUsage usage;
+  usage.status_cache = status_cache.MemoryUsage();
+  usage.grep_cache = grep_cache.MemoryUsage();
+  usage.blame_cache = blame_cache.MemoryUsage();
+  usage.tracked_paths = tracked_paths_cache.MemoryUsage();
+  usage.commit_cache = commit_cache.MemoryUsage();
+  usage.commit_graph = commit_graph_cache.MemoryUsage();
+  usage.hash_cache = hash_cache.MemoryUsage();
+
+  // libgit2 doesn't report the size of a loaded index, so use the size of
+  // the file it was read from while the handles may have it loaded.
+  usage.index = 0;
+  if (repository && !trimmed) {
+    struct stat st;
+    std::string index_path = std::string(git_repository_path(repository)) +
+                             "index";
+    if (stat(index_path.c_str(), &st) == 0)
+      usage.index = st.st_size;
+  }
+  return usage;
+}
+
+void Repository::Trim() {
+  status_cache.Invalidate();
+  grep_cache.Clear();
+  blame_cache.Clear();
+  tracked_paths_cache.Clear();
+  commit_cache.Clear();
+  commit_graph_cache.Clear();
+  hash_cache.Clear();
+  if (!repository || trimmed)
+    return;
+
+  git_repository__cleanup(repository);
+  if (async_idle) {
+    git_repository__cleanup(async_repository);
+    shared.reset();
+    trimmed = true;
+  } else if (shared) {
+    shared->Attach(repository);
+  }
+}
+
+void Repository::Touch() {
+  last_used = PerformanceStats::Now();
+  if (!trimmed || !repository)
+    return;
+
+  trimmed = false;
+  shared = RepositoryRegistry::Acquire(repository);
+  if (shared)
+    shared->Attach(repository);
+}
+
+NAN_METHOD(Repository::GetMemoryUsage) {
+  Nan::HandleScope scope;
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
+  MemoryUsage usage = repo->MeasureMemory();
+  Local<Object> result = Nan::New<Object>();
+  auto set = [&](const char* name, size_t bytes) {
+    Nan::Set(result, Nan::New(name).ToLocalChecked(), Nan::New<Number>(bytes));
+  };
+  set("statusCache", usage.status_cache);
+  set("grepCache", usage.grep_cache);
+  set("blameCache", usage.blame_cache);
+  set("trackedPaths", usage.tracked_paths);
+  set("commitCache", usage.commit_cache);
+  set("commitGraph", usage.commit_graph);
+  set("hashCache", usage.hash_cache);
+  set("index", usage.index);
+  set("total", usage.Total());
+  info.GetReturnValue().Set(result);
+}
+
+NAN_METHOD(Repository::TrimMemory) {
+  Nan::HandleScope scope;
+  OperationTimer timer(GetStats(info), "_trimMemory");
+  Nan::ObjectWrap::Unwrap<Repository>(info.This())->Trim();
+  info.GetReturnValue().SetUndefined();
+}
+
+NAN_METHOD(Repository::SetAsyncIdle) {
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
+  repo->async_idle = Nan::To<bool>(info[0]).FromJust();
+  repo->last_used = PerformanceStats::Now();
+}
+
+// Trims the idle repositories of this thread that haven't been used for at
+// least the given number of milliseconds, least recently used first. With a
+// byte budget, stops as soon as the repositories and libgit2's object cache
+// fit in it. Returns the number of repositories trimmed.
+NAN_METHOD(Repository::TrimRepositories) {
+  Nan::HandleScope scope;
+  size_t max_bytes = 0;
+  if (info[0]->IsNumber() && Nan::To<double>(info[0]).FromJust() > 0)
+    max_bytes = Nan::To<double>(info[0]).FromJust();
+  uint64_t min_idle = 0;
+  if (info[1]->IsNumber() && Nan::To<double>(info[1]).FromJust() > 0)
+    min_idle = Nan::To<double>(info[1]).FromJust() * 1000 * 1000;
+
+  uint64_t now = PerformanceStats::Now();
+  size_t object_cache = ObjectCacheMemory();
+  size_t total = object_cache;
+  std::vector<Repository*> candidates;
+  for (Repository* repo : live_repositories) {
+    total += repo->MeasureMemory().Total();
+    if (repo->async_idle && !repo->trimmed &&
+        now - repo->last_used >= min_idle)
+      candidates.push_back(repo);
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [](Repository* a, Repository* b) {
+    return a->last_used < b->last_used;
+  });
+
+  unsigned trimmed_count = 0;
+  for (Repository* repo : candidates) {
+    if (max_bytes > 0 && total <= max_bytes)
+      break;
+    total -= repo->MeasureMemory().Total();
+    repo->Trim();
+    total += repo->MeasureMemory().Total();
+    size_t trimmed_object_cache = ObjectCacheMemory();
+    total = total - object_cache + trimmed_object_cache;
+    object_cache = trimmed_object_cache;
+    trimmed_count++;
+  }
+  info.GetReturnValue().Set(Nan::New<Number>(trimmed_count));
+}
+
+NAN_METHOD(Repository::GetProcessMemoryUsage) {
+  Nan::HandleScope scope;
+  size_t repositories = 0;
+  for (Repository* repo : live_repositories)
+    repositories += repo->MeasureMemory().Total();
+
+  ssize_t object_cache = 0, object_cache_limit = 0;
+  git_libgit2_opts(GIT_OPT_GET_CACHED_MEMORY, &object_cache,
+                   &object_cache_limit);
+  Local<Object> result = Nan::New<Object>();
+  auto set = [&](const char* name, double bytes) {
+    Nan::Set(result, Nan::New(name).ToLocalChecked(), Nan::New<Number>(bytes));
+  };
+  set("objectCache", object_cache);
+  set("objectCacheLimit", object_cache_limit);
+  set("repositories", repositories);
+  set("repositoryCount", live_repositories.size());
+  info.GetReturnValue().Set(result);
+}
+
+Repository::Repository(Local<String> path, Local<Boolean> search)
+  : async_idle(true), trimmed(false), last_used(PerformanceStats::Now()) {
+  Nan::HandleScope scope;
+  live_repositories.push_back(this);
 
   int flags = 0;
   if (!Nan::To<bool>(search).FromJust()) {
@@ -1111,9 +3093,47 @@ Repository::Repository(Local<String> path, Local<Boolean> search) {
     async_repository = NULL;
     return;
   }
+
+  // The synchronous handle reads objects through the object database shared
+  // by every Repository this thread opened at this path. The async handle
+  // is used from pool threads, so it keeps its own.
+  shared = RepositoryRegistry::Acquire(repository);
+  if (shared)
+    shared->Attach(repository);
+
+  stats.SetTraceId(Tracing::RegisterName(git_repository_path(repository)));
+
+  const char* workdir = git_repository_workdir(repository);
+  if (workdir != NULL)
+    path_table.Add(workdir, 0);
+}
+
+bool Repository::CloseAll() {
+  bool closed = true;
+  for (Repository* repo : live_repositories) {
+    repo->cancellation.Cancel();
+    if (repo->repository != NULL) {
+      git_repository_free(repo->repository);
+      repo->repository = NULL;
+    }
+    if (repo->async_repository != NULL) {
+      if (repo->async_idle) {
+        git_repository_free(repo->async_repository);
+        repo->async_repository = NULL;
+      } else {
+        closed = false;
+      }
+    }
+    repo->shared.reset();
+  }
+  live_repositories.clear();
+  return closed;
 }
 
 Repository::~Repository() {
+  live_repositories.erase(std::remove(live_repositories.begin(),
+                                      live_repositories.end(), this),
+                          live_repositories.end());
   if (repository != NULL) {
     git_repository_free(repository);
     repository = NULL;
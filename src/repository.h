@@ -22,18 +22,46 @@
 #ifndef SRC_REPOSITORY_H_
 #define SRC_REPOSITORY_H_
 
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "blame-cache.h"
+#include "cancellation.h"
+#include "commit-cache.h"
+#include "commit-graph.h"
 #include "git2.h"
+#include "grep.h"
+#include "hash-cache.h"
+#include "instrumentation.h"
 #include "nan.h"
+#include "path-table.h"
+#include "repository-registry.h"
+#include "status-cache.h"
+#include "tracked-paths.h"
 using namespace v8;  // NOLINT
 
 class Repository : public Nan::ObjectWrap {
  public:
   static void Init(Local<Object> target);
 
+  // Frees the libgit2 handles of every repository still open in this
+  // thread's JS environment, whose ObjectWrap destructors won't run when
+  // it is torn down. A handle that async work may still be using is left
+  // open; returns false if any was.
+  static bool CloseAll();
+
+  static Local<Value> ConvertStringVectorToV8Array(
+      const std::vector<std::string>& vector);
+
  private:
+  static NAN_METHOD(StartTracing);
+  static NAN_METHOD(StopTracing);
+  static NAN_METHOD(DumpTrace);
+  static NAN_METHOD(SetCacheOptions);
+  static NAN_METHOD(GetCacheOptions);
+  static NAN_METHOD(SetThreadPoolSize);
+  static NAN_METHOD(GetThreadPoolSize);
   static NAN_METHOD(New);
   static NAN_METHOD(GetPath);
   static NAN_METHOD(GetWorkingDirectory);
@@ -48,6 +76,13 @@ class Repository : public Nan::ObjectWrap {
   static NAN_METHOD(SetConfigValue);
   static NAN_METHOD(GetStatus);
   static NAN_METHOD(GetStatusAsync);
+  static NAN_METHOD(ScanStatusAsync);
+  static NAN_METHOD(GetCachedStatusAsync);
+  static NAN_METHOD(SetStatusCachePersistent);
+  static NAN_METHOD(SetStatusCacheEnabled);
+  static NAN_METHOD(SetHashCachePersistent);
+  static NAN_METHOD(MarkPathsChanged);
+  static NAN_METHOD(InvalidateStatusCache);
   static NAN_METHOD(GetStatusForPath);
   static NAN_METHOD(CheckoutHead);
   static NAN_METHOD(GetReferenceTarget);
@@ -56,12 +91,33 @@ class Repository : public Nan::ObjectWrap {
   static NAN_METHOD(GetHeadBlob);
   static NAN_METHOD(CompareCommits);
   static NAN_METHOD(CompareCommitsAsync);
+  static NAN_METHOD(GetCommitsAsync);
+  static NAN_METHOD(GetChangedPathsAsync);
+  static NAN_METHOD(GrepAsync);
+  static NAN_METHOD(GetTrackedPathsAsync);
+  static NAN_METHOD(GetBlameAsync);
+  static NAN_METHOD(GetPathHistoryStream);
   static NAN_METHOD(Release);
+  static NAN_METHOD(GetSharedReferenceCount);
   static NAN_METHOD(GetLineDiffs);
   static NAN_METHOD(GetLineDiffDetails);
   static NAN_METHOD(GetReferences);
   static NAN_METHOD(CheckoutReference);
   static NAN_METHOD(Add);
+  static NAN_METHOD(WarmPacks);
+  static NAN_METHOD(GetMemoryUsage);
+  static NAN_METHOD(TrimMemory);
+  static NAN_METHOD(SetAsyncIdle);
+  static NAN_METHOD(TrimRepositories);
+  static NAN_METHOD(GetProcessMemoryUsage);
+  static NAN_METHOD(CancelPendingWork);
+  static NAN_METHOD(GetPerformanceStats);
+  static NAN_METHOD(ResetPerformanceStats);
+  static NAN_METHOD(SetPerformanceStatsEnabled);
+  static NAN_METHOD(SetPathTable);
+  static NAN_METHOD(Relativize);
+  static NAN_METHOD(IsWorkingDirectory);
+  static NAN_METHOD(SubmoduleIndexForPath);
 
   static int DiffHunkCallback(const git_diff_delta *delta,
                               const git_diff_hunk *hunk,
@@ -73,22 +129,69 @@ class Repository : public Nan::ObjectWrap {
   static int SubmoduleCallback(git_submodule *submodule, const char *name,
                                void *payload);
 
-  static Local<Value> ConvertStringVectorToV8Array(
-      const std::vector<std::string>& vector);
-
   static git_repository* GetRepository(Nan::NAN_METHOD_ARGS_TYPE args);
   static git_repository* GetAsyncRepository(Nan::NAN_METHOD_ARGS_TYPE args);
+  static PerformanceStats* GetStats(Nan::NAN_METHOD_ARGS_TYPE args);
+  static CancellationToken GetCancellationToken(
+      Nan::NAN_METHOD_ARGS_TYPE args);
 
   static int GetBlob(Nan::NAN_METHOD_ARGS_TYPE args,
                       git_repository* repo, git_blob*& blob);
 
   static git_diff_options CreateDefaultGitDiffOptions();
 
+  static std::string NormalizePathArgument(Local<Value> path);
+
+  // Approximate native memory held by a repository, in bytes.
+  struct MemoryUsage {
+    size_t status_cache;
+    size_t grep_cache;
+    size_t blame_cache;
+    size_t tracked_paths;
+    size_t commit_cache;
+    size_t commit_graph;
+    size_t hash_cache;
+    size_t index;
+
+    size_t Total() const {
+      return status_cache + grep_cache + blame_cache + tracked_paths +
+             commit_cache + commit_graph + hash_cache + index;
+    }
+  };
+
+  MemoryUsage MeasureMemory();
+
+  // Drops the native result caches and the caches, index and config the
+  // libgit2 handles have loaded. The async handle is only cleaned up while
+  // no async work is using it, and then the shared object database is let
+  // go of too, which unmaps its pack files unless another open repository
+  // uses them. Everything is loaded again on demand.
+  void Trim();
+
+  // Marks the repository as used, and attaches it to a shared object
+  // database again after a trim.
+  void Touch();
+
   explicit Repository(Local<String> path, Local<Boolean> search);
   ~Repository();
 
   git_repository* repository;
   git_repository* async_repository;
+  std::shared_ptr<SharedRepository> shared;
+  PerformanceStats stats;
+  CancellationSource cancellation;
+  PathTable path_table;
+  StatusCache status_cache;
+  GrepCache grep_cache;
+  TrackedPathsCache tracked_paths_cache;
+  BlameCache blame_cache;
+  CommitGraphCache commit_graph_cache;
+  CommitCache commit_cache;
+  HashCache hash_cache;
+
+  bool async_idle;  // Set from JS whenever its async work queue drains.
+  bool trimmed;
+  uint64_t last_used;
 };
 
 #endif  // SRC_REPOSITORY_H_
@@ -0,0 +1,254 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "status-cache-file.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+
+#include "mapped-file.h"
+
+namespace {
+
+const char kMagic[4] = {'G', 'U', 'S', 'C'};
+const uint32_t kVersion = 2;
+
+struct FileHeader {
+  char magic[4];
+  uint32_t version;
+  unsigned char index_checksum[GIT_OID_RAWSZ];
+  unsigned char head[GIT_OID_RAWSZ];
+  uint32_t entry_count;
+  uint32_t reserved;
+  int64_t scan_time;
+};
+
+// Each record is followed by its path, padded to a multiple of 8 bytes.
+struct EntryHeader {
+  uint32_t status;
+  uint32_t path_length;
+  int64_t mtime_seconds;
+  uint32_t mtime_nanoseconds;
+  uint32_t exists;
+  uint64_t size;
+  uint64_t inode;
+};
+
+size_t Padded(size_t length) {
+  return (length + 7) & ~static_cast<size_t>(7);
+}
+
+void StatFile(const std::string& path, EntryHeader* entry) {
+  entry->exists = 0;
+  entry->mtime_seconds = 0;
+  entry->mtime_nanoseconds = 0;
+  entry->size = 0;
+  entry->inode = 0;
+
+#ifdef _WIN32
+  struct _stat64 st;
+  if (_stat64(path.c_str(), &st) != 0)
+    return;
+#else
+  struct stat st;
+  if (lstat(path.c_str(), &st) != 0)
+    return;
+#endif
+
+  entry->exists = 1;
+  entry->mtime_seconds = st.st_mtime;
+#if defined(__APPLE__)
+  entry->mtime_nanoseconds = st.st_mtimespec.tv_nsec;
+#elif !defined(_WIN32)
+  entry->mtime_nanoseconds = st.st_mtim.tv_nsec;
+#endif
+  entry->size = st.st_size;
+  entry->inode = st.st_ino;
+}
+
+}  // namespace
+
+std::string StatusCacheFile::PathFor(git_repository* repository) {
+  return std::string(git_repository_path(repository)) + "git-utils-status.cache";
+}
+
+bool StatusCacheFile::Write(const std::string& path,
+                            const std::string& workdir,
+                            const git_oid& index_checksum,
+                            const git_oid& head,
+                            int64_t scan_time,
+                            const StatusList& statuses) {
+  std::string contents;
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  memcpy(header.index_checksum, index_checksum.id, GIT_OID_RAWSZ);
+  memcpy(header.head, head.id, GIT_OID_RAWSZ);
+  header.entry_count = statuses.size();
+  header.scan_time = scan_time;
+  contents.append(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  std::string entry_path = workdir;
+  int64_t latest_mtime = 0;
+  for (const StatusList::Entry& status : statuses) {
+    entry_path.resize(workdir.size());
+    entry_path.append(status.path, status.length);
+
+    EntryHeader entry;
+    StatFile(entry_path, &entry);
+    latest_mtime = std::max(latest_mtime, entry.mtime_seconds);
+    entry.status = status.status;
+    entry.path_length = status.length;
+    contents.append(reinterpret_cast<const char*>(&entry), sizeof(entry));
+    contents.append(status.path, status.length);
+    contents.append(Padded(status.length) - status.length, '\0');
+  }
+
+  // Full scans usually find what the last one saved, so only write the
+  // file when the snapshot or the stat data of its paths changed. The saved
+  // scan time is older, which only makes reading it more cautious, unless
+  // it would now count a path as modified during the scan.
+  {
+    MappedFile existing(path);
+    if (existing.data && existing.size == contents.size()) {
+      FileHeader existing_header;
+      memcpy(&existing_header, existing.data, sizeof(existing_header));
+      int64_t saved_scan_time = existing_header.scan_time;
+      existing_header.scan_time = scan_time;
+      if (latest_mtime < saved_scan_time &&
+          memcmp(&existing_header, contents.data(), sizeof(header)) == 0 &&
+          memcmp(existing.data + sizeof(header),
+                 contents.data() + sizeof(header),
+                 contents.size() - sizeof(header)) == 0)
+        return true;
+    }
+  }
+
+  std::string temporary_path = path + ".lock";
+  FILE* file = fopen(temporary_path.c_str(), "wb");
+  if (!file)
+    return false;
+  bool written =
+    fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+  written = fclose(file) == 0 && written;
+
+#ifdef _WIN32
+  if (written)
+    remove(path.c_str());
+#endif
+  if (!written || rename(temporary_path.c_str(), path.c_str()) != 0) {
+    remove(temporary_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool StatusCacheFile::Read(const std::string& path,
+                           const std::string& workdir,
+                           const git_oid& index_checksum,
+                           const git_oid& head,
+                           StatusList* statuses,
+                           std::vector<std::string>* stale_paths) {
+  MappedFile file(path);
+  if (!file.data || file.size < sizeof(FileHeader))
+    return false;
+
+  FileHeader header;
+  memcpy(&header, file.data, sizeof(header));
+  if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion ||
+      memcmp(header.index_checksum, index_checksum.id, GIT_OID_RAWSZ) != 0 ||
+      memcmp(header.head, head.id, GIT_OID_RAWSZ) != 0)
+    return false;
+
+  std::string entry_path = workdir;
+  size_t offset = sizeof(header);
+  for (uint32_t i = 0; i < header.entry_count; i++) {
+    EntryHeader entry;
+    if (file.size - offset < sizeof(entry))
+      return false;
+    memcpy(&entry, file.data + offset, sizeof(entry));
+    offset += sizeof(entry);
+    if (file.size - offset < Padded(entry.path_length))
+      return false;
+
+    const char* path_data = file.data + offset;
+    offset += Padded(entry.path_length);
+    entry_path.resize(workdir.size());
+    entry_path.append(path_data, entry.path_length);
+
+    // A file modified at or after the scan started may have changed again
+    // after it was scanned without its stat data changing.
+    EntryHeader current;
+    StatFile(entry_path, &current);
+    if (entry.mtime_seconds >= header.scan_time ||
+        current.exists != entry.exists ||
+        current.mtime_seconds != entry.mtime_seconds ||
+        current.mtime_nanoseconds != entry.mtime_nanoseconds ||
+        current.size != entry.size ||
+        current.inode != entry.inode)
+      stale_paths->emplace_back(path_data, entry.path_length);
+
+    statuses->Add(path_data, entry.path_length, entry.status);
+  }
+  statuses->Sort();
+  return true;
+}
+
+void StatusCacheFile::FindChangedEntries(
+    git_index* index, const std::string& workdir, const StatusList& statuses,
+    std::vector<std::string>* stale_paths) {
+  int64_t index_mtime = 0;
+  struct stat st;
+  if (git_index_path(index) && stat(git_index_path(index), &st) == 0)
+    index_mtime = st.st_mtime;
+
+  std::string entry_path = workdir;
+  size_t count = git_index_entrycount(index);
+  for (size_t i = 0; i < count; i++) {
+    const git_index_entry* index_entry = git_index_get_byindex(index, i);
+    if (index_entry->flags_extended & GIT_INDEX_ENTRY_SKIP_WORKTREE)
+      continue;
+
+    std::string path = index_entry->path;
+    size_t position = statuses.LowerBound(path);
+    if (position < statuses.size() &&
+        StatusList::Compare(statuses[position].path, statuses[position].length,
+                            path.data(), path.size()) == 0)
+      continue;
+
+    entry_path.resize(workdir.size());
+    entry_path.append(path);
+    EntryHeader current;
+    StatFile(entry_path, &current);
+    if (!current.exists ||
+        current.size != index_entry->file_size ||
+        current.mtime_seconds != index_entry->mtime.seconds ||
+        current.mtime_seconds >= index_mtime)
+      stale_paths->push_back(std::move(path));
+  }
+}
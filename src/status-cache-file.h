@@ -0,0 +1,67 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_STATUS_CACHE_FILE_H_
+#define SRC_STATUS_CACHE_FILE_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "git2.h"
+#include "status-list.h"
+
+// Persists a status snapshot under the repository's .git directory so a
+// later session can show it before its first full scan finishes.
+//
+// The file holds the index checksum and HEAD the snapshot was taken at,
+// followed by one record per path with its status and the stat data of the
+// working directory file at the time. It is read through a memory mapping
+// and written to a temporary file that is renamed into place.
+class StatusCacheFile {
+ public:
+  static std::string PathFor(git_repository* repository);
+
+  // |scan_time| is when the scan that found |statuses| started, in seconds.
+  static bool Write(const std::string& path, const std::string& workdir,
+                    const git_oid& index_checksum, const git_oid& head,
+                    int64_t scan_time, const StatusList& statuses);
+
+  // Loads the snapshot if it was taken at |index_checksum| and |head|. Paths
+  // whose working directory file changed since, or was modified no earlier
+  // than the scan started, are still loaded and also listed in
+  // |stale_paths| so their status can be checked again.
+  static bool Read(const std::string& path, const std::string& workdir,
+                   const git_oid& index_checksum, const git_oid& head,
+                   StatusList* statuses,
+                   std::vector<std::string>* stale_paths);
+
+  // Tracked files that were unchanged when the snapshot was saved are not
+  // in it. Lists those whose working directory file no longer matches the
+  // stat data in |index|, or is too recent to be trusted, in |stale_paths|.
+  // New untracked files are not found this way.
+  static void FindChangedEntries(git_index* index, const std::string& workdir,
+                                 const StatusList& statuses,
+                                 std::vector<std::string>* stale_paths);
+};
+
+#endif  // SRC_STATUS_CACHE_FILE_H_
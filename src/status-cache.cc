@@ -0,0 +1,182 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "status-cache.h"
+
+#include <string.h>
+
+namespace {
+
+// Past this many changed paths a full scan is cheaper than matching every
+// index entry and directory against a long literal pathspec.
+const size_t kMaxChangedPaths = 1000;
+
+}  // namespace
+
+StatusCache::StatusCache()
+  : enabled(false), persistent(false), valid(false), generation(0) {
+  memset(&index_checksum, 0, sizeof(index_checksum));
+  memset(&head, 0, sizeof(head));
+}
+
+bool StatusCache::IsEnabled() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return enabled;
+}
+
+void StatusCache::SetEnabled(bool enabled) {
+  std::lock_guard<std::mutex> lock(mutex);
+  this->enabled = enabled;
+  InvalidateLocked();
+}
+
+bool StatusCache::IsPersistent() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return persistent;
+}
+
+void StatusCache::SetPersistent(bool persistent) {
+  std::lock_guard<std::mutex> lock(mutex);
+  this->persistent = persistent;
+}
+
+bool StatusCache::AffectsOtherPaths(const std::string& path) {
+  if (path.empty() || path == ".git" || path.compare(0, 5, ".git/") == 0)
+    return true;
+
+  size_t slash = path.rfind('/');
+  const char* name = path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+  return strcmp(name, ".gitignore") == 0 || strcmp(name, ".gitmodules") == 0;
+}
+
+void StatusCache::MarkChanged(const std::vector<std::string>& paths) {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (const std::string& path : paths) {
+    if (AffectsOtherPaths(path)) {
+      InvalidateLocked();
+      return;
+    }
+    changed_paths.insert(path);
+  }
+}
+
+void StatusCache::Invalidate() {
+  std::lock_guard<std::mutex> lock(mutex);
+  InvalidateLocked();
+}
+
+void StatusCache::InvalidateLocked() {
+  valid = false;
+  generation++;
+  statuses.Clear();
+  changed_paths.clear();
+}
+
+size_t StatusCache::MemoryUsage() {
+  std::lock_guard<std::mutex> lock(mutex);
+  size_t bytes = statuses.MemoryUsage();
+  for (const std::string& path : changed_paths)
+    bytes += sizeof(path) + path.capacity();
+  return bytes;
+}
+
+bool StatusCache::Prepare(const git_oid& index_checksum, const git_oid& head,
+                          std::vector<std::string>* changed_paths,
+                          uint64_t* generation) {
+  std::lock_guard<std::mutex> lock(mutex);
+  *generation = this->generation;
+  if (!enabled || !valid ||
+      !git_oid_equal(&this->index_checksum, &index_checksum) ||
+      !git_oid_equal(&this->head, &head) ||
+      this->changed_paths.size() > kMaxChangedPaths) {
+    valid = false;
+    statuses.Clear();
+    this->changed_paths.clear();
+    return false;
+  }
+
+  changed_paths->assign(this->changed_paths.begin(),
+                        this->changed_paths.end());
+  this->changed_paths.clear();
+  return true;
+}
+
+void StatusCache::Store(uint64_t generation, const git_oid& index_checksum,
+                        const git_oid& head, const StatusList& statuses) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!enabled || generation != this->generation)
+    return;
+
+  git_oid_cpy(&this->index_checksum, &index_checksum);
+  git_oid_cpy(&this->head, &head);
+  this->statuses = statuses;
+  valid = true;
+}
+
+bool StatusCache::Update(const std::vector<std::string>& changed_paths,
+                         const StatusList& rescanned, StatusList* result) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // The snapshot was invalidated during the rescan, so the paths that
+  // weren't rescanned can't be trusted anymore.
+  if (!valid)
+    return false;
+
+  if (changed_paths.empty()) {
+    *result = statuses;
+    return true;
+  }
+
+  std::vector<bool> replaced(statuses.size(), false);
+  for (const std::string& path : changed_paths) {
+    for (size_t i = statuses.LowerBound(path); i < statuses.size(); i++) {
+      const StatusList::Entry& entry = statuses[i];
+      if (entry.length < path.size() ||
+          memcmp(entry.path, path.data(), path.size()) != 0)
+        break;
+      if (entry.length == path.size() || entry.path[path.size()] == '/')
+        replaced[i] = true;
+    }
+  }
+
+  // Both lists are sorted, so merging them keeps the snapshot sorted.
+  StatusList merged;
+  size_t i = 0, j = 0;
+  while (i < statuses.size() || j < rescanned.size()) {
+    if (i < statuses.size() && replaced[i]) {
+      i++;
+    } else if (j == rescanned.size() ||
+               (i < statuses.size() &&
+                StatusList::Compare(statuses[i].path, statuses[i].length,
+                                    rescanned[j].path, rescanned[j].length) < 0)) {
+      merged.Add(statuses[i++]);
+    } else {
+      if (i < statuses.size() &&
+          StatusList::Compare(statuses[i].path, statuses[i].length,
+                              rescanned[j].path, rescanned[j].length) == 0)
+        i++;
+      merged.Add(rescanned[j++]);
+    }
+  }
+  statuses = std::move(merged);
+  *result = statuses;
+  return true;
+}
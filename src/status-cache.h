@@ -0,0 +1,95 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_STATUS_CACHE_H_
+#define SRC_STATUS_CACHE_H_
+
+#include <stdint.h>
+
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "git2.h"
+#include "status-list.h"
+
+// The result of the last full-repository status scan, kept up to date from
+// the changed paths reported by a file system monitor. While the index and
+// HEAD are unchanged, a status scan only needs to revisit the reported paths
+// instead of walking the whole working directory.
+//
+// The snapshot is used from the async worker threads and updated from the
+// main thread, so every method takes the lock.
+class StatusCache {
+ public:
+  StatusCache();
+
+  bool IsEnabled();
+  void SetEnabled(bool enabled);
+
+  // Whether full scans are also saved to the repository's status cache file.
+  bool IsPersistent();
+  void SetPersistent(bool persistent);
+
+  // Records repository-relative paths reported as changed by the monitor.
+  // Changes that affect the status of other paths too, such as edits to a
+  // .gitignore file, discard the snapshot.
+  void MarkChanged(const std::vector<std::string>& paths);
+  void Invalidate();
+
+  // An estimate of the heap memory held by the snapshot.
+  size_t MemoryUsage();
+
+  // Returns false when the snapshot can't be used with the given index
+  // checksum and HEAD and a full scan is needed. Otherwise hands over the
+  // paths to rescan, which may be none at all. Paths reported after this
+  // call are kept for the next scan either way.
+  bool Prepare(const git_oid& index_checksum, const git_oid& head,
+               std::vector<std::string>* changed_paths, uint64_t* generation);
+
+  // Replaces the snapshot with the result of a full scan started at
+  // |generation|, unless the snapshot was invalidated since.
+  void Store(uint64_t generation, const git_oid& index_checksum,
+             const git_oid& head, const StatusList& statuses);
+
+  // Replaces the snapshot entries at or below |changed_paths| with the
+  // result of rescanning them and copies the updated snapshot to |result|.
+  // Returns false when the snapshot was invalidated in the meantime.
+  bool Update(const std::vector<std::string>& changed_paths,
+              const StatusList& rescanned, StatusList* result);
+
+ private:
+  static bool AffectsOtherPaths(const std::string& path);
+  void InvalidateLocked();
+
+  std::mutex mutex;
+  bool enabled;
+  bool persistent;
+  bool valid;
+  uint64_t generation;
+  git_oid index_checksum;
+  git_oid head;
+  StatusList statuses;
+  std::set<std::string> changed_paths;
+};
+
+#endif  // SRC_STATUS_CACHE_H_
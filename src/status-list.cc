@@ -0,0 +1,124 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "status-list.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace {
+
+const size_t kBlockSize = 64 * 1024;
+
+}  // namespace
+
+StatusList::StatusList()
+  : block_used(0), block_size(0), allocations(0) {}
+
+StatusList::StatusList(const StatusList& other)
+  : block_used(0), block_size(0), allocations(0) {
+  *this = other;
+}
+
+StatusList& StatusList::operator=(const StatusList& other) {
+  if (this == &other)
+    return *this;
+
+  Clear();
+  if (entries.capacity() < other.size())
+    allocations++;
+  entries.reserve(other.size());
+  for (const Entry& entry : other)
+    Add(entry);
+  return *this;
+}
+
+char* StatusList::Allocate(size_t size) {
+  // Paths longer than a block get a block of their own, so the current one
+  // can still be filled up.
+  if (size > kBlockSize / 4) {
+    allocations++;
+    char* block = new char[size];
+    blocks.emplace(blocks.end() - (blocks.empty() ? 0 : 1), block);
+    return block;
+  }
+
+  if (blocks.empty() || block_size - block_used < size) {
+    allocations++;
+    blocks.emplace_back(new char[kBlockSize]);
+    block_used = 0;
+    block_size = kBlockSize;
+  }
+  char* result = blocks.back().get() + block_used;
+  block_used += size;
+  return result;
+}
+
+void StatusList::Add(const char* path, size_t length, unsigned int status) {
+  char* copy = Allocate(length + 1);
+  memcpy(copy, path, length);
+  copy[length] = '\0';
+
+  if (entries.size() == entries.capacity())
+    allocations++;
+  entries.push_back({copy, static_cast<uint32_t>(length), status});
+}
+
+int StatusList::Compare(const char* a, size_t a_length,
+                        const char* b, size_t b_length) {
+  int result = memcmp(a, b, std::min(a_length, b_length));
+  if (result != 0)
+    return result;
+  return a_length < b_length ? -1 : (a_length > b_length ? 1 : 0);
+}
+
+void StatusList::Sort() {
+  auto less = [](const Entry& a, const Entry& b) {
+    return Compare(a.path, a.length, b.path, b.length) < 0;
+  };
+
+  // libgit2 usually reports paths in order already.
+  if (!std::is_sorted(entries.begin(), entries.end(), less))
+    std::stable_sort(entries.begin(), entries.end(), less);
+}
+
+void StatusList::Clear() {
+  entries.clear();
+  blocks.clear();
+  block_used = 0;
+  block_size = 0;
+}
+
+size_t StatusList::MemoryUsage() const {
+  // Paths too long to share a block have smaller blocks of their own, so
+  // this overestimates lists with many of them.
+  return blocks.size() * kBlockSize + entries.capacity() * sizeof(Entry);
+}
+
+size_t StatusList::LowerBound(const std::string& path) const {
+  auto iter = std::lower_bound(
+    entries.begin(), entries.end(), path,
+    [](const Entry& entry, const std::string& path) {
+      return Compare(entry.path, entry.length, path.data(), path.size()) < 0;
+    });
+  return iter - entries.begin();
+}
@@ -0,0 +1,85 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_STATUS_LIST_H_
+#define SRC_STATUS_LIST_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// The paths and statuses found by a status scan. Paths are copied into large
+// blocks by a bump allocator and indexed by a flat vector, so collecting a
+// scan of any size costs a handful of heap allocations instead of a few per
+// path. Entries are kept sorted by path in byte order.
+class StatusList {
+ public:
+  struct Entry {
+    const char* path;  // NUL-terminated, owned by the list.
+    uint32_t length;
+    uint32_t status;
+  };
+
+  StatusList();
+  StatusList(const StatusList& other);
+  StatusList(StatusList&& other) = default;
+  StatusList& operator=(const StatusList& other);
+  StatusList& operator=(StatusList&& other) = default;
+
+  // Appends an entry. Callers adding paths out of order must call Sort()
+  // before looking anything up.
+  void Add(const char* path, size_t length, unsigned int status);
+  void Add(const Entry& entry) { Add(entry.path, entry.length, entry.status); }
+  void Sort();
+  void Clear();
+
+  size_t size() const { return entries.size(); }
+  bool empty() const { return entries.empty(); }
+  const Entry& operator[](size_t index) const { return entries[index]; }
+  std::vector<Entry>::const_iterator begin() const { return entries.begin(); }
+  std::vector<Entry>::const_iterator end() const { return entries.end(); }
+
+  // Returns the index of the first entry at or after |path|.
+  size_t LowerBound(const std::string& path) const;
+
+  // The number of heap allocations the list made, for benchmarking.
+  size_t Allocations() const { return allocations; }
+
+  // An estimate of the heap memory held by the list.
+  size_t MemoryUsage() const;
+
+  static int Compare(const char* a, size_t a_length,
+                     const char* b, size_t b_length);
+
+ private:
+  char* Allocate(size_t size);
+
+  std::vector<std::unique_ptr<char[]>> blocks;
+  size_t block_used;
+  size_t block_size;
+  std::vector<Entry> entries;
+  size_t allocations;
+};
+
+#endif  // SRC_STATUS_LIST_H_
@@ -0,0 +1,345 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "status-renames.h"
+
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include "cancellation.h"
+
+struct StatusRenames::Candidate {
+  size_t entry;  // The position of the path in the status list.
+  git_oid oid;
+  bool has_oid;  // Added workdir files are only hashed when worth it.
+  uint32_t size;  // The workdir size, for unstaged paths only.
+  bool matched;
+};
+
+namespace {
+
+struct OidHash {
+  size_t operator()(const git_oid& oid) const {
+    size_t hash;
+    memcpy(&hash, oid.id, sizeof(hash));
+    return hash;
+  }
+};
+
+struct OidEqual {
+  bool operator()(const git_oid& a, const git_oid& b) const {
+    return git_oid_equal(&a, &b);
+  }
+};
+
+struct Score {
+  int similarity;
+  size_t source;
+  size_t target;
+};
+
+bool IsFile(uint32_t mode) {
+  return mode == GIT_FILEMODE_BLOB || mode == GIT_FILEMODE_BLOB_EXECUTABLE;
+}
+
+const char* BaseName(const char* path) {
+  const char* slash = strrchr(path, '/');
+  return slash ? slash + 1 : path;
+}
+
+}  // namespace
+
+StatusRenames::~StatusRenames() {
+  git_tree_free(head);
+  git_index_free(index);
+}
+
+int StatusRenames::Detect(StatusList* statuses,
+                          std::vector<StatusRename>* renames) {
+  std::vector<uint32_t> status_bits;
+  status_bits.reserve(statuses->size());
+  for (const StatusList::Entry& entry : *statuses)
+    status_bits.push_back(entry.status);
+
+  size_t found = renames->size();
+  int error = FindRenames(true, *statuses, &status_bits, renames);
+  if (error == GIT_OK)
+    error = FindRenames(false, *statuses, &status_bits, renames);
+  if (error != GIT_OK || renames->size() == found)
+    return error;
+
+  StatusList result;
+  for (size_t i = 0; i < statuses->size(); i++) {
+    const StatusList::Entry& entry = (*statuses)[i];
+    if (status_bits[i] != 0)
+      result.Add(entry.path, entry.length, status_bits[i]);
+  }
+  *statuses = std::move(result);
+  return GIT_OK;
+}
+
+int StatusRenames::FindRenames(bool staged, const StatusList& statuses,
+                               std::vector<uint32_t>* status_bits,
+                               std::vector<StatusRename>* renames) {
+  const uint32_t source_bit =
+    staged ? GIT_STATUS_INDEX_DELETED : GIT_STATUS_WT_DELETED;
+  const uint32_t target_bit = staged ? GIT_STATUS_INDEX_NEW : GIT_STATUS_WT_NEW;
+  const uint32_t renamed_bit =
+    staged ? GIT_STATUS_INDEX_RENAMED : GIT_STATUS_WT_RENAMED;
+
+  std::vector<Candidate> sources, targets;
+  bool has_targets = false;
+  for (size_t i = 0; i < statuses.size(); i++) {
+    if ((*status_bits)[i] & target_bit)
+      has_targets = true;
+  }
+  if (!has_targets)
+    return GIT_OK;
+
+  std::unordered_set<uint32_t> source_sizes;
+  for (size_t i = 0; i < statuses.size(); i++) {
+    if (!((*status_bits)[i] & source_bit))
+      continue;
+    Candidate source = {i};
+    if (LoadSource(staged, statuses[i].path, &source)) {
+      sources.push_back(source);
+      source_sizes.insert(source.size);
+    }
+  }
+  if (sources.empty())
+    return GIT_OK;
+
+  // Hashing an added workdir file means reading it, so only the ones with
+  // the size of a deleted file are hashed. The index records the size the
+  // file had in the workdir, so an unchanged file always passes.
+  const CancellationToken& token = CancellationToken::Current();
+  for (size_t i = 0; i < statuses.size(); i++) {
+    if (!((*status_bits)[i] & target_bit))
+      continue;
+    if (token.IsCancelled())
+      return GIT_EUSER;
+    Candidate target = {i};
+    if (!LoadTarget(staged, statuses[i].path, &target))
+      continue;
+    if (!staged && source_sizes.count(target.size)) {
+      target.has_oid = git_repository_hashfile(
+        &target.oid, repository, statuses[i].path, GIT_OBJ_BLOB,
+        nullptr) == GIT_OK;
+    }
+    targets.push_back(target);
+  }
+
+  // Exact renames first, preferring a deleted path with the same file name
+  // like git does.
+  std::unordered_map<git_oid, std::vector<size_t>, OidHash, OidEqual>
+    sources_by_oid;
+  for (size_t s = 0; s < sources.size(); s++)
+    sources_by_oid[sources[s].oid].push_back(s);
+
+  std::vector<std::pair<size_t, size_t>> pairs;
+  for (size_t t = 0; t < targets.size(); t++) {
+    if (!targets[t].has_oid)
+      continue;
+    auto found = sources_by_oid.find(targets[t].oid);
+    if (found == sources_by_oid.end())
+      continue;
+
+    const char* name = BaseName(statuses[targets[t].entry].path);
+    size_t best = sources.size();
+    for (size_t s : found->second) {
+      if (sources[s].matched)
+        continue;
+      if (best == sources.size())
+        best = s;
+      if (strcmp(BaseName(statuses[sources[s].entry].path), name) == 0) {
+        best = s;
+        break;
+      }
+    }
+    if (best == sources.size())
+      continue;
+    sources[best].matched = true;
+    targets[t].matched = true;
+    pairs.emplace_back(best, t);
+  }
+
+  // Then similar contents among the unmatched paths, within the limit.
+  std::vector<size_t> left_sources, left_targets;
+  for (size_t s = 0; s < sources.size(); s++) {
+    if (!sources[s].matched)
+      left_sources.push_back(s);
+  }
+  for (size_t t = 0; t < targets.size(); t++) {
+    if (!targets[t].matched)
+      left_targets.push_back(t);
+  }
+  if (threshold < 100 && !left_sources.empty() && !left_targets.empty() &&
+      left_sources.size() <= limit && left_targets.size() <= limit) {
+    std::vector<git_hashsig*> source_signatures, target_signatures;
+    for (size_t s : left_sources) {
+      source_signatures.push_back(
+        Signature(false, sources[s], statuses[sources[s].entry].path));
+    }
+    for (size_t t : left_targets) {
+      target_signatures.push_back(
+        Signature(!staged, targets[t], statuses[targets[t].entry].path));
+    }
+
+    std::vector<Score> scores;
+    int error = GIT_OK;
+    for (size_t s = 0; s < left_sources.size() && error == GIT_OK; s++) {
+      if (token.IsCancelled()) {
+        error = GIT_EUSER;
+        break;
+      }
+      if (!source_signatures[s])
+        continue;
+      for (size_t t = 0; t < left_targets.size(); t++) {
+        if (!target_signatures[t])
+          continue;
+        int similarity = git_hashsig_compare(source_signatures[s],
+                                             target_signatures[t]);
+        if (similarity >= static_cast<int>(threshold))
+          scores.push_back({similarity, left_sources[s], left_targets[t]});
+      }
+    }
+    for (git_hashsig* signature : source_signatures)
+      git_hashsig_free(signature);
+    for (git_hashsig* signature : target_signatures)
+      git_hashsig_free(signature);
+    if (error != GIT_OK)
+      return error;
+
+    std::stable_sort(scores.begin(), scores.end(),
+                     [](const Score& a, const Score& b) {
+      return a.similarity > b.similarity;
+    });
+    for (const Score& score : scores) {
+      if (sources[score.source].matched || targets[score.target].matched)
+        continue;
+      sources[score.source].matched = true;
+      targets[score.target].matched = true;
+      pairs.emplace_back(score.source, score.target);
+    }
+  }
+
+  for (const auto& pair : pairs) {
+    size_t from = sources[pair.first].entry, to = targets[pair.second].entry;
+    (*status_bits)[from] &= ~source_bit;
+    (*status_bits)[to] = ((*status_bits)[to] & ~target_bit) | renamed_bit;
+    renames->push_back({statuses[from].path, statuses[to].path});
+  }
+  return GIT_OK;
+}
+
+// Staged deletions come from HEAD and unstaged ones from the index.
+bool StatusRenames::LoadSource(bool staged, const char* path,
+                               Candidate* candidate) {
+  candidate->has_oid = true;
+  if (staged) {
+    if (!head) {
+      git_object* tree;
+      if (git_revparse_single(&tree, repository, "HEAD^{tree}") != GIT_OK)
+        return false;
+      head = reinterpret_cast<git_tree*>(tree);
+    }
+    git_tree_entry* entry;
+    if (git_tree_entry_bypath(&entry, head, path) != GIT_OK)
+      return false;
+    bool file = IsFile(git_tree_entry_filemode(entry));
+    git_oid_cpy(&candidate->oid, git_tree_entry_id(entry));
+    git_tree_entry_free(entry);
+    return file;
+  }
+
+  if (!index && git_repository_index(&index, repository) != GIT_OK)
+    return false;
+  const git_index_entry* entry = git_index_get_bypath(index, path, 0);
+  if (!entry || !IsFile(entry->mode))
+    return false;
+  git_oid_cpy(&candidate->oid, &entry->id);
+  candidate->size = entry->file_size;
+  return true;
+}
+
+// Staged additions come from the index and unstaged ones from the workdir,
+// where untracked directories that weren't recursed into are skipped.
+bool StatusRenames::LoadTarget(bool staged, const char* path,
+                               Candidate* candidate) {
+  if (staged) {
+    if (!index && git_repository_index(&index, repository) != GIT_OK)
+      return false;
+    const git_index_entry* entry = git_index_get_bypath(index, path, 0);
+    if (!entry || !IsFile(entry->mode))
+      return false;
+    git_oid_cpy(&candidate->oid, &entry->id);
+    candidate->has_oid = true;
+    return true;
+  }
+
+  const char* workdir = git_repository_workdir(repository);
+  if (!workdir)
+    return false;
+  std::string full_path = std::string(workdir) + path;
+#ifdef _WIN32
+  struct _stat64 st;
+  if (_stat64(full_path.c_str(), &st) != 0)
+    return false;
+#else
+  struct stat st;
+  if (lstat(full_path.c_str(), &st) != 0)
+    return false;
+#endif
+  if ((st.st_mode & S_IFMT) != S_IFREG)
+    return false;
+  candidate->size = static_cast<uint32_t>(st.st_size);
+  return true;
+}
+
+// Returns null for files that can't be read or are too small to compare.
+git_hashsig* StatusRenames::Signature(bool in_workdir,
+                                      const Candidate& candidate,
+                                      const char* path) {
+  git_hashsig* signature = nullptr;
+  if (in_workdir) {
+    std::string full_path = std::string(git_repository_workdir(repository)) +
+                            path;
+    if (git_hashsig_create_fromfile(&signature, full_path.c_str(),
+                                    GIT_HASHSIG_SMART_WHITESPACE) != GIT_OK)
+      return nullptr;
+    return signature;
+  }
+
+  git_blob* blob;
+  if (git_blob_lookup(&blob, repository, &candidate.oid) != GIT_OK)
+    return nullptr;
+  int error = git_hashsig_create(
+    &signature, static_cast<const char*>(git_blob_rawcontent(blob)),
+    static_cast<size_t>(git_blob_rawsize(blob)), GIT_HASHSIG_SMART_WHITESPACE);
+  git_blob_free(blob);
+  return error == GIT_OK ? signature : nullptr;
+}
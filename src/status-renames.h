@@ -0,0 +1,75 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_STATUS_RENAMES_H_
+#define SRC_STATUS_RENAMES_H_
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "git2.h"
+#include "status-list.h"
+
+struct StatusRename {
+  std::string old_path;
+  std::string new_path;
+};
+
+// Pairs up the deleted and added paths of a status scan, the staged ones
+// (HEAD to index) and the unstaged ones (index to workdir) separately.
+// Paths with identical contents are matched first, which only compares
+// oids and file sizes, so a moved directory of any size is found cheaply.
+// Similarity hashing is then only tried on what is left, and only when
+// neither side has more than |limit| paths.
+class StatusRenames {
+ public:
+  StatusRenames(git_repository* repository, unsigned threshold, size_t limit)
+    : repository(repository), threshold(threshold), limit(limit),
+      index(nullptr), head(nullptr) {}
+  ~StatusRenames();
+
+  // Folds each rename into the entry of its new path, which gets the
+  // renamed status in place of the added one, and drops the entry of its
+  // old path unless it has other changes. Returns GIT_EUSER when the
+  // current async work is cancelled.
+  int Detect(StatusList* statuses, std::vector<StatusRename>* renames);
+
+ private:
+  struct Candidate;
+
+  int FindRenames(bool staged, const StatusList& statuses,
+                  std::vector<uint32_t>* status_bits,
+                  std::vector<StatusRename>* renames);
+  bool LoadSource(bool staged, const char* path, Candidate* candidate);
+  bool LoadTarget(bool staged, const char* path, Candidate* candidate);
+  git_hashsig* Signature(bool in_workdir, const Candidate& candidate,
+                         const char* path);
+
+  git_repository* repository;
+  unsigned threshold;
+  size_t limit;
+  git_index* index;
+  git_tree* head;
+};
+
+#endif  // SRC_STATUS_RENAMES_H_
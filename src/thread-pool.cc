@@ -0,0 +1,248 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "thread-pool.h"
+
+#include <uv.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct ThreadPool::State {
+  struct Lane {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  explicit State(size_t size) : lanes(size), queued(0), next_lane(0),
+                                stopping(false) {}
+
+  bool Take(size_t index, Task* task) {
+    for (size_t i = 0; i < lanes.size(); i++) {
+      Lane& lane = lanes[(index + i) % lanes.size()];
+      std::lock_guard<std::mutex> lock(lane.mutex);
+      if (lane.tasks.empty())
+        continue;
+      // Take the oldest task from our own lane and the newest from others.
+      if (i == 0) {
+        *task = std::move(lane.tasks.front());
+        lane.tasks.pop_front();
+      } else {
+        *task = std::move(lane.tasks.back());
+        lane.tasks.pop_back();
+      }
+      queued--;
+      return true;
+    }
+    return false;
+  }
+
+  std::vector<Lane> lanes;
+  std::atomic<size_t> queued;
+  std::atomic<size_t> next_lane;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping;
+};
+
+namespace {
+
+// The pool and lane the current thread works for, if it is a pool thread.
+thread_local const void* current_state = nullptr;
+thread_local size_t current_lane = 0;
+
+}  // namespace
+
+ThreadPool::ThreadPool(size_t size)
+  : state(std::make_shared<State>(size > 0 ? size : 1)) {
+  for (size_t index = 0; index < state->lanes.size(); index++) {
+    std::shared_ptr<State> state = this->state;
+    std::thread([state, index]() {
+      current_state = state.get();
+      current_lane = index;
+      for (;;) {
+        Task task;
+        if (state->Take(index, &task)) {
+          task();
+          continue;
+        }
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->wake.wait(lock, [&]() {
+          return state->queued > 0 || state->stopping;
+        });
+        if (state->queued == 0)
+          return;
+      }
+    }).detach();
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  state->stopping = true;
+  state->wake.notify_all();
+}
+
+size_t ThreadPool::Size() const {
+  return state->lanes.size();
+}
+
+void ThreadPool::Submit(Task task) {
+  size_t index = current_state == state.get() ?
+    current_lane : state->next_lane++ % state->lanes.size();
+  {
+    std::lock_guard<std::mutex> lock(state->lanes[index].mutex);
+    state->lanes[index].tasks.push_back(std::move(task));
+  }
+  state->queued++;
+
+  // Taking the lock orders this with a thread that just found nothing to do
+  // and is about to wait.
+  std::lock_guard<std::mutex> lock(state->mutex);
+  state->wake.notify_one();
+}
+
+namespace {
+
+// Workers finished on the pool, waiting to be completed on the thread of the
+// event loop they were queued from. There is one per loop, so one per JS
+// thread; pool tasks hold a reference until they have handed their worker
+// over.
+struct Completions {
+  uv_async_t async;
+  std::mutex mutex;
+  std::vector<Nan::AsyncWorker*> finished;
+  size_t outstanding;  // Only used on the loop's thread.
+  bool closed;
+};
+
+thread_local std::shared_ptr<Completions> loop_completions;
+
+std::mutex pool_mutex;
+std::shared_ptr<ThreadPool> pool;
+
+Completions* FromHandle(uv_handle_t* handle) {
+  return static_cast<std::shared_ptr<Completions>*>(handle->data)->get();
+}
+
+void CompleteFinishedWorkers(uv_async_t* handle) {
+  Completions* completions =
+    FromHandle(reinterpret_cast<uv_handle_t*>(handle));
+  std::vector<Nan::AsyncWorker*> finished;
+  {
+    std::lock_guard<std::mutex> lock(completions->mutex);
+    finished.swap(completions->finished);
+  }
+
+  Nan::HandleScope scope;
+  for (Nan::AsyncWorker* worker : finished) {
+    worker->WorkComplete();
+    worker->Destroy();
+  }
+
+  completions->outstanding -= finished.size();
+  if (completions->outstanding == 0)
+    uv_unref(reinterpret_cast<uv_handle_t*>(&completions->async));
+}
+
+void ReleaseHandle(uv_handle_t* handle) {
+  delete static_cast<std::shared_ptr<Completions>*>(handle->data);
+}
+
+#if NODE_MAJOR_VERSION >= 10
+// Workers still running when their environment goes away can't be
+// completed any more, so they are dropped instead.
+void CloseCompletions(void* arg) {
+  std::shared_ptr<Completions> completions = loop_completions;
+  loop_completions.reset();
+  {
+    std::lock_guard<std::mutex> lock(completions->mutex);
+    completions->closed = true;
+  }
+  uv_close(reinterpret_cast<uv_handle_t*>(&completions->async),
+           ReleaseHandle);
+}
+#endif
+
+std::shared_ptr<Completions> CompletionsForCurrentLoop() {
+  if (loop_completions)
+    return loop_completions;
+
+  std::shared_ptr<Completions> completions = std::make_shared<Completions>();
+  completions->outstanding = 0;
+  completions->closed = false;
+  uv_async_init(Nan::GetCurrentEventLoop(), &completions->async,
+                CompleteFinishedWorkers);
+  completions->async.data = new std::shared_ptr<Completions>(completions);
+  uv_unref(reinterpret_cast<uv_handle_t*>(&completions->async));
+#if NODE_MAJOR_VERSION >= 10
+  node::AddEnvironmentCleanupHook(v8::Isolate::GetCurrent(), CloseCompletions,
+                                  nullptr);
+#endif
+  loop_completions = completions;
+  return completions;
+}
+
+}  // namespace
+
+void AsyncWorkerPool::SetSize(size_t size) {
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  if (size == (pool ? pool->Size() : 0))
+    return;
+  pool = size > 0 ? std::make_shared<ThreadPool>(size) : nullptr;
+}
+
+size_t AsyncWorkerPool::Size() {
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  return pool ? pool->Size() : 0;
+}
+
+void AsyncWorkerPool::Queue(Nan::AsyncWorker* worker) {
+  std::shared_ptr<ThreadPool> current_pool;
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    current_pool = pool;
+  }
+  if (!current_pool) {
+    Nan::AsyncQueueWorker(worker);
+    return;
+  }
+
+  // Keep the loop alive while any of its workers is out on the pool, like
+  // libuv does for its own thread pool's requests.
+  std::shared_ptr<Completions> completions = CompletionsForCurrentLoop();
+  if (completions->outstanding++ == 0)
+    uv_ref(reinterpret_cast<uv_handle_t*>(&completions->async));
+
+  current_pool->Submit([worker, completions]() {
+    worker->Execute();
+    std::lock_guard<std::mutex> lock(completions->mutex);
+    if (completions->closed)
+      return;
+    completions->finished.push_back(worker);
+    uv_async_send(&completions->async);
+  });
+}
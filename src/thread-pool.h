@@ -0,0 +1,69 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_THREAD_POOL_H_
+#define SRC_THREAD_POOL_H_
+
+#include <stddef.h>
+
+#include <functional>
+#include <memory>
+
+#include "nan.h"
+
+// A fixed set of threads, each with its own task queue. Tasks submitted from
+// outside the pool are spread over the queues round-robin, tasks submitted
+// from a pool thread go to that thread's queue, and a thread whose queue is
+// empty steals the newest task of another before going to sleep.
+class ThreadPool {
+ public:
+  typedef std::function<void()> Task;
+
+  explicit ThreadPool(size_t size);
+
+  // Returns without waiting: the threads finish the tasks already queued
+  // and then exit on their own.
+  ~ThreadPool();
+
+  size_t Size() const;
+  void Submit(Task task);
+
+ private:
+  struct State;
+
+  std::shared_ptr<State> state;
+};
+
+// Runs Nan async workers on the module's own thread pool instead of libuv's,
+// so that long git operations don't hold up file system, DNS and zlib work
+// elsewhere in the process. Finished workers are handed back to the event
+// loop they were queued from through a uv_async_t, which makes this work the
+// same way from worker threads.
+class AsyncWorkerPool {
+ public:
+  // Zero, the default, queues workers on libuv's thread pool.
+  static void SetSize(size_t size);
+  static size_t Size();
+
+  static void Queue(Nan::AsyncWorker* worker);
+};
+
+#endif  // SRC_THREAD_POOL_H_
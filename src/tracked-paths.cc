@@ -0,0 +1,113 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "tracked-paths.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+void TrackedPaths::FindPrefix(const std::string& prefix, size_t* begin,
+                              size_t* end) const {
+  auto compare = [&](size_t index, size_t length) {
+    uint32_t start = offsets[index];
+    uint32_t path_length = offsets[index + 1] - start;
+    return paths.compare(start, std::min<size_t>(path_length, length), prefix,
+                         0, length);
+  };
+
+  size_t low = 0, high = size();
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (compare(middle, prefix.size()) < 0)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  *begin = low;
+
+  high = size();
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (compare(middle, prefix.size()) <= 0)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  *end = low;
+}
+
+std::shared_ptr<const TrackedPaths> TrackedPathsCache::Get(git_index* index) {
+  git_oid checksum;
+  memset(&checksum, 0, sizeof(checksum));
+  if (const git_oid* index_checksum = git_index_checksum(index))
+    git_oid_cpy(&checksum, index_checksum);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (current && git_oid_equal(&current->index_checksum, &checksum))
+      return current;
+  }
+
+  auto listing = std::make_shared<TrackedPaths>();
+  git_oid_cpy(&listing->index_checksum, &checksum);
+  size_t count = git_index_entrycount(index);
+  listing->offsets.reserve(count + 1);
+  listing->modes.reserve(count);
+  listing->oids.reserve(count * GIT_OID_RAWSZ);
+  listing->sizes.reserve(count);
+  listing->offsets.push_back(0);
+
+  const char* previous_path = nullptr;
+  for (size_t i = 0; i < count; i++) {
+    const git_index_entry* entry = git_index_get_byindex(index, i);
+    if (previous_path && strcmp(previous_path, entry->path) == 0)
+      continue;
+    previous_path = entry->path;
+
+    listing->paths.append(entry->path);
+    listing->offsets.push_back(listing->paths.size());
+    listing->modes.push_back(entry->mode);
+    listing->oids.insert(listing->oids.end(), entry->id.id,
+                         entry->id.id + GIT_OID_RAWSZ);
+    listing->sizes.push_back(entry->file_size);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  current = listing;
+  return listing;
+}
+
+void TrackedPathsCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  current.reset();
+}
+
+size_t TrackedPathsCache::MemoryUsage() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!current)
+    return 0;
+  return current->paths.capacity() +
+         current->offsets.capacity() * sizeof(uint32_t) +
+         current->modes.capacity() * sizeof(uint32_t) +
+         current->oids.capacity() +
+         current->sizes.capacity() * sizeof(uint32_t);
+}
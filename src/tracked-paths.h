@@ -0,0 +1,68 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_TRACKED_PATHS_H_
+#define SRC_TRACKED_PATHS_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "git2.h"
+
+// Every path in the index, in index order, packed into a single UTF-8
+// buffer. Entry i's path is the bytes from offsets[i] to offsets[i + 1].
+// Conflicted paths are listed once.
+struct TrackedPaths {
+  git_oid index_checksum;
+  std::string paths;
+  std::vector<uint32_t> offsets;  // One more than the number of entries.
+  std::vector<uint32_t> modes;
+  std::vector<unsigned char> oids;  // GIT_OID_RAWSZ bytes per entry.
+  std::vector<uint32_t> sizes;  // The working directory size when staged.
+
+  size_t size() const { return modes.size(); }
+
+  // Finds the entries whose paths start with |prefix|, which are next to
+  // each other since the index is sorted.
+  void FindPrefix(const std::string& prefix, size_t* begin, size_t* end) const;
+};
+
+// The tracked paths of a repository's index, rebuilt only when the index
+// checksum changes. Listings are immutable once built, so callers can keep
+// using one after the cache has moved on to a newer index.
+class TrackedPathsCache {
+ public:
+  std::shared_ptr<const TrackedPaths> Get(git_index* index);
+  void Clear();
+
+  // The memory held by the current listing.
+  size_t MemoryUsage();
+
+ private:
+  std::mutex mutex;
+  std::shared_ptr<const TrackedPaths> current;
+};
+
+#endif  // SRC_TRACKED_PATHS_H_
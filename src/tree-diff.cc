@@ -0,0 +1,241 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "tree-diff.h"
+
+#include <string.h>
+
+#include "cancellation.h"
+
+namespace {
+
+bool IsTree(const git_tree_entry* entry) {
+  return git_tree_entry_filemode(entry) == GIT_FILEMODE_TREE;
+}
+
+// Orders entries the way git sorts them within a tree, where a tree sorts
+// as if its name ended with a slash.
+int CompareEntryNames(const git_tree_entry* a, const git_tree_entry* b) {
+  const char* a_name = git_tree_entry_name(a);
+  const char* b_name = git_tree_entry_name(b);
+  size_t a_length = strlen(a_name);
+  size_t b_length = strlen(b_name);
+  size_t length = a_length < b_length ? a_length : b_length;
+
+  int result = memcmp(a_name, b_name, length);
+  if (result != 0)
+    return result;
+
+  unsigned char a_next = a_length > length ? a_name[length] : (IsTree(a) ? '/' : 0);
+  unsigned char b_next = b_length > length ? b_name[length] : (IsTree(b) ? '/' : 0);
+  return a_next - b_next;
+}
+
+}  // namespace
+
+int TreeDiff::Compare(const git_tree* old_tree, const git_tree* new_tree,
+                      ChangedPaths* result) {
+  this->result = result;
+  std::string prefix;
+  return CompareTrees(old_tree, new_tree, &prefix);
+}
+
+int TreeDiff::CompareTrees(const git_tree* old_tree, const git_tree* new_tree,
+                           std::string* prefix) {
+  if (CancellationToken::Current().IsCancelled())
+    return GIT_EUSER;
+
+  size_t old_count = old_tree ? git_tree_entrycount(old_tree) : 0;
+  size_t new_count = new_tree ? git_tree_entrycount(new_tree) : 0;
+  size_t i = 0, j = 0;
+  while (i < old_count || j < new_count) {
+    const git_tree_entry* old_entry =
+      i < old_count ? git_tree_entry_byindex(old_tree, i) : NULL;
+    const git_tree_entry* new_entry =
+      j < new_count ? git_tree_entry_byindex(new_tree, j) : NULL;
+
+    int order = !old_entry ? 1 : !new_entry ? -1 :
+      CompareEntryNames(old_entry, new_entry);
+    int error;
+    if (order < 0) {
+      error = CompareEntries(old_entry, NULL, prefix);
+      i++;
+    } else if (order > 0) {
+      error = CompareEntries(NULL, new_entry, prefix);
+      j++;
+    } else {
+      error = CompareEntries(old_entry, new_entry, prefix);
+      i++;
+      j++;
+    }
+    if (error != GIT_OK)
+      return error;
+  }
+  return GIT_OK;
+}
+
+int TreeDiff::CompareEntries(const git_tree_entry* old_entry,
+                             const git_tree_entry* new_entry,
+                             std::string* prefix) {
+  if (old_entry && new_entry &&
+      git_oid_equal(git_tree_entry_id(old_entry), git_tree_entry_id(new_entry)) &&
+      git_tree_entry_filemode(old_entry) == git_tree_entry_filemode(new_entry))
+    return GIT_OK;
+
+  if (!new_entry) {
+    return IsTree(old_entry) ? AddTree(old_entry, GIT_DELTA_DELETED, prefix) :
+      AddBlob(*prefix + git_tree_entry_name(old_entry), old_entry, NULL,
+              GIT_DELTA_DELETED);
+  }
+  if (!old_entry) {
+    return IsTree(new_entry) ? AddTree(new_entry, GIT_DELTA_ADDED, prefix) :
+      AddBlob(*prefix + git_tree_entry_name(new_entry), NULL, new_entry,
+              GIT_DELTA_ADDED);
+  }
+
+  // Entries only match by name when both are trees or neither is.
+  if (IsTree(old_entry)) {
+    git_tree* old_tree;
+    git_tree* new_tree;
+    int error = git_tree_lookup(&old_tree, repository,
+                                git_tree_entry_id(old_entry));
+    if (error != GIT_OK)
+      return error;
+    error = git_tree_lookup(&new_tree, repository,
+                            git_tree_entry_id(new_entry));
+    if (error != GIT_OK) {
+      git_tree_free(old_tree);
+      return error;
+    }
+
+    size_t length = prefix->size();
+    prefix->append(git_tree_entry_name(old_entry));
+    prefix->push_back('/');
+    error = CompareTrees(old_tree, new_tree, prefix);
+    prefix->resize(length);
+    git_tree_free(old_tree);
+    git_tree_free(new_tree);
+    return error;
+  }
+
+  git_filemode_t old_mode = git_tree_entry_filemode(old_entry);
+  git_filemode_t new_mode = git_tree_entry_filemode(new_entry);
+  bool old_blob = old_mode == GIT_FILEMODE_BLOB ||
+    old_mode == GIT_FILEMODE_BLOB_EXECUTABLE;
+  bool new_blob = new_mode == GIT_FILEMODE_BLOB ||
+    new_mode == GIT_FILEMODE_BLOB_EXECUTABLE;
+  git_delta_t status = old_mode == new_mode || (old_blob && new_blob) ?
+    GIT_DELTA_MODIFIED : GIT_DELTA_TYPECHANGE;
+  return AddBlob(*prefix + git_tree_entry_name(old_entry), old_entry,
+                 new_entry, status);
+}
+
+int TreeDiff::AddTree(const git_tree_entry* entry, git_delta_t status,
+                      std::string* prefix) {
+  git_tree* tree;
+  int error = git_tree_lookup(&tree, repository, git_tree_entry_id(entry));
+  if (error != GIT_OK)
+    return error;
+
+  size_t length = prefix->size();
+  prefix->append(git_tree_entry_name(entry));
+  prefix->push_back('/');
+  if (status == GIT_DELTA_DELETED)
+    error = CompareTrees(tree, NULL, prefix);
+  else
+    error = CompareTrees(NULL, tree, prefix);
+  prefix->resize(length);
+  git_tree_free(tree);
+  return error;
+}
+
+int TreeDiff::AddBlob(const std::string& path, const git_tree_entry* old_entry,
+                      const git_tree_entry* new_entry, git_delta_t status) {
+  result->paths.push_back(path);
+  result->statuses.push_back(status);
+  if (!line_stats)
+    return GIT_OK;
+
+  // Submodules have no content to count lines in.
+  git_blob* old_blob = NULL;
+  git_blob* new_blob = NULL;
+  if (old_entry && git_tree_entry_type(old_entry) == GIT_OBJ_BLOB)
+    git_blob_lookup(&old_blob, repository, git_tree_entry_id(old_entry));
+  if (new_entry && git_tree_entry_type(new_entry) == GIT_OBJ_BLOB)
+    git_blob_lookup(&new_blob, repository, git_tree_entry_id(new_entry));
+
+  size_t additions = 0, deletions = 0;
+  if (old_blob || new_blob) {
+    git_patch* patch;
+    if (git_patch_from_blobs(&patch, old_blob, path.c_str(), new_blob,
+                             path.c_str(), NULL) == GIT_OK) {
+      size_t context;
+      git_patch_line_stats(&context, &additions, &deletions, patch);
+      git_patch_free(patch);
+    }
+  }
+  git_blob_free(old_blob);
+  git_blob_free(new_blob);
+
+  result->additions.push_back(additions);
+  result->deletions.push_back(deletions);
+  return GIT_OK;
+}
+
+int TreeDiff::CompareWithRenames(git_tree* old_tree, git_tree* new_tree,
+                                 ChangedPaths* result) {
+  git_diff_options options = GIT_DIFF_OPTIONS_INIT;
+  git_diff* diff;
+  int error = git_diff_tree_to_tree(&diff, repository, old_tree, new_tree,
+                                    &options);
+  if (error != GIT_OK)
+    return error;
+
+  git_diff_find_options find_options = GIT_DIFF_FIND_OPTIONS_INIT;
+  find_options.flags = GIT_DIFF_FIND_RENAMES;
+  error = git_diff_find_similar(diff, &find_options);
+  if (error != GIT_OK) {
+    git_diff_free(diff);
+    return error;
+  }
+
+  size_t count = git_diff_num_deltas(diff);
+  for (size_t i = 0; i < count; i++) {
+    const git_diff_delta* delta = git_diff_get_delta(diff, i);
+    result->paths.push_back(delta->new_file.path);
+    result->old_paths.push_back(delta->old_file.path);
+    result->statuses.push_back(delta->status);
+    if (!line_stats)
+      continue;
+
+    size_t context = 0, additions = 0, deletions = 0;
+    git_patch* patch;
+    if (git_patch_from_diff(&patch, diff, i) == GIT_OK) {
+      if (patch)
+        git_patch_line_stats(&context, &additions, &deletions, patch);
+      git_patch_free(patch);
+    }
+    result->additions.push_back(additions);
+    result->deletions.push_back(deletions);
+  }
+  git_diff_free(diff);
+  return GIT_OK;
+}
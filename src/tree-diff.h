@@ -0,0 +1,74 @@
+// Copyright (c) 2013 GitHub Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_TREE_DIFF_H_
+#define SRC_TREE_DIFF_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "git2.h"
+
+// The paths that differ between two trees, stored column by column so they
+// can be handed to JS as a few typed arrays. Statuses are git_delta_t values.
+struct ChangedPaths {
+  std::vector<std::string> paths;
+  std::vector<std::string> old_paths;  // Only filled in for renames.
+  std::vector<uint8_t> statuses;
+  std::vector<uint32_t> additions;  // Only filled in with line stats.
+  std::vector<uint32_t> deletions;
+};
+
+// Compares two trees by walking them side by side. Subtrees with the same
+// oid on both sides are skipped without being loaded, so the cost depends on
+// the size of the change rather than the size of the trees.
+class TreeDiff {
+ public:
+  TreeDiff(git_repository* repository, bool line_stats)
+    : repository(repository), line_stats(line_stats) {}
+
+  // Either tree may be null to diff against an empty tree.
+  int Compare(const git_tree* old_tree, const git_tree* new_tree,
+              ChangedPaths* result);
+
+  // Uses libgit2's diff with rename detection instead of the tree walk, as
+  // finding renames needs all added and deleted paths at once.
+  int CompareWithRenames(git_tree* old_tree, git_tree* new_tree,
+                         ChangedPaths* result);
+
+ private:
+  int CompareTrees(const git_tree* old_tree, const git_tree* new_tree,
+                   std::string* prefix);
+  int CompareEntries(const git_tree_entry* old_entry,
+                     const git_tree_entry* new_entry, std::string* prefix);
+  int AddTree(const git_tree_entry* entry, git_delta_t status,
+              std::string* prefix);
+  int AddBlob(const std::string& path, const git_tree_entry* old_entry,
+              const git_tree_entry* new_entry, git_delta_t status);
+
+  git_repository* repository;
+  bool line_stats;
+  ChangedPaths* result;
+};
+
+#endif  // SRC_TREE_DIFF_H_